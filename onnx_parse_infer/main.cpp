@@ -2,322 +2,2904 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <set>
 #include <memory>
 #include <iostream>
 #include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <stdint.h>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
+#include <random>
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define ENGINE_SSE
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define ENGINE_NEON
+#endif
+#ifdef _WIN32
+#include <malloc.h>
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 #include "onnx.proto3.pb.h"
 
 
-//  spconv_infer1.py
-class BaseNode : std::enable_shared_from_this<BaseNode> {
-
-public:
-	BaseNode() {}
-	virtual ~BaseNode() {}
-
-	virtual void update() {}
-
+// 取值与onnx::TensorProto_DataType一致
+enum class DataType : int {
+	Float32 = 1,
+	Int32 = 6,
+	Int64 = 7
 };
 
-class Tensor : std::enable_shared_from_this<Tensor> {
-public:
-	Tensor(const std::string& name, BaseNode* parent = nullptr) :
-		name_(name),
-		value_(0.f)
+static size_t element_size(DataType dtype) {
+	switch (dtype)
 	{
-		parent_ = parent;
+	case DataType::Float32: return sizeof(float);
+	case DataType::Int32: return sizeof(int32_t);
+	case DataType::Int64: return sizeof(int64_t);
 	}
+	return 0;
+}
 
-	~Tensor() {
-	}
+static bool is_supported_dtype(int dtype) {
+	return dtype == (int)DataType::Float32 || dtype == (int)DataType::Int32 || dtype == (int)DataType::Int64;
+}
+
+// arena和其中每个张量的起始地址都按缓存行对齐，也满足AVX-512的对齐加载
+static const size_t kArenaAlignment = 64;
+
+static size_t align_up(size_t size, size_t alignment) {
+	return (size + alignment - 1) / alignment * alignment;
+}
+
+static void* aligned_malloc(size_t size, size_t alignment) {
+#ifdef _WIN32
+	return _aligned_malloc(size, alignment);
+#else
+	void* ptr = nullptr;
+	if (posix_memalign(&ptr, alignment, size) != 0)
+		return nullptr;
+	return ptr;
+#endif
+}
+
+static void aligned_free(void* ptr) {
+#ifdef _WIN32
+	_aligned_free(ptr);
+#else
+	free(ptr);
+#endif
+}
+
+// 只读映射整个文件，页面在第一次访问时才从文件载入，映射同一个文件的进程共享物理页
+class MappedFile {
+public:
+	MappedFile() {}
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile() { this->close(); }
 
+	bool open(const std::string& file) {
+		this->close();
+#ifdef _WIN32
+		HANDLE handle = CreateFileA(file.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (handle == INVALID_HANDLE_VALUE)
+			return false;
 
-	void update() {
-		if (this->parent_ != nullptr)
+		LARGE_INTEGER size;
+		HANDLE mapping = nullptr;
+		if (GetFileSizeEx(handle, &size) && size.QuadPart > 0)
+			mapping = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping)
 		{
-			this->parent_->update();
+			this->data_ = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			CloseHandle(mapping);
 		}
+		CloseHandle(handle);
+		if (this->data_ == nullptr)
+			return false;
+		this->size_ = (size_t)size.QuadPart;
+#else
+		int fd = ::open(file.c_str(), O_RDONLY);
+		if (fd < 0)
+			return false;
+
+		struct stat st;
+		void* data = MAP_FAILED;
+		if (fstat(fd, &st) == 0 && st.st_size > 0)
+			data = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (data == MAP_FAILED)
+			return false;
+		this->data_ = data;
+		this->size_ = (size_t)st.st_size;
+#endif
+		return true;
 	}
-public:
-	std::string name_;
-	float value_;
-	BaseNode* parent_;  // 父类指针
+
+	void close() {
+		if (this->data_ == nullptr)
+			return;
+#ifdef _WIN32
+		UnmapViewOfFile(this->data_);
+#else
+		munmap(this->data_, this->size_);
+#endif
+		this->data_ = nullptr;
+		this->size_ = 0;
+	}
+
+	const uint8_t* data() const { return static_cast<const uint8_t*>(this->data_); }
+	size_t size() const { return this->size_; }
+
+private:
+	void* data_{ nullptr };
+	size_t size_{ 0 };
 };
 
-class Node : public BaseNode, std::enable_shared_from_this<Node> {
+/**
+ * protobuf wire format的最小读取器，只用来在映射的模型中定位字段，不拷贝数据
+ * tag = (field << 3) | wire_type，wire_type 0为varint，1为64位，2为带长度的字节串，5为32位
+ */
+class WireReader {
 public:
-	Node(const std::string& name, const std::string& op_type) :
-		name_(name),
-		op_type_(op_type)
-	{
-		input_.clear();
-		//output_.clear();
+	WireReader(const uint8_t* data, size_t size) : p_(data), end_(data + size) {}
+
+	bool done() const { return this->failed_ || this->p_ >= this->end_; }
+	bool failed() const { return this->failed_; }
+	const uint8_t* position() const { return this->p_; }
+
+	bool read_tag(uint32_t* field, uint32_t* wire_type) {
+		uint64_t tag = 0;
+		if (!this->read_varint(&tag) || (tag >> 3) == 0)
+			return this->fail();
+		*field = (uint32_t)(tag >> 3);
+		*wire_type = (uint32_t)(tag & 7);
+		return true;
 	}
-	virtual  ~Node() {}
-	void update() {
-		if (!this->is_computed_) {
-			this->is_computed_ = true;
 
-			for (const auto& x : input_)
+	bool read_varint(uint64_t* value) {
+		uint64_t v = 0;
+		for (int shift = 0; shift < 64 && this->p_ < this->end_; shift += 7)
+		{
+			uint8_t b = *this->p_++;
+			v |= (uint64_t)(b & 0x7f) << shift;
+			if ((b & 0x80) == 0)
 			{
-				x->update();
+				*value = v;
+				return true;
 			}
-
-			this->forward();
 		}
+		return this->fail();
 	}
 
-	virtual void forward() {};
-
-public:
-	std::string name_{ "" };
-	std::string op_type_{ "" };
-	bool is_computed_{ false };
-	std::vector<Tensor*> input_;
-	Tensor* output_{ nullptr };
-};
-
-class SparseConvolution : public Node {
-public:
-	SparseConvolution(const std::string& name, Tensor* x, const std::string& attr) : Node(name, "SparseConvolution") {
-		attributes_ = attr;
-		this->input_.push_back(x);
-		std::string n = name + ".ouput";
-		auto parent = dynamic_cast<BaseNode*>(this);
-		this->output_ = new Tensor(n, parent);
+	bool read_bytes(const uint8_t** data, size_t* size) {
+		uint64_t n = 0;
+		if (!this->read_varint(&n) || n > (uint64_t)(this->end_ - this->p_))
+			return this->fail();
+		*data = this->p_;
+		*size = (size_t)n;
+		this->p_ += n;
+		return true;
 	}
-	~SparseConvolution() {
-		if (this->output_)
+
+	// 跳过当前字段的值，group(3、4)已经废弃，onnx中不会出现
+	bool skip(uint32_t wire_type) {
+		uint64_t v = 0;
+		const uint8_t* data = nullptr;
+		size_t size = 0;
+		switch (wire_type)
 		{
-			delete output_;
-			output_ = nullptr;
+		case 0: return this->read_varint(&v);
+		case 1: return this->advance(8);
+		case 2: return this->read_bytes(&data, &size);
+		case 5: return this->advance(4);
+		default: return this->fail();
 		}
 	}
 
+private:
+	bool advance(size_t n) {
+		if (n > (size_t)(this->end_ - this->p_))
+			return this->fail();
+		this->p_ += n;
+		return true;
+	}
 
-	void forward() override {
-		this->output_->value_ = this->input_[0]->value_ * 0.5;
-		printf("Do %s x[%f] * 0.5, output = %f\n", this->op_type_.c_str(), this->input_[0]->value_, this->output_->value_);
+	bool fail() {
+		this->failed_ = true;
+		return false;
 	}
 
-private:
-	std::string attributes_;
+	const uint8_t* p_;
+	const uint8_t* end_;
+	bool failed_{ false };
 };
 
-class ReLU : public Node {
-public:
-	ReLU(const std::string& name, Tensor* x) :
-		Node(name, "ReLU") {
-		this->input_.push_back(x);
-		std::string n = name + ".ouput";
-		auto parent = dynamic_cast<BaseNode*>(this);
-		this->output_ = new Tensor(n, parent);
-	}
-	~ReLU() {
-		if (this->output_)
+// 映射中的一个initializer，message为整个TensorProto，raw_data为空时需要完整解析message
+struct InitializerSpan {
+	const uint8_t* message{ nullptr };
+	size_t message_size{ 0 };
+	std::string name;
+	int data_type{ 0 };
+	std::vector<int64_t> dims;
+	const uint8_t* raw_data{ nullptr };
+	size_t raw_size{ 0 };
+	bool external{ false };  // data_location = EXTERNAL，数据在另外的文件中
+};
+
+// TensorProto: dims = 1, data_type = 2, name = 8, raw_data = 9, data_location = 14
+static bool scan_tensor(const uint8_t* data, size_t size, InitializerSpan* span) {
+	span->message = data;
+	span->message_size = size;
+	WireReader reader(data, size);
+	while (!reader.done())
+	{
+		uint32_t field = 0, wire_type = 0;
+		uint64_t value = 0;
+		const uint8_t* bytes = nullptr;
+		size_t length = 0;
+		if (!reader.read_tag(&field, &wire_type))
+			break;
+
+		if (field == 1 && wire_type == 0 && reader.read_varint(&value))
+			span->dims.push_back((int64_t)value);
+		else if (field == 1 && wire_type == 2 && reader.read_bytes(&bytes, &length))
 		{
-			delete output_;
-			output_ = nullptr;
+			// proto3默认打包的repeated int64
+			WireReader packed(bytes, length);
+			while (!packed.done() && packed.read_varint(&value))
+				span->dims.push_back((int64_t)value);
+			if (packed.failed())
+				return false;
 		}
+		else if (field == 2 && wire_type == 0 && reader.read_varint(&value))
+			span->data_type = (int)value;
+		else if (field == 8 && wire_type == 2 && reader.read_bytes(&bytes, &length))
+			span->name.assign((const char*)bytes, length);
+		else if (field == 9 && wire_type == 2)
+			reader.read_bytes(&span->raw_data, &span->raw_size);
+		else if (field == 14 && wire_type == 0 && reader.read_varint(&value))
+			span->external = value == onnx::TensorProto_DataLocation_EXTERNAL;
+		else
+			reader.skip(wire_type);
 	}
+	return !reader.failed();
+}
+
+/**
+ * ModelProto.graph = 7，GraphProto.initializer = 5
+ * initializer只记录位置，graph的其余字段原样拼接到graph中，之后单独解析。
+ * 出现多次的graph按protobuf的规则合并，拼接后再解析的结果与之相同
+ */
+static bool scan_model(const uint8_t* data, size_t size, std::string* graph, std::vector<InitializerSpan>* initializers) {
+	WireReader model(data, size);
+	while (!model.done())
+	{
+		uint32_t field = 0, wire_type = 0;
+		if (!model.read_tag(&field, &wire_type))
+			break;
+		if (field != 7 || wire_type != 2)
+		{
+			model.skip(wire_type);
+			continue;
+		}
+
+		const uint8_t* body = nullptr;
+		size_t body_size = 0;
+		if (!model.read_bytes(&body, &body_size))
+			break;
 
+		WireReader reader(body, body_size);
+		while (!reader.done())
+		{
+			const uint8_t* begin = reader.position();
+			if (!reader.read_tag(&field, &wire_type))
+				break;
 
-	void forward() override {
-		this->output_->value_ = std::max(0.f, this->input_[0]->value_);
-		printf("Do %s max(0, x[%f]), output = %f\n", this->op_type_.c_str(), this->input_[0]->value_, this->output_->value_);
+			const uint8_t* message = nullptr;
+			size_t message_size = 0;
+			if (field == 5 && wire_type == 2)
+			{
+				initializers->push_back(InitializerSpan());
+				if (!reader.read_bytes(&message, &message_size) || !scan_tensor(message, message_size, &initializers->back()))
+					return false;
+			}
+			else if (reader.skip(wire_type))
+				graph->append((const char*)begin, reader.position() - begin);
+		}
+		if (reader.failed())
+			return false;
 	}
-};
+	return !model.failed();
+}
 
-class Add : public Node {
+// onnx节点的属性，标量也按长度为1的列表保存
+class Attributes {
 public:
-	Add(const std::string& name, Tensor* a, Tensor* b) :
-		Node(name, "Add") {
-		this->input_.push_back(a);
-		this->input_.push_back(b);
-		std::string n = name + ".ouput";
-		auto parent = dynamic_cast<BaseNode*>(this);
-		this->output_ = new Tensor(n, parent);
-	}
-	~Add() {
-		if (this->output_)
+	Attributes() {}
+	Attributes(const onnx::NodeProto& node) {
+		for (const auto& a : node.attribute())
 		{
-			delete output_;
-			output_ = nullptr;
+			switch (a.type())
+			{
+			case onnx::AttributeProto_AttributeType_INT: ints_[a.name()] = { a.i() }; break;
+			case onnx::AttributeProto_AttributeType_INTS: ints_[a.name()].assign(a.ints().begin(), a.ints().end()); break;
+			case onnx::AttributeProto_AttributeType_FLOAT: floats_[a.name()] = { a.f() }; break;
+			case onnx::AttributeProto_AttributeType_FLOATS: floats_[a.name()].assign(a.floats().begin(), a.floats().end()); break;
+			case onnx::AttributeProto_AttributeType_STRING: strings_[a.name()] = a.s(); break;
+			default: break;
+			}
 		}
 	}
 
-
-	void forward() override {
-		this->output_->value_ = this->input_[0]->value_ + this->input_[1]->value_;
-		printf("Do %s a[%f] + b[%f], output = %f\n", this->op_type_.c_str(), this->input_[0]->value_, this->input_[1]->value_, this->output_->value_);
+	int64_t get_int(const std::string& name, int64_t default_value) const {
+		auto it = ints_.find(name);
+		return it == ints_.end() || it->second.empty() ? default_value : it->second[0];
 	}
-};
 
-class BatchNormalization : public Node {
-public:
-	BatchNormalization(const std::string& name, Tensor* x, const std::string& attr) :
-		Node(name, "BatchNormalization") {
-		attributes_ = attr;
-		this->input_.push_back(x);
-		std::string n = name + ".ouput";
-		auto parent = dynamic_cast<BaseNode*>(this);
-		this->output_ = new Tensor(n, parent);
-	}
-	~BatchNormalization() {
-		if (this->output_)
-		{
-			delete output_;
-			output_ = nullptr;
-		}
+	std::vector<int64_t> get_ints(const std::string& name) const {
+		auto it = ints_.find(name);
+		return it == ints_.end() ? std::vector<int64_t>() : it->second;
 	}
 
+	float get_float(const std::string& name, float default_value) const {
+		auto it = floats_.find(name);
+		return it == floats_.end() || it->second.empty() ? default_value : it->second[0];
+	}
 
-	void forward() override {
-		this->output_->value_ = this->input_[0]->value_ + 0.1;
-		printf("Do %s x[%f] +0.1, output = %f\n", this->op_type_.c_str(), this->input_[0]->value_, this->output_->value_);
+	std::string get_string(const std::string& name, const std::string& default_value = "") const {
+		auto it = strings_.find(name);
+		return it == strings_.end() ? default_value : it->second;
 	}
 
 private:
-	std::string attributes_;
+	std::map<std::string, std::vector<int64_t>> ints_;
+	std::map<std::string, std::vector<float>> floats_;
+	std::map<std::string, std::string> strings_;
 };
 
-class Engine {
+/**
+ * 算子内部的fork-join线程池
+ * parallel_for把任务编号分给调用线程和池中的线程，全部完成后返回，thread为0到num_threads-1，用于选择各线程的临时缓冲区。
+ * 并行执行器的多个线程同时调用时按调用顺序串行执行
+ */
+class ThreadPool {
 public:
-	Engine() {}
-	~Engine() {
-		// 析构
-		for (int i = 0; i < this->inputs_.size(); ++i)
+	typedef void(*Task)(void* context, int task, int thread);
+
+	ThreadPool(int num_threads) {
+		this->num_threads_ = std::max(1, num_threads);
+		for (int i = 1; i < this->num_threads_; ++i)
+			this->threads_.push_back(std::thread(&ThreadPool::worker, this, i));
+	}
+
+	~ThreadPool() {
 		{
-			if (this->inputs_[i])
-			{
-				delete this->inputs_[i];
-				this->inputs_[i] = nullptr;
-			}
+			std::unique_lock<std::mutex> lock(this->mutex_);
+			this->stop_ = true;
 		}
-		for (int i = 0; i < this->outputs_.size(); ++i)
+		this->wakeup_.notify_all();
+		for (auto& t : this->threads_)
+			t.join();
+	}
+
+	int num_threads() const { return this->num_threads_; }
+
+	void parallel_for(int num_tasks, Task fn, void* context) {
+		if (num_tasks <= 1 || this->num_threads_ == 1)
 		{
-			if (this->outputs_[i])
-			{
-				delete this->outputs_[i];
-				this->outputs_[i] = nullptr;
-			}
+			for (int i = 0; i < num_tasks; ++i)
+				fn(context, i, 0);
+			return;
 		}
-		for (int i = 0; i < this->nodes_.size(); ++i)
+
+		std::lock_guard<std::mutex> call(this->call_mutex_);
 		{
-			if (this->nodes_[i])
-			{
-				delete this->nodes_[i];
-				this->nodes_[i] = nullptr;
-			}
+			std::unique_lock<std::mutex> lock(this->mutex_);
+			this->fn_ = fn;
+			this->context_ = context;
+			this->num_tasks_ = num_tasks;
+			this->next_.store(0);
+			this->active_ = this->num_threads_ - 1;
+			this->generation_++;
 		}
+		this->wakeup_.notify_all();
+		this->run_tasks(0);
 
+		std::unique_lock<std::mutex> lock(this->mutex_);
+		this->finished_.wait(lock, [&] { return this->active_ == 0; });
 	}
 
-	Tensor* add_input(const std::string& name)
-	{
-		auto x = new Tensor(name);
-		this->inputs_.push_back(x);
-		return x;
-	}
-	Tensor* mark_output(Tensor* x) {
-		this->outputs_.push_back(x);
-		return x;
+private:
+	void run_tasks(int thread) {
+		for (int i = this->next_.fetch_add(1); i < this->num_tasks_; i = this->next_.fetch_add(1))
+			this->fn_(this->context_, i, thread);
 	}
 
-	Node* add_spconv(const std::string& name, Tensor* x, std::string attributes = "") {
-		auto spc = new SparseConvolution(name, x, attributes);
-		this->nodes_.push_back(spc);
-		return spc;
+	void worker(int thread) {
+		uint64_t seen = 0;
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lock(this->mutex_);
+				this->wakeup_.wait(lock, [&] { return this->stop_ || this->generation_ != seen; });
+				if (this->stop_)
+					return;
+				seen = this->generation_;
+			}
+
+			this->run_tasks(thread);
+
+			std::unique_lock<std::mutex> lock(this->mutex_);
+			if (--this->active_ == 0)
+				this->finished_.notify_one();
+		}
 	}
 
-	Node* add_relu(const std::string& name, Tensor* x) {
-		auto relu = new ReLU(name, x);
-		this->nodes_.push_back(relu);
-		return relu;
+private:
+	int num_threads_{ 1 };
+	std::vector<std::thread> threads_;
+	std::mutex call_mutex_;
+	std::mutex mutex_;
+	std::condition_variable wakeup_;
+	std::condition_variable finished_;
+	Task fn_{ nullptr };
+	void* context_{ nullptr };
+	int num_tasks_{ 0 };
+	std::atomic<int> next_{ 0 };
+	uint64_t generation_{ 0 };
+	int active_{ 0 };
+	bool stop_{ false };
+};
+
+// 开放寻址的哈希表，键为体素的线性化坐标，值为行号，容量在load时按最大行数分配
+class CoordinateHash {
+public:
+	void reserve(int64_t max_items) {
+		size_t capacity = 16;
+		while (capacity < (size_t)max_items * 2)
+			capacity <<= 1;
+		this->keys_.assign(capacity, -1);
+		this->values_.assign(capacity, -1);
+		this->mask_ = capacity - 1;
 	}
 
-	Node* add_add(const std::string& name, Tensor* a, Tensor* b) {
-		auto add = new Add(name, a, b);
-		this->nodes_.push_back(add);
-		return add;
+	void clear() {
+		std::fill(this->keys_.begin(), this->keys_.end(), -1);
 	}
 
-	Node* add_bn(const std::string& name, Tensor* x, std::string attributes = "") {
-		auto bn = new BatchNormalization(name, x, attributes);
-		this->nodes_.push_back(bn);
-		return bn;
+	void insert(int64_t key, int32_t value) {
+		size_t slot = hash(key) & this->mask_;
+		while (this->keys_[slot] != -1 && this->keys_[slot] != key)
+			slot = (slot + 1) & this->mask_;
+		this->keys_[slot] = key;
+		this->values_[slot] = value;
 	}
 
-	float forward(float x) {
-		for (const auto& n : this->nodes_)
+	// 不存在时返回-1
+	int32_t find(int64_t key) const {
+		size_t slot = hash(key) & this->mask_;
+		while (this->keys_[slot] != -1)
 		{
-			n->is_computed_ = false;
+			if (this->keys_[slot] == key)
+				return this->values_[slot];
+			slot = (slot + 1) & this->mask_;
 		}
+		return -1;
+	}
 
-		this->inputs_[0]->value_ = x;
-		this->outputs_[0]->update();
-		return this->outputs_[0]->value_;
+private:
+	static size_t hash(int64_t key) {
+		uint64_t x = (uint64_t)key;
+		x ^= x >> 33;
+		x *= 0xff51afd7ed558ccdULL;
+		x ^= x >> 33;
+		return (size_t)x;
 	}
 
 private:
-	std::vector<Tensor*> inputs_;
-	std::vector<Tensor*> outputs_;
-	std::vector <Node*> nodes_;
+	std::vector<int64_t> keys_;
+	std::vector<int32_t> values_;
+	size_t mask_{ 0 };
 };
 
-Engine* load_engine(const std::string& onnx_file) {
-	auto engine = new Engine();
-	onnx::ModelProto model;
-	std::ifstream in(onnx_file, std::ios_base::binary);
-	model.ParseFromIstream(&in);
-	in.close();
-	//std::cout << model.graph().input().size() << "\n";
+/**
+ * 稀疏卷积的规则表，第k个偏移的(输入行, 输出行)对在pair_in/pair_out的[k * rows_capacity, k * rows_capacity + pair_count[k])
+ * 输入坐标相同、indice_key相同的子流形卷积在一次推理内共用一个规则表，由最先执行的层建立
+ */
+struct Rulebook {
+	std::mutex mutex;
+	uint64_t inference = 0;   // 建立时的推理序号，与Engine当前的序号不同时需要重建
+	int64_t rows_capacity = 0;
+	int64_t out_rows = 0;
+	CoordinateHash hash;
+	std::vector<int32_t> pair_in;
+	std::vector<int32_t> pair_out;
+	std::vector<int> pair_count;
 
-	std::map<std::string, Tensor*> name_to_tensor;
-	for (const auto& i : model.graph().input())
-	{
-		auto x = engine->add_input(i.name());
-		name_to_tensor[x->name_] = x;
+	void reserve(int kernel_volume, int64_t rows, int64_t hash_rows) {
+		this->rows_capacity = rows;
+		this->hash.reserve(hash_rows);
+		this->pair_in.resize(kernel_volume * rows);
+		this->pair_out.resize(kernel_volume * rows);
+		this->pair_count.assign(kernel_volume, 0);
 	}
+};
+
+struct SparseConvStats {
+	uint64_t builds = 0;      // 建立规则表的次数
+	uint64_t reuses = 0;      // 直接使用其他层建好的规则表的次数
+	double rulebook_ms = 0;   // 建立规则表的耗时，包括等待共用的层建好
+	double compute_ms = 0;    // 收集、乘法、累加的耗时
+};
 
-	for (const auto& n : model.graph().node())
+
+//  spconv_infer1.py
+class BaseNode : std::enable_shared_from_this<BaseNode> {
+
+public:
+	BaseNode() {}
+	virtual ~BaseNode() {}
+
+};
+
+class Tensor : std::enable_shared_from_this<Tensor> {
+public:
+	Tensor(const std::string& name, BaseNode* parent = nullptr) :
+		name_(name)
 	{
-		if (n.op_type() == "SparseConvolution") {
-			auto layer = engine->add_spconv(n.name(), name_to_tensor[n.input()[0]], "");
-			name_to_tensor[n.output()[0]] = layer->output_;
-		}
-		else if (n.op_type() == "BatchNormalization") {
-			auto layer = engine->add_bn(n.name(), name_to_tensor[n.input()[0]], "");
-			name_to_tensor[n.output()[0]] = layer->output_;
-		}
-		else if (n.op_type() == "Relu") {
-			auto layer = engine->add_relu(n.name(), name_to_tensor[n.input()[0]]);
-			name_to_tensor[n.output()[0]] = layer->output_;
+		parent_ = parent;
+	}
+
+	~Tensor() {
+	}
+
+	// 行主序连续存储，strides以元素为单位
+	void reshape(const std::vector<int64_t>& shape) {
+		this->shape_ = shape;
+		this->strides_.assign(shape.size(), 1);
+		for (int i = (int)shape.size() - 2; i >= 0; --i)
+		{
+			this->strides_[i] = this->strides_[i + 1] * shape[i + 1];
 		}
-		else if (n.op_type() == "Add") {
-			auto layer = engine->add_add(n.name(), name_to_tensor[n.input()[0]], name_to_tensor[n.input()[1]]);
-			name_to_tensor[n.output()[0]] = layer->output_;
+	}
+
+	int ndim() const { return (int)this->shape_.size(); }
+
+	int64_t numel() const {
+		int64_t n = 1;
+		for (auto d : this->shape_)
+			n *= d;
+		return n;
+	}
+
+	size_t bytes() const { return this->numel() * element_size(this->dtype_); }
+
+	// 稀疏张量的行数随输入变化，只要不超过规划的容量就可以修改
+	bool set_rows(int64_t rows) {
+		if (this->ndim() == 0 || rows < 0 || rows * this->strides_[0] * element_size(this->dtype_) > this->capacity_)
+		{
+			printf("%s: %d rows exceed the planned capacity\n", this->name_.c_str(), (int)rows);
+			return false;
 		}
+		this->shape_[0] = rows;
+		return true;
 	}
 
-	for (const auto& o : model.graph().output())
-	{
-		engine->mark_output(name_to_tensor[o.name()]);
+	template<typename T>
+	T* data() { return static_cast<T*>(this->data_); }
+
+	template<typename T>
+	const T* data() const { return static_cast<const T*>(this->data_); }
+
+	// 映射的initializer不保证按元素对齐，load时读取常量用copy_data拷贝出来，对齐时才可以直接按T*读取
+	bool is_aligned() const { return (uintptr_t)this->data_ % element_size(this->dtype_) == 0; }
+
+	template<typename T>
+	std::vector<T> copy_data() const {
+		std::vector<T> values(this->bytes() / sizeof(T));
+		memcpy(values.data(), this->data_, values.size() * sizeof(T));
+		return values;
 	}
 
-	return engine;
-}
+	std::string shape_string() const {
+		std::string s = "[";
+		for (int i = 0; i < this->ndim(); ++i)
+		{
+			if (i > 0) s += ", ";
+			s += std::to_string(this->shape_[i]);
+		}
+		return s + "]";
+	}
 
-int main() {
+public:
+	std::string name_;
+	DataType dtype_{ DataType::Float32 };
+	std::vector<int64_t> shape_;
+	std::vector<int64_t> strides_;
+	void* data_{ nullptr };     // 激活指向Engine的arena，权重指向映射的模型文件(只读)或load时分配的常量缓冲区，Tensor本身不拥有内存
+	bool is_constant_{ false }; // initializer，不参与内存规划
+	size_t capacity_{ 0 };      // 规划时按最大形状分配的字节数
 
-	std::string onnx = R"(D:\LearningCodes\GithubRepo\shouxieAI\spconv-onnx\code\code\scn.onnx)";
-	auto engine = load_engine(onnx); 
-	unsigned int i = 0;
-	while (i < 10000)
+	// 稀疏张量：本张量为[N, C]的特征矩阵，indices_为[N, 4]的int32体素坐标(batch, z, y, x)，两者按行对应
+	// 逐元素的算子直接沿用输入的indices_，只有卷积会产生新的坐标
+	Tensor* indices_{ nullptr };
+	std::vector<int64_t> spatial_shape_;  // (D, H, W)
+	BaseNode* parent_;  // 父类指针
+};
+
+class Node;
+
+// 一次kernel调用，节点和输入输出的地址都在compile时解析好，forward中不再经过Tensor查找
+struct Launch {
+	Node* node;
+	std::vector<const void*> inputs;
+	void* output;
+};
+
+class Node : public BaseNode, std::enable_shared_from_this<Node> {
+public:
+	Node(const std::string& name, const std::string& op_type) :
+		name_(name),
+		op_type_(op_type)
 	{
-		++i;
-		std::cout << "result = " << engine->forward(1.0) << std::endl;
+		input_.clear();
+		//output_.clear();
 	}
+	virtual  ~Node() {
+		if (this->output_)
+		{
+			delete output_;
+			output_ = nullptr;
+		}
+	}
+	// load时按节点顺序调用一次，由输入的形状推出output_的形状，不支持时返回false
+	virtual bool infer_shape() { return true; }
+
+	// launch.inputs与input_一一对应
+	virtual void forward(const Launch& launch) {};
+
+	// 把紧跟在后面的Relu并入本节点的收尾，不支持时返回false
+	virtual bool fuse_relu() { return false; }
+
+protected:
+	void create_output() {
+		std::string n = this->name_ + ".ouput";
+		auto parent = dynamic_cast<BaseNode*>(this);
+		this->output_ = new Tensor(n, parent);
+	}
+
+public:
+	std::string name_{ "" };
+	std::string op_type_{ "" };
+	std::vector<Tensor*> input_;
+	Tensor* output_{ nullptr };
+};
+
+/**
+ * 稀疏3D卷积，与spconv的SparseConv3d/SubMConv3d一致
+ * 1. 规则表：对每个卷积核偏移k列出所有(输入行, 输出行)对。子流形卷积的输出坐标与输入相同，
+ *    用输入坐标建哈希表，按偏移查找邻居；普通卷积由输入坐标推出输出坐标，用哈希表去重，输出行号按首次出现的顺序分配
+ * 2. 按偏移依次计算：把该偏移的输入行收集成连续的块，与W_k [Cin, Cout]相乘后累加到对应的输出行。
+ *    同一偏移内每个输出行只出现一次，块之间并行不会冲突；各偏移按固定顺序累加，结果与线程数无关
+ * 权重布局为[Cout, kD, kH, kW, Cin]，也接受spconv 1.x的[kD, kH, kW, Cin, Cout]
+ * 融合后的收尾依次为 + residual、Relu，残差作为第二个输入，BatchNormalization直接折叠进权重和偏置
+ */
+class SparseConvolution : public Node {
+public:
+	static const int kTile = 64;  // 一次收集的行数
+
+	SparseConvolution(const std::string& name, Tensor* x, Tensor* weight, Tensor* bias, const Attributes& attr) : Node(name, "SparseConvolution") {
+		attributes_ = attr;
+		this->input_.push_back(x);
+		this->weight_ = weight;
+		this->bias_ = bias;
+		this->create_output();
+	}
+
+	~SparseConvolution() {
+		if (this->coords_)
+		{
+			delete this->coords_;
+			this->coords_ = nullptr;
+		}
+	}
+
+	bool infer_shape() override {
+		auto x = this->input_[0];
+		if (x->ndim() != 2 || x->dtype_ != DataType::Float32 || x->indices_ == nullptr)
+		{
+			printf("%s: expect sparse float features [N, C] with coordinates, got %s\n", this->name_.c_str(), x->shape_string().c_str());
+			return false;
+		}
+		if (attributes_.get_int("ndim", 3) != 3 || attributes_.get_int("groups", 1) != 1 ||
+			attributes_.get_int("transposed", 0) != 0 || attributes_.get_int("inverse", 0) != 0)
+		{
+			printf("%s: only 3D, groups = 1, non-transposed convolutions are supported\n", this->name_.c_str());
+			return false;
+		}
+
+		this->subm_ = attributes_.get_int("subm", 0) != 0;
+		this->indice_key_ = attributes_.get_string("indice_key", attributes_.get_string("rulebook"));
+		if (!this->read_triple("kernel_size", 3, this->kernel_) || !this->read_triple("stride", 1, this->stride_) ||
+			!this->read_triple("padding", 0, this->padding_) || !this->read_triple("dilation", 1, this->dilation_))
+			return false;
+
+		this->in_channels_ = x->shape_[1];
+		this->out_channels_ = attributes_.get_int("out_channels", 0);
+		if (attributes_.get_int("in_channels", this->in_channels_) != this->in_channels_ || !this->load_weights())
+			return false;
+
+		// 输入的空间尺寸来自上一层，网络的输入取属性input_spatial_shape
+		auto input_spatial = attributes_.get_ints("input_spatial_shape");
+		if (x->spatial_shape_.empty())
+			x->spatial_shape_ = input_spatial;
+		if (x->spatial_shape_.size() != 3 || (!input_spatial.empty() && input_spatial != x->spatial_shape_))
+		{
+			printf("%s: unknown or inconsistent input_spatial_shape\n", this->name_.c_str());
+			return false;
+		}
+
+		std::vector<int64_t> output_spatial = x->spatial_shape_;
+		if (!this->subm_)
+		{
+			for (int d = 0; d < 3; ++d)
+				output_spatial[d] = (x->spatial_shape_[d] + 2 * this->padding_[d] - this->dilation_[d] * (this->kernel_[d] - 1) - 1) / this->stride_[d] + 1;
+		}
+		auto expected = attributes_.get_ints("output_spatial_shape");
+		if (!expected.empty() && expected != output_spatial)
+		{
+			printf("%s: output_spatial_shape does not match the convolution parameters\n", this->name_.c_str());
+			return false;
+		}
+
+		// 普通卷积的输出行数优先使用导出时给出的output_bound，否则取每个输入体素最多产生K个输出的上界
+		int64_t rows = x->shape_[0];
+		int64_t out_rows = rows;
+		if (!this->subm_)
+		{
+			out_rows = attributes_.get_int("output_bound", 0);
+			if (out_rows <= 0)
+				out_rows = rows * this->kernel_volume();
+
+			this->coords_ = new Tensor(this->name_ + ".indices", dynamic_cast<BaseNode*>(this));
+			this->coords_->dtype_ = DataType::Int32;
+			this->coords_->reshape({ out_rows, 4 });
+		}
+
+		this->output_->reshape({ out_rows, this->out_channels_ });
+		this->output_->indices_ = this->subm_ ? x->indices_ : this->coords_;
+		this->output_->spatial_shape_ = output_spatial;
+
+		this->rulebook_ = std::make_shared<Rulebook>();
+		this->rulebook_->reserve(this->kernel_volume(), rows, this->subm_ ? rows : out_rows);
+		this->set_thread_pool(nullptr);
+		return true;
+	}
+
+	// 可以共用规则表的层返回相同的键：子流形卷积，indice_key、输入坐标、卷积核大小和膨胀都相同
+	std::string rulebook_key() const {
+		if (!this->subm_ || this->indice_key_.empty())
+			return "";
+
+		char geometry[128];
+		snprintf(geometry, sizeof(geometry), "@%p/%dx%dx%d/%dx%dx%d", (void*)this->input_[0]->indices_,
+			(int)this->kernel_[0], (int)this->kernel_[1], (int)this->kernel_[2],
+			(int)this->dilation_[0], (int)this->dilation_[1], (int)this->dilation_[2]);
+		return this->indice_key_ + geometry;
+	}
+
+	const std::shared_ptr<Rulebook>& rulebook() const { return this->rulebook_; }
+
+	// inference指向Engine的推理序号，规则表只在每次推理中第一次用到时建立
+	void share_rulebook(const std::shared_ptr<Rulebook>& rulebook, const uint64_t* inference) {
+		this->rulebook_ = rulebook;
+		this->inference_ = inference;
+	}
+
+	const SparseConvStats& stats() const { return this->stats_; }
+
+	// 每个线程一块收集/乘积用的临时缓冲区
+	void set_thread_pool(ThreadPool* pool) {
+		this->pool_ = pool;
+		int threads = pool ? pool->num_threads() : 1;
+		this->scratch_.resize(threads * kTile * (this->in_channels_ + this->out_channels_));
+	}
+
+	void forward(const Launch& launch) override {
+		auto x = this->input_[0];
+		this->features_ = static_cast<const float*>(launch.inputs[0]);
+		this->result_ = static_cast<float*>(launch.output);
+
+		auto tick = std::chrono::steady_clock::now();
+		int64_t out_rows = 0;
+		{
+			auto& rb = *this->rulebook_;
+			std::lock_guard<std::mutex> lock(rb.mutex);
+			if (this->inference_ == nullptr || rb.inference != *this->inference_)
+			{
+				rb.out_rows = this->build_rulebook(x->indices_->data<int32_t>(), x->shape_[0], x->spatial_shape_.data());
+				rb.inference = this->inference_ ? *this->inference_ : 0;
+				this->stats_.builds++;
+			}
+			else
+			{
+				this->stats_.reuses++;
+			}
+			out_rows = rb.out_rows;
+		}
+		auto built = std::chrono::steady_clock::now();
+		this->stats_.rulebook_ms += std::chrono::duration<double, std::milli>(built - tick).count();
+
+		this->output_->shape_[0] = out_rows;
+		if (this->coords_)
+			this->coords_->shape_[0] = out_rows;
+
+		int64_t cout = this->out_channels_;
+		for (int64_t i = 0; i < out_rows; ++i)
+			memcpy(this->result_ + i * cout, this->biases_.data(), cout * sizeof(float));
+
+		for (int k = 0; k < this->kernel_volume(); ++k)
+		{
+			int tiles = (this->rulebook_->pair_count[k] + kTile - 1) / kTile;
+			this->offset_ = k;
+			this->parallel_for(tiles, &SparseConvolution::gemm_task);
+		}
+
+		if (this->input_.size() > 1 || this->relu_)
+		{
+			this->residual_ = this->input_.size() > 1 ? static_cast<const float*>(launch.inputs[1]) : nullptr;
+			this->parallel_for((int)((out_rows + kTile - 1) / kTile), &SparseConvolution::epilogue_task);
+		}
+		this->stats_.compute_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - built).count();
+	}
+
+	bool subm() const { return this->subm_; }
+	const std::string& indice_key() const { return this->indice_key_; }
+
+	// y * alpha + beta：W'[k][ci][co] = W[k][ci][co] * alpha[co]，b' = b * alpha + beta，只能在收尾为空时折叠
+	bool fold_bn(const std::vector<float>& alpha, const std::vector<float>& beta) {
+		if (this->relu_ || this->input_.size() > 1 || alpha.size() != this->out_channels_ || beta.size() != this->out_channels_)
+			return false;
+
+		// 直接使用initializer的权重是只读的，先拷贝
+		int64_t cout = this->out_channels_;
+		if (this->weights_.empty())
+			this->weights_.assign(this->weight_data_, this->weight_data_ + this->kernel_volume() * this->in_channels_ * cout);
+		this->weight_data_ = this->weights_.data();
+		for (size_t i = 0; i < this->weights_.size(); ++i)
+			this->weights_[i] *= alpha[i % cout];
+		for (int64_t co = 0; co < cout; ++co)
+			this->biases_[co] = this->biases_[co] * alpha[co] + beta[co];
+		return true;
+	}
+
+	// 残差必须在Relu之前
+	bool fuse_add(Tensor* residual) {
+		if (this->relu_ || this->input_.size() > 1 || residual->shape_ != this->output_->shape_ || residual->indices_ != this->output_->indices_)
+			return false;
+
+		this->input_.push_back(residual);
+		return true;
+	}
+
+	bool fuse_relu() override {
+		this->relu_ = true;
+		return true;
+	}
+
+private:
+	int kernel_volume() const { return (int)(this->kernel_[0] * this->kernel_[1] * this->kernel_[2]); }
+
+	bool read_triple(const std::string& name, int64_t default_value, int64_t* values) {
+		auto v = attributes_.get_ints(name);
+		if (v.size() == 1)
+			v.assign(3, v[0]);
+		if (v.empty())
+			v.assign(3, default_value);
+		if (v.size() != 3 || *std::min_element(v.begin(), v.end()) < (name == "padding" ? 0 : 1))
+		{
+			printf("%s: invalid %s\n", this->name_.c_str(), name.c_str());
+			return false;
+		}
+		std::copy(v.begin(), v.end(), values);
+		return true;
+	}
+
+	// 计算用的布局为[k][ci][co]，k = (kz * kH + ky) * kW + kx。
+	// [kD, kH, kW, Cin, Cout]的权重直接使用initializer的数据，不拷贝；[Cout, kD, kH, kW, Cin]的重排到weights_
+	bool load_weights() {
+		auto w = this->weight_;
+		int64_t K = this->kernel_volume();
+		int64_t cin = this->in_channels_;
+		if (w == nullptr || !w->is_constant_ || w->dtype_ != DataType::Float32 || w->ndim() != 5)
+		{
+			printf("%s: weight must be a 5-D float initializer\n", this->name_.c_str());
+			return false;
+		}
+		if (this->out_channels_ <= 0)
+			this->out_channels_ = w->shape_[0];
+
+		int64_t cout = this->out_channels_;
+		std::vector<int64_t> krsc = { cout, this->kernel_[0], this->kernel_[1], this->kernel_[2], cin };
+		std::vector<int64_t> rsck = { this->kernel_[0], this->kernel_[1], this->kernel_[2], cin, cout };
+		const char* src = static_cast<const char*>(w->data_);
+		if (w->shape_ == krsc)
+		{
+			this->weights_.resize(K * cin * cout);
+			for (int64_t co = 0; co < cout; ++co)
+				for (int64_t k = 0; k < K; ++k)
+					for (int64_t ci = 0; ci < cin; ++ci)
+						memcpy(&this->weights_[(k * cin + ci) * cout + co], src + ((co * K + k) * cin + ci) * sizeof(float), sizeof(float));
+			this->weight_data_ = this->weights_.data();
+		}
+		else if (w->shape_ == rsck)
+		{
+			if (!w->is_aligned())
+				this->weights_ = w->copy_data<float>();
+			this->weight_data_ = w->is_aligned() ? w->data<float>() : this->weights_.data();
+		}
+		else
+		{
+			printf("%s: weight shape %s does not match [%d, kD, kH, kW, %d]\n", this->name_.c_str(), w->shape_string().c_str(), (int)cout, (int)cin);
+			return false;
+		}
+
+		if (this->bias_ && (!this->bias_->is_constant_ || this->bias_->dtype_ != DataType::Float32 || this->bias_->numel() != cout))
+		{
+			printf("%s: bias must be a float initializer with %d elements\n", this->name_.c_str(), (int)cout);
+			return false;
+		}
+		if (this->bias_)
+			this->biases_ = this->bias_->copy_data<float>();
+		else
+			this->biases_.assign(cout, 0.f);
+		return true;
+	}
+
+	static int64_t linearize(const int32_t* c, const int64_t* spatial) {
+		return ((c[0] * spatial[0] + c[1]) * spatial[1] + c[2]) * spatial[2] + c[3];
+	}
+
+	void parallel_for(int tasks, void(*fn)(void*, int, int)) {
+		if (this->pool_)
+			this->pool_->parallel_for(tasks, fn, this);
+		else
+		{
+			for (int i = 0; i < tasks; ++i)
+				fn(this, i, 0);
+		}
+	}
+
+	// 返回输出的行数
+	int64_t build_rulebook(const int32_t* coords, int64_t rows, const int64_t* spatial) {
+		auto& rb = *this->rulebook_;
+		this->coords_in_ = coords;
+		this->rows_in_ = rows;
+		this->spatial_ = spatial;
+		rb.hash.clear();
+		if (this->subm_)
+		{
+			for (int64_t i = 0; i < rows; ++i)
+				rb.hash.insert(linearize(coords + i * 4, spatial), (int32_t)i);
+			this->parallel_for(this->kernel_volume(), &SparseConvolution::subm_task);
+			return rows;
+		}
+
+		const int64_t* out_spatial = this->output_->spatial_shape_.data();
+		int64_t capacity = this->coords_->capacity_ / (4 * sizeof(int32_t));
+		capacity = std::min(capacity, (int64_t)(this->output_->capacity_ / (this->out_channels_ * sizeof(float))));
+		int32_t* out_coords = this->coords_->data<int32_t>();
+		int64_t out_rows = 0;
+		bool overflow = false;
+		std::fill(rb.pair_count.begin(), rb.pair_count.end(), 0);
+		for (int64_t i = 0; i < rows; ++i)
+		{
+			const int32_t* c = coords + i * 4;
+			for (int k = 0; k < this->kernel_volume(); ++k)
+			{
+				int32_t o[4] = { c[0], 0, 0, 0 };
+				int kk[3] = { k / (int)(this->kernel_[1] * this->kernel_[2]), k / (int)this->kernel_[2] % (int)this->kernel_[1], k % (int)this->kernel_[2] };
+				bool valid = true;
+				for (int d = 0; d < 3 && valid; ++d)
+				{
+					int64_t t = c[d + 1] + this->padding_[d] - kk[d] * this->dilation_[d];
+					valid = t >= 0 && t % this->stride_[d] == 0 && t / this->stride_[d] < out_spatial[d];
+					o[d + 1] = (int32_t)(t / this->stride_[d]);
+				}
+				if (!valid)
+					continue;
+
+				int64_t key = linearize(o, out_spatial);
+				int32_t j = rb.hash.find(key);
+				if (j < 0)
+				{
+					if (out_rows == capacity)
+					{
+						overflow = true;
+						continue;
+					}
+					j = (int32_t)out_rows++;
+					rb.hash.insert(key, j);
+					memcpy(out_coords + j * 4, o, sizeof(o));
+				}
+				int n = rb.pair_count[k]++;
+				rb.pair_in[k * rb.rows_capacity + n] = (int32_t)i;
+				rb.pair_out[k * rb.rows_capacity + n] = j;
+			}
+		}
+
+		if (overflow)
+			printf("%s: output exceeds %d voxels, increase output_bound\n", this->name_.c_str(), (int)capacity);
+		return out_rows;
+	}
+
+	// 子流形卷积的一个偏移：输出行i读取坐标为c + (k - center) * dilation的输入行
+	static void subm_task(void* context, int k, int thread) {
+		auto self = static_cast<SparseConvolution*>(context);
+		int64_t kk[3] = { k / (self->kernel_[1] * self->kernel_[2]), k / self->kernel_[2] % self->kernel_[1], k % self->kernel_[2] };
+		int32_t delta[3];
+		for (int d = 0; d < 3; ++d)
+			delta[d] = (int32_t)((kk[d] - (self->kernel_[d] - 1) / 2) * self->dilation_[d]);
+
+		auto& rb = *self->rulebook_;
+		int32_t* pair_in = rb.pair_in.data() + k * rb.rows_capacity;
+		int32_t* pair_out = rb.pair_out.data() + k * rb.rows_capacity;
+		int n = 0;
+		for (int64_t i = 0; i < self->rows_in_; ++i)
+		{
+			const int32_t* c = self->coords_in_ + i * 4;
+			int32_t p[4] = { c[0], c[1] + delta[0], c[2] + delta[1], c[3] + delta[2] };
+			if (p[1] < 0 || p[1] >= self->spatial_[0] || p[2] < 0 || p[2] >= self->spatial_[1] || p[3] < 0 || p[3] >= self->spatial_[2])
+				continue;
+
+			int32_t j = rb.hash.find(linearize(p, self->spatial_));
+			if (j >= 0)
+			{
+				pair_in[n] = j;
+				pair_out[n] = (int32_t)i;
+				n++;
+			}
+		}
+		rb.pair_count[k] = n;
+	}
+
+	// c[4][cout] = a[4][cin] * w[cin][cout]，每个元素都按ci从小到大累加，向量化与标量的结果相同
+	static void gemm4(const float* a, const float* w, float* c, int64_t cin, int64_t cout) {
+		const float* a0 = a;
+		const float* a1 = a0 + cin;
+		const float* a2 = a1 + cin;
+		const float* a3 = a2 + cin;
+		int64_t co = 0;
+#if defined(ENGINE_SSE)
+		for (; co + 8 <= cout; co += 8)
+		{
+			__m128 c00 = _mm_setzero_ps(), c01 = c00, c10 = c00, c11 = c00, c20 = c00, c21 = c00, c30 = c00, c31 = c00;
+			for (int64_t ci = 0; ci < cin; ++ci)
+			{
+				__m128 w0 = _mm_loadu_ps(w + ci * cout + co);
+				__m128 w1 = _mm_loadu_ps(w + ci * cout + co + 4);
+				__m128 v = _mm_set1_ps(a0[ci]);
+				c00 = _mm_add_ps(c00, _mm_mul_ps(v, w0));
+				c01 = _mm_add_ps(c01, _mm_mul_ps(v, w1));
+				v = _mm_set1_ps(a1[ci]);
+				c10 = _mm_add_ps(c10, _mm_mul_ps(v, w0));
+				c11 = _mm_add_ps(c11, _mm_mul_ps(v, w1));
+				v = _mm_set1_ps(a2[ci]);
+				c20 = _mm_add_ps(c20, _mm_mul_ps(v, w0));
+				c21 = _mm_add_ps(c21, _mm_mul_ps(v, w1));
+				v = _mm_set1_ps(a3[ci]);
+				c30 = _mm_add_ps(c30, _mm_mul_ps(v, w0));
+				c31 = _mm_add_ps(c31, _mm_mul_ps(v, w1));
+			}
+			_mm_storeu_ps(c + co, c00);
+			_mm_storeu_ps(c + co + 4, c01);
+			_mm_storeu_ps(c + cout + co, c10);
+			_mm_storeu_ps(c + cout + co + 4, c11);
+			_mm_storeu_ps(c + 2 * cout + co, c20);
+			_mm_storeu_ps(c + 2 * cout + co + 4, c21);
+			_mm_storeu_ps(c + 3 * cout + co, c30);
+			_mm_storeu_ps(c + 3 * cout + co + 4, c31);
+		}
+#elif defined(ENGINE_NEON)
+		for (; co + 8 <= cout; co += 8)
+		{
+			float32x4_t c00 = vdupq_n_f32(0), c01 = c00, c10 = c00, c11 = c00, c20 = c00, c21 = c00, c30 = c00, c31 = c00;
+			for (int64_t ci = 0; ci < cin; ++ci)
+			{
+				float32x4_t w0 = vld1q_f32(w + ci * cout + co);
+				float32x4_t w1 = vld1q_f32(w + ci * cout + co + 4);
+				c00 = vaddq_f32(c00, vmulq_n_f32(w0, a0[ci]));
+				c01 = vaddq_f32(c01, vmulq_n_f32(w1, a0[ci]));
+				c10 = vaddq_f32(c10, vmulq_n_f32(w0, a1[ci]));
+				c11 = vaddq_f32(c11, vmulq_n_f32(w1, a1[ci]));
+				c20 = vaddq_f32(c20, vmulq_n_f32(w0, a2[ci]));
+				c21 = vaddq_f32(c21, vmulq_n_f32(w1, a2[ci]));
+				c30 = vaddq_f32(c30, vmulq_n_f32(w0, a3[ci]));
+				c31 = vaddq_f32(c31, vmulq_n_f32(w1, a3[ci]));
+			}
+			vst1q_f32(c + co, c00);
+			vst1q_f32(c + co + 4, c01);
+			vst1q_f32(c + cout + co, c10);
+			vst1q_f32(c + cout + co + 4, c11);
+			vst1q_f32(c + 2 * cout + co, c20);
+			vst1q_f32(c + 2 * cout + co + 4, c21);
+			vst1q_f32(c + 3 * cout + co, c30);
+			vst1q_f32(c + 3 * cout + co + 4, c31);
+		}
+#endif
+		for (; co < cout; ++co)
+		{
+			float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+			for (int64_t ci = 0; ci < cin; ++ci)
+			{
+				float wv = w[ci * cout + co];
+				s0 += a0[ci] * wv;
+				s1 += a1[ci] * wv;
+				s2 += a2[ci] * wv;
+				s3 += a3[ci] * wv;
+			}
+			c[co] = s0;
+			c[cout + co] = s1;
+			c[2 * cout + co] = s2;
+			c[3 * cout + co] = s3;
+		}
+	}
+
+	// 当前偏移的第tile块：收集kTile个输入行，乘W_k，累加到输出行
+	static void gemm_task(void* context, int tile, int thread) {
+		auto self = static_cast<SparseConvolution*>(context);
+		int k = self->offset_;
+		int64_t cin = self->in_channels_;
+		int64_t cout = self->out_channels_;
+		int begin = tile * kTile;
+		const auto& rb = *self->rulebook_;
+		int count = rb.pair_count[k] - begin;
+		if (count > kTile)
+			count = kTile;
+		const int32_t* pair_in = rb.pair_in.data() + k * rb.rows_capacity + begin;
+		const int32_t* pair_out = rb.pair_out.data() + k * rb.rows_capacity + begin;
+		const float* w = self->weight_data_ + k * cin * cout;
+		float* a = self->scratch_.data() + thread * kTile * (cin + cout);
+		float* c = a + kTile * cin;
+
+		for (int r = 0; r < count; ++r)
+			memcpy(a + r * cin, self->features_ + pair_in[r] * cin, cin * sizeof(float));
+
+		// 收集到的行补0到4的倍数，每次计算4行
+		int padded = (count + 3) / 4 * 4;
+		memset(a + count * cin, 0, (padded - count) * cin * sizeof(float));
+		for (int r = 0; r < padded; r += 4)
+			gemm4(a + r * cin, w, c + r * cout, cin, cout);
+
+		for (int r = 0; r < count; ++r)
+		{
+			float* y = self->result_ + pair_out[r] * cout;
+			const float* crow = c + r * cout;
+			for (int64_t co = 0; co < cout; ++co)
+				y[co] += crow[co];
+		}
+	}
+
+	// 第tile块输出行的收尾：+ residual、Relu
+	static void epilogue_task(void* context, int tile, int thread) {
+		auto self = static_cast<SparseConvolution*>(context);
+		int64_t cout = self->out_channels_;
+		int64_t begin = tile * kTile * cout;
+		int64_t end = std::min((int64_t)(tile + 1) * kTile, self->output_->shape_[0]) * cout;
+		float* y = self->result_;
+		if (self->residual_)
+		{
+			for (int64_t i = begin; i < end; ++i)
+				y[i] += self->residual_[i];
+		}
+		if (self->relu_)
+		{
+			for (int64_t i = begin; i < end; ++i)
+				y[i] = std::max(0.f, y[i]);
+		}
+	}
+
+private:
+	Attributes attributes_;
+	Tensor* weight_{ nullptr };
+	Tensor* bias_{ nullptr };
+	Tensor* coords_{ nullptr };  // 普通卷积产生的输出坐标，子流形卷积沿用输入的坐标
+	int64_t kernel_[3];
+	int64_t stride_[3];
+	int64_t padding_[3];
+	int64_t dilation_[3];
+	bool subm_{ false };
+	std::string indice_key_;
+	int64_t in_channels_{ 0 };
+	int64_t out_channels_{ 0 };
+	const float* weight_data_{ nullptr };  // [k][ci][co]，指向weights_或weight_的数据
+	std::vector<float> weights_;
+	std::vector<float> biases_;  // 折叠BatchNormalization后与bias_不同
+	bool relu_{ false };
+
+	std::shared_ptr<Rulebook> rulebook_;
+	const uint64_t* inference_{ nullptr };
+	SparseConvStats stats_;
+
+	// 一次forward内各个任务共享的状态
+	ThreadPool* pool_{ nullptr };
+	std::vector<float> scratch_;
+	const int32_t* coords_in_{ nullptr };
+	int64_t rows_in_{ 0 };
+	const int64_t* spatial_{ nullptr };
+	const float* features_{ nullptr };
+	const float* residual_{ nullptr };
+	float* result_{ nullptr };
+	int offset_{ 0 };
+};
+
+class ReLU : public Node {
+public:
+	ReLU(const std::string& name, Tensor* x) :
+		Node(name, "ReLU") {
+		this->input_.push_back(x);
+		this->create_output();
+	}
+
+	bool infer_shape() override {
+		this->output_->reshape(this->input_[0]->shape_);
+		this->output_->indices_ = this->input_[0]->indices_;
+		this->output_->spatial_shape_ = this->input_[0]->spatial_shape_;
+		return this->input_[0]->dtype_ == DataType::Float32;
+	}
+
+	void forward(const Launch& launch) override {
+		const float* x = static_cast<const float*>(launch.inputs[0]);
+		float* y = static_cast<float*>(launch.output);
+		this->output_->shape_[0] = this->input_[0]->shape_[0];
+		int64_t n = this->output_->numel();
+		for (int64_t i = 0; i < n; ++i)
+			y[i] = std::max(0.f, x[i]);
+	}
+};
+
+class Add : public Node {
+public:
+	Add(const std::string& name, Tensor* a, Tensor* b) :
+		Node(name, "Add") {
+		this->input_.push_back(a);
+		this->input_.push_back(b);
+		this->create_output();
+	}
+
+	// 不支持广播，两个输入的形状必须相同，稀疏张量还要求坐标相同
+	bool infer_shape() override {
+		auto a = this->input_[0];
+		auto b = this->input_[1];
+		if (a->shape_ != b->shape_ || a->indices_ != b->indices_ || a->dtype_ != DataType::Float32 || b->dtype_ != DataType::Float32)
+		{
+			printf("%s: shape or coordinates mismatch %s vs %s\n", this->name_.c_str(), a->shape_string().c_str(), b->shape_string().c_str());
+			return false;
+		}
+		this->output_->reshape(a->shape_);
+		this->output_->indices_ = a->indices_;
+		this->output_->spatial_shape_ = a->spatial_shape_;
+		return true;
+	}
+
+	bool fuse_relu() override {
+		this->relu_ = true;
+		return true;
+	}
+
+	void forward(const Launch& launch) override {
+		const float* a = static_cast<const float*>(launch.inputs[0]);
+		const float* b = static_cast<const float*>(launch.inputs[1]);
+		float* y = static_cast<float*>(launch.output);
+		this->output_->shape_[0] = this->input_[0]->shape_[0];
+		int64_t n = this->output_->numel();
+		if (this->relu_)
+		{
+			for (int64_t i = 0; i < n; ++i)
+				y[i] = std::max(0.f, a[i] + b[i]);
+		}
+		else
+		{
+			for (int64_t i = 0; i < n; ++i)
+				y[i] = a[i] + b[i];
+		}
+	}
+
+private:
+	bool relu_{ false };
+};
+
+class BatchNormalization : public Node {
+public:
+	BatchNormalization(const std::string& name, Tensor* x, Tensor* scale, Tensor* bias, Tensor* mean, Tensor* var, const Attributes& attr) :
+		Node(name, "BatchNormalization") {
+		attributes_ = attr;
+		this->input_.push_back(x);
+		this->params_ = { scale, bias, mean, var };
+		this->create_output();
+	}
+
+	// 通道在第1维，[N, C]的稀疏特征和[N, C, ...]的稠密张量都适用
+	// 推理时的y = (x - mean) / sqrt(var + eps) * scale + bias在load时化简为y = x * alpha + beta
+	bool infer_shape() override {
+		auto x = this->input_[0];
+		if (x->ndim() < 2 || x->dtype_ != DataType::Float32)
+		{
+			printf("%s: expect float input with channels at dim 1, got %s\n", this->name_.c_str(), x->shape_string().c_str());
+			return false;
+		}
+
+		int64_t channels = x->shape_[1];
+		for (auto p : this->params_)
+		{
+			if (p == nullptr || !p->is_constant_ || p->dtype_ != DataType::Float32 || p->numel() != channels)
+			{
+				printf("%s: scale/bias/mean/var must be float initializers with %d elements\n", this->name_.c_str(), (int)channels);
+				return false;
+			}
+		}
+
+		float eps = attributes_.get_float("epsilon", 1e-5f);
+		auto scale = this->params_[0]->copy_data<float>();
+		auto bias = this->params_[1]->copy_data<float>();
+		auto mean = this->params_[2]->copy_data<float>();
+		auto var = this->params_[3]->copy_data<float>();
+		this->alpha_.resize(channels);
+		this->beta_.resize(channels);
+		for (int64_t c = 0; c < channels; ++c)
+		{
+			this->alpha_[c] = scale[c] / std::sqrt(var[c] + eps);
+			this->beta_[c] = bias[c] - mean[c] * this->alpha_[c];
+		}
+
+		this->inner_ = 1;
+		for (int i = 2; i < x->ndim(); ++i)
+			this->inner_ *= x->shape_[i];
+		this->output_->reshape(x->shape_);
+		this->output_->indices_ = x->indices_;
+		this->output_->spatial_shape_ = x->spatial_shape_;
+		return true;
+	}
+
+	const std::vector<float>& alpha() const { return this->alpha_; }
+	const std::vector<float>& beta() const { return this->beta_; }
+
+	bool fuse_relu() override {
+		this->relu_ = true;
+		return true;
+	}
+
+	void forward(const Launch& launch) override {
+		const float* x = static_cast<const float*>(launch.inputs[0]);
+		float* y = static_cast<float*>(launch.output);
+		this->output_->shape_[0] = this->input_[0]->shape_[0];
+		int64_t outer = this->input_[0]->shape_[0];
+		int64_t channels = (int64_t)this->alpha_.size();
+		for (int64_t n = 0; n < outer; ++n)
+		{
+			for (int64_t c = 0; c < channels; ++c)
+			{
+				float a = this->alpha_[c];
+				float b = this->beta_[c];
+				int64_t offset = (n * channels + c) * this->inner_;
+				for (int64_t i = 0; i < this->inner_; ++i)
+				{
+					float v = x[offset + i] * a + b;
+					y[offset + i] = this->relu_ ? std::max(0.f, v) : v;
+				}
+			}
+		}
+	}
+
+private:
+	Attributes attributes_;
+	std::vector<Tensor*> params_;
+	std::vector<float> alpha_;
+	std::vector<float> beta_;
+	int64_t inner_{ 1 };
+	bool relu_{ false };
+};
+
+/**
+ * 算子间并行的执行器
+ * 每个节点有一个依赖计数，每次执行开始时重置为前驱的个数，节点完成后把后继的计数减1，
+ * 减到0的后继放入当前线程自己的队列。线程优先从自己队列的尾部取任务(刚写完的输入还在缓存中)，
+ * 自己的队列空了再从其他线程队列的头部窃取。调用run的线程作为0号线程参与执行，
+ * 其余线程在两次run之间休眠。每个节点的计算与在哪个线程上执行无关，结果与串行执行完全相同
+ */
+class ParallelExecutor {
+public:
+	~ParallelExecutor() {
+		{
+			std::unique_lock<std::mutex> lock(this->mutex_);
+			this->stop_ = true;
+		}
+		this->wakeup_.notify_all();
+		for (auto& t : this->threads_)
+			t.join();
+	}
+
+	// consumers[i]为读取第i个launch输出的launch，同一个后继读两次时出现两次
+	bool startup(const std::vector<Launch>* launches, const std::vector<std::vector<int>>* consumers, int num_threads, bool pin_threads) {
+		int n = (int)launches->size();
+		this->launches_ = launches;
+		this->consumers_ = consumers;
+		this->num_deps_.assign(n, 0);
+		for (const auto& c : *consumers)
+		{
+			for (auto i : c)
+				this->num_deps_[i]++;
+		}
+		this->pending_.reset(new std::atomic<int>[std::max(n, 1)]);
+
+		// 每个节点每次run只入队一次，队列容量取节点数就不会溢出
+		this->queues_.reset(new Queue[num_threads]);
+		for (int i = 0; i < num_threads; ++i)
+			this->queues_[i].tasks.resize(std::max(n, 1));
+		this->num_threads_ = num_threads;
+		this->pin_threads_ = pin_threads;
+
+		for (int i = 1; i < num_threads; ++i)
+			this->threads_.push_back(std::thread(&ParallelExecutor::worker, this, i));
+		return true;
+	}
+
+	int num_threads() const { return this->num_threads_; }
+
+	void run() {
+		int n = (int)this->launches_->size();
+		for (int i = 0; i < n; ++i)
+			this->pending_[i].store(this->num_deps_[i], std::memory_order_relaxed);
+		for (int i = 0; i < this->num_threads_; ++i)
+			this->queues_[i].head = this->queues_[i].tail = 0;
+
+		// 没有前驱的节点轮流分给各个线程
+		int k = 0;
+		for (int i = 0; i < n; ++i)
+		{
+			if (this->num_deps_[i] == 0)
+				this->push(k++ % this->num_threads_, i);
+		}
+		this->remaining_.store(n, std::memory_order_release);
+
+		{
+			std::unique_lock<std::mutex> lock(this->mutex_);
+			this->active_ = this->num_threads_ - 1;
+			this->generation_++;
+		}
+		this->wakeup_.notify_all();
+		this->execute(0);
+
+		// 等其他线程都离开execute，下一次run才能重置队列
+		std::unique_lock<std::mutex> lock(this->mutex_);
+		this->finished_.wait(lock, [&] { return this->active_ == 0; });
+	}
+
+private:
+	struct Queue {
+		std::mutex mutex;
+		std::vector<int> tasks;
+		int head = 0;
+		int tail = 0;
+	};
+
+	void push(int thread, int task) {
+		auto& q = this->queues_[thread];
+		std::lock_guard<std::mutex> lock(q.mutex);
+		q.tasks[q.tail++ % q.tasks.size()] = task;
+	}
+
+	// 从自己队列的尾部取
+	bool pop(int thread, int& task) {
+		auto& q = this->queues_[thread];
+		std::lock_guard<std::mutex> lock(q.mutex);
+		if (q.head == q.tail)
+			return false;
+		task = q.tasks[--q.tail % q.tasks.size()];
+		return true;
+	}
+
+	// 从其他线程队列的头部窃取
+	bool steal(int thread, int& task) {
+		for (int i = 1; i < this->num_threads_; ++i)
+		{
+			auto& q = this->queues_[(thread + i) % this->num_threads_];
+			std::lock_guard<std::mutex> lock(q.mutex);
+			if (q.head != q.tail)
+			{
+				task = q.tasks[q.head++ % q.tasks.size()];
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void execute(int thread) {
+		int task = 0;
+		while (this->remaining_.load(std::memory_order_acquire) > 0)
+		{
+			if (!this->pop(thread, task) && !this->steal(thread, task))
+			{
+				std::this_thread::yield();
+				continue;
+			}
+
+			const auto& launch = (*this->launches_)[task];
+			launch.node->forward(launch);
+			for (auto c : (*this->consumers_)[task])
+			{
+				if (this->pending_[c].fetch_sub(1, std::memory_order_acq_rel) == 1)
+					this->push(thread, c);
+			}
+			this->remaining_.fetch_sub(1, std::memory_order_release);
+		}
+	}
+
+	void worker(int thread) {
+		if (this->pin_threads_)
+			pin_current_thread(thread);
+
+		uint64_t seen = 0;
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lock(this->mutex_);
+				this->wakeup_.wait(lock, [&] { return this->stop_ || this->generation_ != seen; });
+				if (this->stop_)
+					return;
+				seen = this->generation_;
+			}
+
+			this->execute(thread);
+
+			std::unique_lock<std::mutex> lock(this->mutex_);
+			if (--this->active_ == 0)
+				this->finished_.notify_one();
+		}
+	}
+
+	// 第i个线程绑定到第i个逻辑核，调用run的线程不绑定
+	static void pin_current_thread(int thread) {
+		unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+#ifdef _WIN32
+		SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << (thread % cores));
+#elif defined(__linux__)
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(thread % cores, &set);
+		pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+	}
+
+private:
+	const std::vector<Launch>* launches_{ nullptr };
+	const std::vector<std::vector<int>>* consumers_{ nullptr };
+	std::vector<int> num_deps_;
+	std::unique_ptr<std::atomic<int>[]> pending_;
+	std::unique_ptr<Queue[]> queues_;
+	std::atomic<int> remaining_{ 0 };
+	int num_threads_{ 1 };
+	bool pin_threads_{ false };
+
+	std::vector<std::thread> threads_;
+	std::mutex mutex_;
+	std::condition_variable wakeup_;
+	std::condition_variable finished_;
+	uint64_t generation_{ 0 };
+	int active_{ 0 };
+	bool stop_{ false };
+};
+
+struct EngineConfig {
+	int64_t dynamic_dim = 1024;  // 输入中没有给出具体值的维度(dim_param)按此大小规划内存
+	int num_threads = 1;         // 大于1时使用ParallelExecutor，0表示取硬件线程数
+	int kernel_threads = 1;      // 稀疏卷积内部的线程数，0表示取硬件线程数
+	bool pin_threads = false;    // 并行时把工作线程绑定到固定的核
+	bool fuse = true;            // compile前把BatchNormalization、Relu、Add并入前面的节点
+};
+
+struct MemoryPlan {
+	int num_tensors = 0;
+	size_t naive_bytes = 0;  // 每个激活单独分配时的总和
+	size_t arena_bytes = 0;  // 按生命周期复用后的峰值
+};
+
+class Engine {
+public:
+	Engine(const EngineConfig& config) : config_(config) {
+		if (this->config_.num_threads <= 0)
+			this->config_.num_threads = std::max(1u, std::thread::hardware_concurrency());
+		if (this->config_.kernel_threads <= 0)
+			this->config_.kernel_threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	~Engine() {
+		// 先停止工作线程，析构，outputs_中的张量归各自的节点所有
+		this->executor_.reset();
+		this->kernel_pool_.reset();
+		for (int i = 0; i < this->inputs_.size(); ++i)
+		{
+			if (this->inputs_[i])
+			{
+				delete this->inputs_[i];
+				this->inputs_[i] = nullptr;
+			}
+		}
+		for (int i = 0; i < this->nodes_.size(); ++i)
+		{
+			if (this->nodes_[i])
+			{
+				delete this->nodes_[i];
+				this->nodes_[i] = nullptr;
+			}
+		}
+		for (int i = 0; i < this->constants_.size(); ++i)
+		{
+			if (this->constants_[i]->data_ && !this->is_mapped(this->constants_[i]->data_))
+				aligned_free(this->constants_[i]->data_);
+			delete this->constants_[i];
+		}
+		if (this->arena_)
+		{
+			aligned_free(this->arena_);
+			this->arena_ = nullptr;
+		}
+	}
+
+	Tensor* add_input(const std::string& name)
+	{
+		auto x = new Tensor(name);
+		this->inputs_.push_back(x);
+		return x;
+	}
+	Tensor* mark_output(Tensor* x) {
+		this->outputs_.push_back(x);
+		return x;
+	}
+
+	// 保存在float_data等字段中的权重拷贝到独立的对齐缓冲区，生命周期与Engine相同
+	Tensor* add_constant(const onnx::TensorProto& proto) {
+		if (!is_supported_dtype(proto.data_type()))
+		{
+			printf("Unsupported initializer %s, data_type = %d\n", proto.name().c_str(), proto.data_type());
+			return nullptr;
+		}
+
+		auto x = new Tensor(proto.name());
+		x->dtype_ = (DataType)proto.data_type();
+		x->is_constant_ = true;
+		x->reshape(std::vector<int64_t>(proto.dims().begin(), proto.dims().end()));
+		x->data_ = aligned_malloc(std::max(align_up(x->bytes(), kArenaAlignment), kArenaAlignment), kArenaAlignment);
+		this->constants_.push_back(x);
+
+		size_t bytes = x->bytes();
+		if (!proto.raw_data().empty())
+		{
+			if (proto.raw_data().size() != bytes)
+			{
+				printf("Initializer %s has %d bytes, expect %d\n", proto.name().c_str(), (int)proto.raw_data().size(), (int)bytes);
+				return nullptr;
+			}
+			memcpy(x->data_, proto.raw_data().data(), bytes);
+		}
+		else if (x->dtype_ == DataType::Float32 && proto.float_data_size() == x->numel())
+			std::copy(proto.float_data().begin(), proto.float_data().end(), x->data<float>());
+		else if (x->dtype_ == DataType::Int32 && proto.int32_data_size() == x->numel())
+			std::copy(proto.int32_data().begin(), proto.int32_data().end(), x->data<int32_t>());
+		else if (x->dtype_ == DataType::Int64 && proto.int64_data_size() == x->numel())
+			std::copy(proto.int64_data().begin(), proto.int64_data().end(), x->data<int64_t>());
+		else
+		{
+			printf("Initializer %s has no data\n", proto.name().c_str());
+			return nullptr;
+		}
+		return x;
+	}
+
+	/**
+	 * 映射模型文件并就地定位initializer，不构造整个ModelProto
+	 * 有raw_data的权重直接指向映射(不保证对齐，见Tensor::copy_data)，float_data等字段保存的解析该TensorProto后拷贝。
+	 * graph去掉initializer后只剩节点和输入输出的描述，很小，单独解析到graph中
+	 */
+	bool map_model(const std::string& onnx_file, onnx::GraphProto* graph, std::map<std::string, Tensor*>* constants) {
+		this->model_file_.reset(new MappedFile());
+		if (!this->model_file_->open(onnx_file))
+		{
+			printf("Failed to map %s\n", onnx_file.c_str());
+			return false;
+		}
+
+		std::string graph_bytes;
+		std::vector<InitializerSpan> initializers;
+		if (!scan_model(this->model_file_->data(), this->model_file_->size(), &graph_bytes, &initializers) ||
+			!graph->ParseFromString(graph_bytes))
+		{
+			printf("Failed to parse %s\n", onnx_file.c_str());
+			return false;
+		}
+
+		int mapped = 0;
+		int copied = 0;
+		size_t mapped_bytes = 0;
+		size_t copied_bytes = 0;
+		for (const auto& span : initializers)
+		{
+			Tensor* x = nullptr;
+			if (span.external)
+			{
+				printf("Initializer %s stores its data in an external file, which is not supported\n", span.name.c_str());
+				return false;
+			}
+			if (span.raw_data && is_supported_dtype(span.data_type))
+			{
+				x = this->add_constant_view(span);
+				mapped++;
+			}
+			else
+			{
+				onnx::TensorProto proto;
+				if (!proto.ParseFromArray(span.message, (int)span.message_size))
+				{
+					printf("Failed to parse initializer %s\n", span.name.c_str());
+					return false;
+				}
+				x = this->add_constant(proto);
+				copied++;
+			}
+			if (x == nullptr)
+				return false;
+
+			(this->is_mapped(x->data_) ? mapped_bytes : copied_bytes) += x->bytes();
+			(*constants)[x->name_] = x;
+		}
+
+		printf("Mapped %s: %d initializers (%.1f MB) in place, %d copied (%.1f KB)\n", onnx_file.c_str(),
+			mapped, mapped_bytes / 1048576.0, copied, copied_bytes / 1024.0);
+		return true;
+	}
+
+	Node* add_spconv(const std::string& name, Tensor* x, Tensor* weight, Tensor* bias, const Attributes& attributes) {
+		auto spc = new SparseConvolution(name, x, weight, bias, attributes);
+		this->nodes_.push_back(spc);
+		return spc;
+	}
+
+	Node* add_relu(const std::string& name, Tensor* x) {
+		auto relu = new ReLU(name, x);
+		this->nodes_.push_back(relu);
+		return relu;
+	}
+
+	Node* add_add(const std::string& name, Tensor* a, Tensor* b) {
+		auto add = new Add(name, a, b);
+		this->nodes_.push_back(add);
+		return add;
+	}
+
+	Node* add_bn(const std::string& name, Tensor* x, Tensor* scale, Tensor* bias, Tensor* mean, Tensor* var, const Attributes& attributes) {
+		auto bn = new BatchNormalization(name, x, scale, bias, mean, var, attributes);
+		this->nodes_.push_back(bn);
+		return bn;
+	}
+
+	/**
+	 * 把图编译成扁平的执行计划，load时调用一次
+	 * 0. 融合节点，见fuse_nodes
+	 * 1. 从所有输出反向找出需要执行的节点，拓扑排序，同时就绪的节点按onnx中的先后执行
+	 * 2. 按这个顺序规划内存，并行执行时只在图上有先后关系的张量之间复用内存
+	 * 3. 为每个节点生成Launch，此后输入输出的地址不再变化，并行执行时还要记录每个Launch的后继
+	 * 全部为迭代实现，网络的深度不受栈大小限制
+	 */
+	bool compile() {
+		if (this->config_.fuse)
+			this->fuse_nodes();
+		if (!this->sort_nodes() || !this->plan_memory())
+			return false;
+
+		if (this->config_.kernel_threads > 1)
+			this->kernel_pool_.reset(new ThreadPool(this->config_.kernel_threads));
+
+		// 一次推理内，indice_key和输入坐标都相同的子流形卷积共用规则表
+		std::map<std::string, std::shared_ptr<Rulebook>> rulebooks;
+		for (auto node : this->order_)
+		{
+			auto conv = dynamic_cast<SparseConvolution*>(node);
+			if (conv == nullptr)
+				continue;
+
+			conv->set_thread_pool(this->kernel_pool_.get());
+			std::string key = conv->rulebook_key();
+			if (key.empty())
+			{
+				conv->share_rulebook(conv->rulebook(), &this->inference_);
+				continue;
+			}
+
+			auto& shared = rulebooks[key];
+			if (!shared)
+				shared = conv->rulebook();
+			else
+				printf("%s reuses the rulebook of indice_key %s\n", conv->name_.c_str(), conv->indice_key().c_str());
+			conv->share_rulebook(shared, &this->inference_);
+		}
+
+		this->launches_.clear();
+		for (auto node : this->order_)
+		{
+			Launch launch;
+			launch.node = node;
+			for (auto x : node->input_)
+				launch.inputs.push_back(x->data_);
+			launch.output = node->output_->data_;
+			this->launches_.push_back(launch);
+		}
+
+		if (this->config_.num_threads > 1)
+		{
+			std::map<Node*, int> position;
+			for (int i = 0; i < this->order_.size(); ++i)
+				position[this->order_[i]] = i;
+
+			this->consumers_.assign(this->order_.size(), std::vector<int>());
+			for (int i = 0; i < this->order_.size(); ++i)
+			{
+				for (auto x : this->order_[i]->input_)
+				{
+					if (producer(x))
+						this->consumers_[position[producer(x)]].push_back(i);
+				}
+			}
+
+			this->executor_.reset(new ParallelExecutor());
+			if (!this->executor_->startup(&this->launches_, &this->consumers_, this->config_.num_threads, this->config_.pin_threads))
+			{
+				this->executor_.reset();
+				return false;
+			}
+		}
+		return true;
+	}
+
+	int num_threads() const { return this->executor_ ? this->executor_->num_threads() : 1; }
+
+	const MemoryPlan& memory_plan() const { return this->plan_; }
+
+	int num_inputs() const { return (int)this->inputs_.size(); }
+	int num_outputs() const { return (int)this->outputs_.size(); }
+	Tensor* input(int i) { return this->inputs_[i]; }
+	Tensor* output(int i) { return this->outputs_[i]; }
+
+	// 输入由调用者直接写入input(i)的data，按compile的顺序执行一遍，所有输出都会被计算，不分配内存
+	void forward() {
+		this->inference_++;
+		if (this->executor_)
+		{
+			this->executor_->run();
+			return;
+		}
+
+		for (const auto& launch : this->launches_)
+		{
+			launch.node->forward(launch);
+		}
+	}
+
+	// 各稀疏卷积层建立规则表与计算的平均耗时
+	void print_profile() const {
+		if (this->inference_ == 0)
+			return;
+
+		double rulebook_ms = 0;
+		double compute_ms = 0;
+		printf("%-24s %-12s %8s %8s %12s %12s\n", "layer", "indice_key", "builds", "reuses", "rulebook ms", "compute ms");
+		for (auto node : this->order_)
+		{
+			auto conv = dynamic_cast<SparseConvolution*>(node);
+			if (conv == nullptr)
+				continue;
+
+			const auto& stats = conv->stats();
+			printf("%-24s %-12s %8d %8d %12.3f %12.3f\n", conv->name_.c_str(), conv->indice_key().c_str(),
+				(int)stats.builds, (int)stats.reuses, stats.rulebook_ms / this->inference_, stats.compute_ms / this->inference_);
+			rulebook_ms += stats.rulebook_ms;
+			compute_ms += stats.compute_ms;
+		}
+
+		double total = std::max(rulebook_ms + compute_ms, 1e-9);
+		printf("sparse convolution per inference: rulebook %.3f ms (%.1f%%), compute %.3f ms (%.1f%%)\n",
+			rulebook_ms / this->inference_, 100 * rulebook_ms / total, compute_ms / this->inference_, 100 * compute_ms / total);
+	}
+
+private:
+	Tensor* add_constant_view(const InitializerSpan& span) {
+		auto x = new Tensor(span.name);
+		x->dtype_ = (DataType)span.data_type;
+		x->is_constant_ = true;
+		x->reshape(span.dims);
+		this->constants_.push_back(x);
+		if (span.raw_size != x->bytes())
+		{
+			printf("Initializer %s has %d bytes, expect %d\n", span.name.c_str(), (int)span.raw_size, (int)x->bytes());
+			return nullptr;
+		}
+		// 映射是只读的，常量不会被写入
+		x->data_ = const_cast<uint8_t*>(span.raw_data);
+		return x;
+	}
+
+	bool is_mapped(const void* ptr) const {
+		if (!this->model_file_)
+			return false;
+		const uint8_t* p = static_cast<const uint8_t*>(ptr);
+		return p >= this->model_file_->data() && p < this->model_file_->data() + this->model_file_->size();
+	}
+
+	static Node* producer(Tensor* x) {
+		return dynamic_cast<Node*>(x->parent_);
+	}
+
+	/**
+	 * 按onnx中的顺序逐个检查节点能否并入产生其输入的节点
+	 * 1. SparseConvolution -> BatchNormalization：折叠进卷积的权重和偏置
+	 * 2. SparseConvolution -> Add：另一个输入作为残差，在卷积的收尾中相加
+	 * 3. SparseConvolution/Add/BatchNormalization -> Relu：在该节点的收尾中截断
+	 * 被并入的节点读取的张量不能是网络的输出，也不能有其他使用者。删除被并入的节点后，
+	 * 它的使用者改为读取前一个节点的输出，因此conv-bn-relu、conv-add-relu这样的链会逐个并入卷积
+	 */
+	int fuse_nodes() {
+		int fused = 0;
+		for (int i = 0; i < this->nodes_.size(); ++i)
+		{
+			auto node = this->nodes_[i];
+			Node* target = nullptr;
+			Tensor* x = nullptr;
+			if (node->op_type_ == "BatchNormalization")
+			{
+				x = node->input_[0];
+				auto conv = dynamic_cast<SparseConvolution*>(producer(x));
+				auto bn = static_cast<BatchNormalization*>(node);
+				if (conv && this->exclusive(x) && conv->fold_bn(bn->alpha(), bn->beta()))
+					target = conv;
+			}
+			else if (node->op_type_ == "ReLU")
+			{
+				x = node->input_[0];
+				if (producer(x) && this->exclusive(x) && producer(x)->fuse_relu())
+					target = producer(x);
+			}
+			else if (node->op_type_ == "Add")
+			{
+				for (int j = 0; j < 2 && target == nullptr; ++j)
+				{
+					x = node->input_[j];
+					auto conv = dynamic_cast<SparseConvolution*>(producer(x));
+					if (conv && this->exclusive(x) && conv->fuse_add(node->input_[1 - j]))
+						target = conv;
+				}
+			}
+			else
+				continue;
+
+			if (target == nullptr)
+			{
+				if (producer(node->input_[0]) || (node->input_.size() > 1 && producer(node->input_[1])))
+					printf("Fusion: %s (%s) kept, its input is shared or the producer cannot take it\n", node->name_.c_str(), node->op_type_.c_str());
+				continue;
+			}
+
+			// 逐元素的节点输入输出形状相同，网络输入的空间尺寸是后面的卷积在infer_shape时才写到输出上的
+			printf("Fusion: %s (%s) -> %s\n", node->name_.c_str(), node->op_type_.c_str(), target->name_.c_str());
+			x->spatial_shape_ = node->output_->spatial_shape_;
+			this->replace_tensor(node->output_, x);
+			delete node;
+			this->nodes_.erase(this->nodes_.begin() + i);
+			--i;
+			fused++;
+		}
+
+		printf("Fusion: %d nodes fused, %d nodes left\n", fused, (int)this->nodes_.size());
+		return fused;
+	}
+
+	// x只被一个节点读取一次，并且不是网络的输出
+	bool exclusive(Tensor* x) const {
+		int uses = (int)std::count(this->outputs_.begin(), this->outputs_.end(), x);
+		for (auto node : this->nodes_)
+			uses += (int)std::count(node->input_.begin(), node->input_.end(), x);
+		return uses == 1;
+	}
+
+	void replace_tensor(Tensor* from, Tensor* to) {
+		for (auto node : this->nodes_)
+			std::replace(node->input_.begin(), node->input_.end(), from, to);
+		std::replace(this->outputs_.begin(), this->outputs_.end(), from, to);
+	}
+
+	bool sort_nodes() {
+		std::map<Node*, int> index;
+		for (int i = 0; i < this->nodes_.size(); ++i)
+			index[this->nodes_[i]] = i;
+
+		std::vector<char> needed(this->nodes_.size(), 0);
+		std::vector<Node*> stack;
+		for (auto y : this->outputs_)
+		{
+			if (producer(y))
+				stack.push_back(producer(y));
+		}
+		while (!stack.empty())
+		{
+			auto node = stack.back();
+			stack.pop_back();
+			int i = index[node];
+			if (needed[i])
+				continue;
+
+			needed[i] = 1;
+			for (auto x : node->input_)
+			{
+				if (producer(x))
+					stack.push_back(producer(x));
+			}
+		}
+
+		// Kahn算法，pending为尚未完成的前驱数，同一个张量被读两次时也计两次
+		std::vector<int> pending(this->nodes_.size(), 0);
+		std::vector<std::vector<int>> consumers(this->nodes_.size());
+		std::set<int> ready;
+		int num_needed = 0;
+		for (int i = 0; i < this->nodes_.size(); ++i)
+		{
+			if (!needed[i])
+				continue;
+
+			num_needed++;
+			for (auto x : this->nodes_[i]->input_)
+			{
+				if (producer(x))
+				{
+					pending[i]++;
+					consumers[index[producer(x)]].push_back(i);
+				}
+			}
+			if (pending[i] == 0)
+				ready.insert(i);
+		}
+
+		this->order_.clear();
+		while (!ready.empty())
+		{
+			int i = *ready.begin();
+			ready.erase(ready.begin());
+			this->order_.push_back(this->nodes_[i]);
+			for (auto c : consumers[i])
+			{
+				if (--pending[c] == 0)
+					ready.insert(c);
+			}
+		}
+
+		if (this->order_.size() != num_needed)
+		{
+			printf("Graph has a cycle, %d of %d nodes sorted\n", (int)this->order_.size(), num_needed);
+			return false;
+		}
+		return true;
+	}
+
+	/**
+	 * 规划所有激活张量在arena中的偏移
+	 * 执行顺序为order_，张量的生命周期为[产生它的节点, 最后读取它的节点]，
+	 * 输入在第一个节点之前就已写入，输入和输出都要保留到forward返回之后。
+	 * 张量按大小降序依次放入与之生命周期重叠的已放置张量之间最低的空隙，
+	 * 生命周期不重叠的张量共用同一段内存，最后一次性分配整个arena。
+	 * 并行执行时节点的先后只由依赖决定，a能与b共用内存要求a的生产者和所有读取者都是b的生产者的祖先
+	 */
+	bool plan_memory() {
+		struct Block {
+			Tensor* tensor;
+			size_t size;
+			int first;
+			int last;
+			size_t offset;
+			std::vector<int> readers;
+		};
+
+		const auto& order = this->order_;
+		std::map<Tensor*, int> block_index;
+		std::vector<Block> blocks;
+		auto add_block = [&](Tensor* t, int first) {
+			block_index[t] = (int)blocks.size();
+			blocks.push_back({ t, std::max(align_up(t->bytes(), kArenaAlignment), kArenaAlignment), first, first, 0 });
+		};
+
+		for (auto x : this->inputs_)
+			add_block(x, -1);
+
+		// 读取稀疏张量的节点同时也读取它的坐标，卷积产生的坐标与输出特征同时写入
+		for (int i = 0; i < order.size(); ++i)
+		{
+			for (auto x : order[i]->input_)
+			{
+				for (auto t : { x, x->indices_ })
+				{
+					if (t == nullptr || t->is_constant_)
+						continue;
+					auto& b = blocks[block_index[t]];
+					b.last = std::max(b.last, i);
+					b.readers.push_back(i);
+				}
+			}
+			add_block(order[i]->output_, i);
+
+			auto indices = order[i]->output_->indices_;
+			if (indices && indices->parent_ == order[i])
+				add_block(indices, i);
+		}
+
+		// 输入由调用者写入一次后可以反复forward，和输出一样在整个过程中都不能被覆盖
+		for (auto x : this->inputs_)
+			blocks[block_index[x]].last = (int)order.size();
+		for (auto y : this->outputs_)
+		{
+			for (auto t : { y, y->indices_ })
+			{
+				if (t && !t->is_constant_)
+					blocks[block_index[t]].last = (int)order.size();
+			}
+		}
+
+		std::vector<Block*> sorted;
+		for (auto& b : blocks)
+			sorted.push_back(&b);
+		std::stable_sort(sorted.begin(), sorted.end(), [](const Block* a, const Block* b) { return a->size > b->size; });
+
+		// ancestors[i]的第j位表示order[j]一定在order[i]开始之前完成
+		bool concurrent = this->config_.num_threads > 1;
+		int words = ((int)order.size() + 63) / 64;
+		std::vector<std::vector<uint64_t>> ancestors;
+		if (concurrent)
+		{
+			ancestors.assign(order.size(), std::vector<uint64_t>(words, 0));
+			for (int i = 0; i < order.size(); ++i)
+			{
+				for (auto x : order[i]->input_)
+				{
+					if (x->is_constant_ || blocks[block_index[x]].first < 0)
+						continue;
+					int p = blocks[block_index[x]].first;
+					for (int w = 0; w < words; ++w)
+						ancestors[i][w] |= ancestors[p][w];
+					ancestors[i][p / 64] |= uint64_t(1) << (p % 64);
+				}
+			}
+		}
+
+		auto is_ancestor = [&](int a, int b) {
+			return (ancestors[b][a / 64] >> (a % 64)) & 1;
+		};
+		auto finishes_before = [&](const Block* a, const Block* b) {
+			if (b->first < 0 || a->last == (int)order.size())
+				return false;
+			if (a->first >= 0 && !is_ancestor(a->first, b->first))
+				return false;
+			for (auto r : a->readers)
+			{
+				if (!is_ancestor(r, b->first))
+					return false;
+			}
+			return true;
+		};
+		auto overlaps = [&](const Block* a, const Block* b) {
+			if (concurrent)
+				return !finishes_before(a, b) && !finishes_before(b, a);
+			return a->first <= b->last && b->first <= a->last;
+		};
+
+		MemoryPlan plan;
+		std::vector<Block*> placed;
+		for (auto b : sorted)
+		{
+			std::vector<Block*> conflicts;
+			for (auto p : placed)
+			{
+				if (overlaps(p, b))
+					conflicts.push_back(p);
+			}
+			std::sort(conflicts.begin(), conflicts.end(), [](const Block* a, const Block* b) { return a->offset < b->offset; });
+
+			size_t offset = 0;
+			for (auto c : conflicts)
+			{
+				if (offset + b->size <= c->offset)
+					break;
+				offset = std::max(offset, c->offset + c->size);
+			}
+			b->offset = offset;
+			placed.push_back(b);
+
+			plan.num_tensors++;
+			plan.naive_bytes += b->size;
+			plan.arena_bytes = std::max(plan.arena_bytes, offset + b->size);
+		}
+
+		this->arena_ = static_cast<char*>(aligned_malloc(std::max(plan.arena_bytes, kArenaAlignment), kArenaAlignment));
+		if (this->arena_ == nullptr)
+		{
+			printf("Failed to allocate arena of %d bytes\n", (int)plan.arena_bytes);
+			return false;
+		}
+
+		for (auto& b : blocks)
+		{
+			b.tensor->data_ = this->arena_ + b.offset;
+			b.tensor->capacity_ = b.size;
+		}
+
+		this->plan_ = plan;
+		return true;
+	}
+
+private:
+	std::vector<Tensor*> inputs_;
+	std::vector<Tensor*> outputs_;
+	std::vector <Node*> nodes_;
+	std::vector<Node*> order_;
+	std::vector<Launch> launches_;
+	std::vector<std::vector<int>> consumers_;
+	std::unique_ptr<ParallelExecutor> executor_;
+	std::unique_ptr<ThreadPool> kernel_pool_;
+	uint64_t inference_{ 0 };  // forward的次数，用于判断规则表是否属于本次推理
+	EngineConfig config_;
+	std::vector<Tensor*> constants_;
+	std::unique_ptr<MappedFile> model_file_;  // 映射的权重与Engine同生命周期
+	char* arena_{ nullptr };
+	MemoryPlan plan_;
+};
+
+Engine* load_engine(const std::string& onnx_file, const EngineConfig& config = EngineConfig()) {
+	auto engine = new Engine(config);
+	onnx::GraphProto graph;
+	std::map<std::string, Tensor*> name_to_tensor;
+	if (!engine->map_model(onnx_file, &graph, &name_to_tensor))
+	{
+		delete engine;
+		return nullptr;
+	}
+
+	for (const auto& i : graph.input())
+	{
+		// 旧版本的导出会把initializer也列在input中
+		if (name_to_tensor.count(i.name()))
+			continue;
+
+		auto x = engine->add_input(i.name());
+		const auto& type = i.type().tensor_type();
+		if (!is_supported_dtype(type.elem_type()))
+		{
+			printf("Unsupported input %s, elem_type = %d\n", i.name().c_str(), type.elem_type());
+			delete engine;
+			return nullptr;
+		}
+
+		std::vector<int64_t> shape;
+		for (const auto& d : type.shape().dim())
+			shape.push_back(d.dim_value() > 0 ? d.dim_value() : config.dynamic_dim);
+		x->dtype_ = (DataType)type.elem_type();
+		x->reshape(shape);
+		name_to_tensor[x->name_] = x;
+	}
+
+	// 稀疏网络的输入为[N, C]的特征和[N, 4]的int32坐标，坐标附加到所有的二维特征输入上
+	Tensor* coordinates = nullptr;
+	for (int i = 0; i < engine->num_inputs(); ++i)
+	{
+		auto x = engine->input(i);
+		if (x->dtype_ == DataType::Int32 && x->ndim() == 2 && x->shape_[1] == 4)
+			coordinates = x;
+	}
+	for (int i = 0; i < engine->num_inputs() && coordinates; ++i)
+	{
+		auto x = engine->input(i);
+		if (x->dtype_ == DataType::Float32 && x->ndim() == 2)
+			x->indices_ = coordinates;
+	}
+
+	auto get_tensor = [&](const onnx::NodeProto& n, int i) -> Tensor* {
+		if (i >= n.input_size() || name_to_tensor.count(n.input(i)) == 0)
+			return nullptr;
+		return name_to_tensor[n.input(i)];
+	};
+
+	for (const auto& n : graph.node())
+	{
+		Node* layer = nullptr;
+		if (n.op_type() == "SparseConvolution") {
+			layer = engine->add_spconv(n.name(), get_tensor(n, 0), get_tensor(n, 1), get_tensor(n, 2), Attributes(n));
+		}
+		else if (n.op_type() == "BatchNormalization") {
+			layer = engine->add_bn(n.name(), get_tensor(n, 0), get_tensor(n, 1), get_tensor(n, 2), get_tensor(n, 3), get_tensor(n, 4), Attributes(n));
+		}
+		else if (n.op_type() == "Relu") {
+			layer = engine->add_relu(n.name(), get_tensor(n, 0));
+		}
+		else if (n.op_type() == "Add") {
+			layer = engine->add_add(n.name(), get_tensor(n, 0), get_tensor(n, 1));
+		}
+		else {
+			printf("Unsupported op %s of node %s\n", n.op_type().c_str(), n.name().c_str());
+			delete engine;
+			return nullptr;
+		}
+
+		for (auto x : layer->input_)
+		{
+			if (x == nullptr)
+			{
+				printf("Node %s has an unknown input\n", n.name().c_str());
+				delete engine;
+				return nullptr;
+			}
+		}
+
+		if (!layer->infer_shape())
+		{
+			delete engine;
+			return nullptr;
+		}
+		name_to_tensor[n.output()[0]] = layer->output_;
+	}
+
+	// 输入先经过BatchNormalization等逐元素的层时没有卷积为它指定空间尺寸，取共用同一组坐标的张量的尺寸
+	for (int i = 0; i < engine->num_inputs(); ++i)
+	{
+		auto x = engine->input(i);
+		for (const auto& item : name_to_tensor)
+		{
+			if (x->indices_ == nullptr || !x->spatial_shape_.empty())
+				break;
+			if (item.second->indices_ == x->indices_ && item.second->spatial_shape_.size() == 3)
+				x->spatial_shape_ = item.second->spatial_shape_;
+		}
+	}
+
+	for (const auto& o : graph.output())
+	{
+		if (name_to_tensor.count(o.name()) == 0)
+		{
+			printf("Unknown output %s\n", o.name().c_str());
+			delete engine;
+			return nullptr;
+		}
+		engine->mark_output(name_to_tensor[o.name()]);
+	}
+
+	if (!engine->compile())
+	{
+		delete engine;
+		return nullptr;
+	}
+
+	const auto& plan = engine->memory_plan();
+	printf("Memory plan: %d activations, naive %.1f KB, arena %.1f KB (%.1f%% of naive), %d threads\n",
+		plan.num_tensors, plan.naive_bytes / 1024.0, plan.arena_bytes / 1024.0,
+		plan.naive_bytes > 0 ? 100.0 * plan.arena_bytes / plan.naive_bytes : 0.0, engine->num_threads());
+	return engine;
+}
+
+// 稠密网格上的参考实现，按double累加，mask标记有效的体素
+struct DenseGrid {
+	int batch, depth, height, width, channels;
+	std::vector<double> values;
+	std::vector<char> mask;
+
+	DenseGrid(int batch, int depth, int height, int width, int channels)
+		: batch(batch), depth(depth), height(height), width(width), channels(channels),
+		values((size_t)batch * depth * height * width * channels, 0.0), mask((size_t)batch * depth * height * width, 0) {}
+
+	size_t at(int b, int z, int y, int x) const { return (((size_t)b * this->depth + z) * this->height + y) * this->width + x; }
+	int active() const { return (int)std::count(this->mask.begin(), this->mask.end(), 1); }
+};
+
+// 参考卷积的参数，weights按[cout, kD, kH, kW, cin]排列
+struct ReferenceConv {
+	int kernel[3], stride[3], padding[3], dilation[3];
+	bool subm;
+	int in_channels, out_channels;
+	std::vector<float> weights;
+	std::vector<float> bias;
+};
+
+// 子流形卷积只在输入有效的位置输出，普通稀疏卷积在感受野内有任一有效输入的位置输出
+static DenseGrid dense_conv(const DenseGrid& x, const ReferenceConv& p) {
+	int out_size[3];
+	int in_size[3] = { x.depth, x.height, x.width };
+	for (int i = 0; i < 3; ++i)
+		out_size[i] = p.subm ? in_size[i] : (in_size[i] + 2 * p.padding[i] - p.dilation[i] * (p.kernel[i] - 1) - 1) / p.stride[i] + 1;
+
+	DenseGrid y(x.batch, out_size[0], out_size[1], out_size[2], p.out_channels);
+	int volume = p.kernel[0] * p.kernel[1] * p.kernel[2];
+	std::vector<double> acc(p.out_channels);
+	for (int b = 0; b < y.batch; ++b)
+	for (int z = 0; z < y.depth; ++z)
+	for (int yy = 0; yy < y.height; ++yy)
+	for (int xx = 0; xx < y.width; ++xx)
+	{
+		if (p.subm && !x.mask[x.at(b, z, yy, xx)])
+			continue;
+
+		bool any = false;
+		std::fill(acc.begin(), acc.end(), 0.0);
+		for (int k = 0; k < volume; ++k)
+		{
+			int offset[3] = { k / (p.kernel[1] * p.kernel[2]), k / p.kernel[2] % p.kernel[1], k % p.kernel[2] };
+			int out[3] = { z, yy, xx };
+			int in[3];
+			bool inside = true;
+			for (int i = 0; i < 3; ++i)
+			{
+				in[i] = p.subm ? out[i] + (offset[i] - (p.kernel[i] - 1) / 2) * p.dilation[i]
+					: out[i] * p.stride[i] - p.padding[i] + offset[i] * p.dilation[i];
+				inside = inside && in[i] >= 0 && in[i] < in_size[i];
+			}
+			if (!inside || !x.mask[x.at(b, in[0], in[1], in[2])])
+				continue;
+
+			any = true;
+			const double* v = x.values.data() + x.at(b, in[0], in[1], in[2]) * p.in_channels;
+			for (int co = 0; co < p.out_channels; ++co)
+			{
+				const float* w = p.weights.data() + ((size_t)co * volume + k) * p.in_channels;
+				for (int ci = 0; ci < p.in_channels; ++ci)
+					acc[co] += v[ci] * w[ci];
+			}
+		}
+		if (!any && !p.subm)
+			continue;
+
+		size_t o = y.at(b, z, yy, xx);
+		y.mask[o] = 1;
+		for (int co = 0; co < p.out_channels; ++co)
+			y.values[o * p.out_channels + co] = acc[co] + p.bias[co];
+	}
+	return y;
+}
+
+// 在内存中搭建只含SparseConvolution、Relu、Add的ONNX模型，输入为feat[N, C]和coords[N, 4]
+class ReferenceModel {
+public:
+	ReferenceModel(int channels) {
+		this->add_input("feat", onnx::TensorProto_DataType_FLOAT, channels);
+		this->add_input("coords", onnx::TensorProto_DataType_INT32, 4);
+	}
+
+	// 随机初始化p的权重和偏置，rsck为true时权重按[kD, kH, kW, cin, cout]保存
+	void add_conv(const std::string& name, const std::string& input, const std::string& output, ReferenceConv& p,
+		const int spatial[3], const std::string& indice_key, bool rsck, std::mt19937& rng) {
+		int volume = p.kernel[0] * p.kernel[1] * p.kernel[2];
+		std::uniform_real_distribution<float> weight(-0.3f, 0.3f), bias(-0.1f, 0.1f);
+		p.weights.resize((size_t)p.out_channels * volume * p.in_channels);
+		p.bias.resize(p.out_channels);
+		for (auto& v : p.weights)
+			v = weight(rng);
+		for (auto& v : p.bias)
+			v = bias(rng);
+
+		std::vector<float> stored = p.weights;
+		if (rsck)
+		{
+			for (int co = 0; co < p.out_channels; ++co)
+				for (int k = 0; k < volume; ++k)
+					for (int ci = 0; ci < p.in_channels; ++ci)
+						stored[((size_t)k * p.in_channels + ci) * p.out_channels + co] = p.weights[((size_t)co * volume + k) * p.in_channels + ci];
+			this->add_initializer(name + ".weight", { p.kernel[0], p.kernel[1], p.kernel[2], p.in_channels, p.out_channels }, stored);
+		}
+		else
+			this->add_initializer(name + ".weight", { p.out_channels, p.kernel[0], p.kernel[1], p.kernel[2], p.in_channels }, stored);
+		this->add_initializer(name + ".bias", { p.out_channels }, p.bias);
+
+		auto n = this->add_node("SparseConvolution", name, { input, name + ".weight", name + ".bias" }, output);
+		add_ints(n, "kernel_size", { p.kernel[0], p.kernel[1], p.kernel[2] });
+		add_ints(n, "stride", { p.stride[0], p.stride[1], p.stride[2] });
+		add_ints(n, "padding", { p.padding[0], p.padding[1], p.padding[2] });
+		add_ints(n, "dilation", { p.dilation[0], p.dilation[1], p.dilation[2] });
+		add_ints(n, "input_spatial_shape", { spatial[0], spatial[1], spatial[2] });
+		add_int(n, "ndim", 3);
+		add_int(n, "subm", p.subm);
+		add_int(n, "in_channels", p.in_channels);
+		add_int(n, "out_channels", p.out_channels);
+		auto a = n->add_attribute();
+		a->set_name("indice_key");
+		a->set_type(onnx::AttributeProto_AttributeType_STRING);
+		a->set_s(indice_key);
+	}
+
+	onnx::NodeProto* add_node(const std::string& op, const std::string& name, const std::vector<std::string>& inputs, const std::string& output) {
+		auto n = this->model_.mutable_graph()->add_node();
+		n->set_op_type(op);
+		n->set_name(name);
+		for (const auto& i : inputs)
+			n->add_input(i);
+		n->add_output(output);
+		return n;
+	}
+
+	void add_output(const std::string& name) { this->model_.mutable_graph()->add_output()->set_name(name); }
+
+	bool save(const std::string& file) const {
+		std::ofstream out(file, std::ios::binary);
+		return out && this->model_.SerializeToOstream(&out);
+	}
+
+private:
+	void add_input(const std::string& name, int elem_type, int64_t channels) {
+		auto t = this->model_.mutable_graph()->add_input();
+		t->set_name(name);
+		auto type = t->mutable_type()->mutable_tensor_type();
+		type->set_elem_type(elem_type);
+		type->mutable_shape()->add_dim()->set_dim_param("N");
+		type->mutable_shape()->add_dim()->set_dim_value(channels);
+	}
+
+	void add_initializer(const std::string& name, const std::vector<int64_t>& dims, const std::vector<float>& values) {
+		auto t = this->model_.mutable_graph()->add_initializer();
+		t->set_name(name);
+		t->set_data_type(onnx::TensorProto_DataType_FLOAT);
+		for (auto d : dims)
+			t->add_dims(d);
+		t->set_raw_data(std::string((const char*)values.data(), values.size() * sizeof(float)));
+	}
+
+	static void add_int(onnx::NodeProto* n, const std::string& name, int64_t value) {
+		auto a = n->add_attribute();
+		a->set_name(name);
+		a->set_type(onnx::AttributeProto_AttributeType_INT);
+		a->set_i(value);
+	}
+
+	static void add_ints(onnx::NodeProto* n, const std::string& name, const std::vector<int64_t>& values) {
+		auto a = n->add_attribute();
+		a->set_name(name);
+		a->set_type(onnx::AttributeProto_AttributeType_INTS);
+		for (auto v : values)
+			a->add_ints(v);
+	}
+
+	onnx::ModelProto model_;
+};
+
+// 按density随机选取体素，特征在[-1, 1]之间，同时写入稠密网格
+struct SparseInput {
+	std::vector<float> features;
+	std::vector<int32_t> coordinates;
+	int rows = 0;
+};
+
+static SparseInput random_sparse_input(DenseGrid& grid, float density, std::mt19937& rng) {
+	std::uniform_real_distribution<float> uniform(0.0f, 1.0f), feature(-1.0f, 1.0f);
+	std::vector<int> cells;
+	for (int i = 0; i < (int)grid.mask.size(); ++i)
+		if (uniform(rng) < density)
+			cells.push_back(i);
+	std::shuffle(cells.begin(), cells.end(), rng);
+
+	SparseInput input;
+	for (int c : cells)
+	{
+		int x = c % grid.width, y = c / grid.width % grid.height, z = c / (grid.width * grid.height) % grid.depth, b = c / (grid.width * grid.height * grid.depth);
+		input.coordinates.insert(input.coordinates.end(), { b, z, y, x });
+		size_t i = grid.at(b, z, y, x);
+		grid.mask[i] = 1;
+		for (int j = 0; j < grid.channels; ++j)
+		{
+			float v = feature(rng);
+			input.features.push_back(v);
+			grid.values[i * grid.channels + j] = v;
+		}
+	}
+	input.rows = (int)cells.size();
+	return input;
+}
+
+static void set_sparse_input(Engine* engine, const SparseInput& input) {
+	memcpy(engine->input(0)->data_, input.features.data(), input.features.size() * sizeof(float));
+	memcpy(engine->input(1)->data_, input.coordinates.data(), input.coordinates.size() * sizeof(int32_t));
+	engine->input(0)->set_rows(input.rows);
+	engine->input(1)->set_rows(input.rows);
+}
+
+// 输出与稠密参考的最大误差，mismatches为只在一侧有效的体素数
+static double compare_with_dense(Tensor* y, const DenseGrid& reference, int* mismatches) {
+	const int32_t* c = y->indices_->data<int32_t>();
+	int rows = (int)y->shape_[0], channels = (int)y->shape_[1];
+	double max_diff = 0;
+	*mismatches = reference.active() - rows;
+	for (int i = 0; i < rows; ++i)
+	{
+		size_t g = reference.at(c[i * 4 + 0], c[i * 4 + 1], c[i * 4 + 2], c[i * 4 + 3]);
+		if (!reference.mask[g])
+		{
+			++*mismatches;
+			continue;
+		}
+		for (int j = 0; j < channels; ++j)
+			max_diff = std::max(max_diff, std::fabs(y->data<float>()[i * channels + j] - reference.values[g * channels + j]));
+	}
+	return max_diff;
+}
+
+/*
+ * 用稠密的double参考实现验证稀疏卷积，全部通过时返回true
+ * 单层覆盖子流形k1/k3、膨胀、步长2/3、偶数卷积核和两种权重排布，
+ * 网络为 subm-relu-subm-add(残差)-relu-下采样-subm，分别在融合开关、单线程和多线程下运行
+ */
+bool check_spconv_reference(int kernel_threads = 1, double tolerance = 1e-4) {
+	const std::string file = "spconv_reference.onnx";
+	std::mt19937 rng(11);
+	bool passed = true;
+
+	struct Case { int kernel, stride, padding, dilation; bool subm, rsck; };
+	const Case cases[] = {
+		{ 3, 1, 1, 1, true, false }, { 3, 1, 0, 2, true, false }, { 1, 1, 0, 1, true, false }, { 3, 2, 1, 1, false, false },
+		{ 3, 2, 0, 1, false, true }, { 2, 2, 0, 1, false, false }, { 3, 1, 1, 1, false, false }, { 3, 3, 1, 2, false, false }
+	};
+	for (const auto& c : cases)
+	{
+		const int spatial[3] = { 11, 17, 23 };
+		DenseGrid grid(2, spatial[0], spatial[1], spatial[2], 5);
+		auto input = random_sparse_input(grid, 0.2f, rng);
+
+		ReferenceConv p{ { c.kernel, c.kernel, c.kernel }, { c.stride, c.stride, c.stride }, { c.padding, c.padding, c.padding },
+			{ c.dilation, c.dilation, c.dilation }, c.subm, 5, 7 };
+		ReferenceModel model(5);
+		model.add_conv("conv", "feat", "y", p, spatial, "subm0", c.rsck, rng);
+		model.add_output("y");
+		if (!model.save(file))
+		{
+			printf("Save %s failed\n", file.c_str());
+			return false;
+		}
+
+		EngineConfig config;
+		config.dynamic_dim = input.rows;
+		config.kernel_threads = kernel_threads;
+		std::unique_ptr<Engine> engine(load_engine(file, config));
+		if (!engine)
+			return false;
+
+		set_sparse_input(engine.get(), input);
+		engine->forward();
+		int mismatches = 0;
+		double diff = compare_with_dense(engine->output(0), dense_conv(grid, p), &mismatches);
+		bool ok = mismatches == 0 && diff <= tolerance;
+		passed = passed && ok;
+		printf("%s k%d s%d p%d d%d%s%s: %d -> %d rows, %d mismatches, max diff %.3g\n", ok ? "PASS" : "FAIL",
+			c.kernel, c.stride, c.padding, c.dilation, c.subm ? " subm" : "", c.rsck ? " rsck" : "",
+			input.rows, (int)engine->output(0)->shape_[0], mismatches, diff);
+	}
+
+	{
+		const int spatial[3] = { 20, 40, 40 }, down[3] = { 10, 20, 20 };
+		DenseGrid grid(1, spatial[0], spatial[1], spatial[2], 16);
+		auto input = random_sparse_input(grid, 0.1f, rng);
+
+		ReferenceConv a{ { 3, 3, 3 }, { 1, 1, 1 }, { 1, 1, 1 }, { 1, 1, 1 }, true, 16, 16 }, b = a;
+		ReferenceConv c{ { 3, 3, 3 }, { 2, 2, 2 }, { 1, 1, 1 }, { 1, 1, 1 }, false, 16, 32 };
+		ReferenceConv d{ { 3, 3, 3 }, { 1, 1, 1 }, { 1, 1, 1 }, { 1, 1, 1 }, true, 32, 32 };
+		ReferenceModel model(16);
+		model.add_conv("c1", "feat", "y1", a, spatial, "subm1", false, rng);
+		model.add_node("Relu", "r1", { "y1" }, "a1");
+		model.add_conv("c2", "a1", "y2", b, spatial, "subm1", false, rng);
+		model.add_node("Add", "add", { "y2", "feat" }, "s");
+		model.add_node("Relu", "r2", { "s" }, "a2");
+		model.add_conv("c3", "a2", "y3", c, spatial, "down", false, rng);
+		model.add_conv("c4", "y3", "y4", d, down, "subm2", false, rng);
+		model.add_output("y4");
+		model.add_output("a2");
+		if (!model.save(file))
+		{
+			printf("Save %s failed\n", file.c_str());
+			return false;
+		}
+
+		auto relu = [](DenseGrid& x) {
+			for (auto& v : x.values)
+				v = std::max(0.0, v);
+		};
+		DenseGrid r1 = dense_conv(grid, a);
+		relu(r1);
+		DenseGrid r2 = dense_conv(r1, b);
+		for (size_t i = 0; i < r2.values.size(); ++i)
+			r2.values[i] += grid.values[i];
+		relu(r2);
+		DenseGrid r4 = dense_conv(dense_conv(r2, c), d);
+
+		for (bool fuse : { false, true })
+		for (int threads : { 1, 4 })
+		{
+			EngineConfig config;
+			config.dynamic_dim = input.rows;
+			config.kernel_threads = kernel_threads;
+			config.num_threads = threads;
+			config.fuse = fuse;
+			std::unique_ptr<Engine> engine(load_engine(file, config));
+			if (!engine)
+				return false;
+
+			set_sparse_input(engine.get(), input);
+			engine->forward();
+			int m4 = 0, m2 = 0;
+			double d4 = compare_with_dense(engine->output(0), r4, &m4);
+			double d2 = compare_with_dense(engine->output(1), r2, &m2);
+			bool ok = m4 == 0 && m2 == 0 && d4 <= tolerance && d2 <= tolerance;
+			passed = passed && ok;
+			printf("%s residual net, fuse %d, %d threads: %d -> %d rows, %d/%d mismatches, max diff %.3g/%.3g\n", ok ? "PASS" : "FAIL",
+				fuse, threads, input.rows, (int)engine->output(0)->shape_[0], m4, m2, d4, d2);
+		}
+	}
+
+	std::remove(file.c_str());
+	printf("SparseConvolution reference check %s\n", passed ? "passed" : "FAILED");
+	return passed;
+}
+
+// 特征为[-1, 1]之间的随机数，坐标与main中相同，沿x、y、z依次排开
+static void fill_random_inputs(Engine* engine, unsigned int seed) {
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> feature(-1.0f, 1.0f);
+	for (int i = 0; i < engine->num_inputs(); ++i)
+	{
+		auto x = engine->input(i);
+		if (x->dtype_ == DataType::Float32)
+			for (int64_t j = 0; j < x->numel(); ++j)
+				x->data<float>()[j] = feature(rng);
+		else
+			memset(x->data_, 0, x->bytes());
+	}
+	for (int i = 0; i < engine->num_inputs(); ++i)
+	{
+		auto x = engine->input(i);
+		if (x->indices_ == nullptr || x->spatial_shape_.size() != 3)
+			continue;
+
+		const auto& spatial = x->spatial_shape_;
+		int32_t* c = x->indices_->data<int32_t>();
+		int64_t rows = std::min(x->shape_[0], spatial[0] * spatial[1] * spatial[2]);
+		for (int64_t j = 0; j < rows; ++j)
+		{
+			c[j * 4 + 0] = 0;
+			c[j * 4 + 1] = (int32_t)(j / (spatial[1] * spatial[2]));
+			c[j * 4 + 2] = (int32_t)(j / spatial[2] % spatial[1]);
+			c[j * 4 + 3] = (int32_t)(j % spatial[2]);
+		}
+		x->set_rows(rows);
+		x->indices_->set_rows(rows);
+	}
+}
+
+/*
+ * 分别关闭和打开融合加载同一个模型，输入相同，比较所有输出的形状、坐标和数值，
+ * 误差都不超过tolerance * max(1, |y|)时返回true，折叠BN后的累加顺序不同，数值大的输出按相对误差判断
+ * 用于确认BatchNormalization折叠进权重、Relu/Add并入卷积尾部时的先加后截断顺序与逐层执行一致
+ */
+bool check_fusion(const std::string& onnx_file, double tolerance = 1e-4, const EngineConfig& base = EngineConfig()) {
+	EngineConfig config = base;
+	config.fuse = false;
+	std::unique_ptr<Engine> reference(load_engine(onnx_file, config));
+	config.fuse = true;
+	std::unique_ptr<Engine> fused(load_engine(onnx_file, config));
+	if (!reference || !fused)
+		return false;
+
+	fill_random_inputs(reference.get(), 7);
+	fill_random_inputs(fused.get(), 7);
+	reference->forward();
+	fused->forward();
+
+	if (reference->num_outputs() != fused->num_outputs())
+	{
+		printf("Fusion check FAILED, %d outputs vs %d\n", reference->num_outputs(), fused->num_outputs());
+		return false;
+	}
+
+	bool passed = true;
+	for (int i = 0; i < reference->num_outputs(); ++i)
+	{
+		auto a = reference->output(i);
+		auto b = fused->output(i);
+		if (a->shape_ != b->shape_)
+		{
+			printf("FAIL %s: shape %s vs %s\n", a->name_.c_str(), a->shape_string().c_str(), b->shape_string().c_str());
+			passed = false;
+			continue;
+		}
+
+		bool same_indices = (a->indices_ == nullptr) == (b->indices_ == nullptr);
+		if (same_indices && a->indices_)
+			same_indices = memcmp(a->indices_->data_, b->indices_->data_, a->shape_[0] * 4 * sizeof(int32_t)) == 0;
+
+		double max_diff = 0, max_abs = 0;
+		for (int64_t j = 0; j < a->numel(); ++j)
+		{
+			max_diff = std::max(max_diff, (double)std::fabs(a->data<float>()[j] - b->data<float>()[j]));
+			max_abs = std::max(max_abs, (double)std::fabs(a->data<float>()[j]));
+		}
+		bool ok = same_indices && max_diff <= tolerance * std::max(1.0, max_abs);
+		passed = passed && ok;
+		printf("%s %s %s: max diff %.3g (|y| <= %.3g)%s\n", ok ? "PASS" : "FAIL", a->name_.c_str(), a->shape_string().c_str(),
+			max_diff, max_abs, same_indices ? "" : ", coordinates differ");
+	}
+	printf("Fusion check %s\n", passed ? "passed" : "FAILED");
+	return passed;
+}
+
+int main() {
+
+	std::string onnx = R"(D:\LearningCodes\GithubRepo\shouxieAI\spconv-onnx\code\code\scn.onnx)";
+	//check_spconv_reference();
+	//check_fusion(onnx);
+	auto engine = load_engine(onnx);
+	if (engine == nullptr)
+		return -1;
+
+	// 特征全部为1，体素沿x、y、z依次排开
+	for (int i = 0; i < engine->num_inputs(); ++i)
+	{
+		auto x = engine->input(i);
+		if (x->dtype_ == DataType::Float32)
+			std::fill(x->data<float>(), x->data<float>() + x->numel(), 1.0f);
+		else
+			memset(x->data_, 0, x->bytes());
+	}
+	for (int i = 0; i < engine->num_inputs(); ++i)
+	{
+		auto x = engine->input(i);
+		if (x->indices_ == nullptr || x->spatial_shape_.size() != 3)
+			continue;
+
+		const auto& spatial = x->spatial_shape_;
+		int32_t* c = x->indices_->data<int32_t>();
+		int64_t rows = std::min(x->shape_[0], spatial[0] * spatial[1] * spatial[2]);
+		for (int64_t j = 0; j < rows; ++j)
+		{
+			c[j * 4 + 0] = 0;
+			c[j * 4 + 1] = (int32_t)(j / (spatial[1] * spatial[2]));
+			c[j * 4 + 2] = (int32_t)(j / spatial[2] % spatial[1]);
+			c[j * 4 + 3] = (int32_t)(j % spatial[2]);
+		}
+		x->set_rows(rows);
+		x->indices_->set_rows(rows);
+	}
+
+	unsigned int i = 0;
+	while (i < 10000)
+	{
+		++i;
+		engine->forward();
+	}
+
+	auto y = engine->output(0);
+	double sum = 0;
+	for (int64_t j = 0; j < y->numel(); ++j)
+		sum += y->data<float>()[j];
+	std::cout << "result " << y->shape_string() << " sum = " << sum << std::endl;
+	engine->print_profile();
 
+	delete engine;
 	return 0;
 }
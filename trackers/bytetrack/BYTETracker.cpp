@@ -1,6 +1,8 @@
 #include "BYTETracker.h"
 #include <fstream>
 #include <iostream>
+#include <chrono>
+#include <cstddef>
 
 using namespace std;
 
@@ -8,16 +10,87 @@ byte_kalman::Config& BYTETracker::config(){
 	return _config;
 }
 
+const TrackerStats& BYTETracker::stats() const{
+	return _stats;
+}
+
+void BYTETracker::reset_stats(){
+	_stats = TrackerStats();
+}
+
 BYTETracker::BYTETracker()
 {
 	frame_id = 0;
+	track_id_count = 0;
 }
 
 BYTETracker::~BYTETracker()
 {
 }
 
-vector<STrack> BYTETracker::update(const vector<Object>& objects)
+void BYTETracker::visit_output(const TrackVisitor& visitor)
+{
+	for (int i = 0; i < this->tracked_stracks.size(); i++)
+	{
+		if (this->tracked_stracks[i].is_activated)
+		{
+			visitor(this->tracked_stracks[i]);
+		}
+	}
+}
+
+vector<STrack> BYTETracker::predict(float dt)
+{
+	vector<STrack> output_stracks;
+	predict([&](const STrack& track){output_stracks.push_back(track);}, dt);
+	return output_stracks;
+}
+
+vector<STrack> BYTETracker::update(const vector<Object>& objects, float dt)
+{
+	vector<STrack> output_stracks;
+	DetectionSpan span(objects.data(), objects.size(), sizeof(Object), offsetof(Object, rect), offsetof(Object, rect) + 4,
+		offsetof(Object, rect) + 8, offsetof(Object, rect) + 12, offsetof(Object, prob), offsetof(Object, label), true);
+	update(span, [&](const STrack& track){output_stracks.push_back(track);}, nullptr, dt);
+	return output_stracks;
+}
+
+void BYTETracker::predict(const TrackVisitor& visitor, float dt)
+{
+	this->frame_id++;
+
+	vector<STrack*> strack_pool;
+	for (int i = 0; i < this->tracked_stracks.size(); i++)
+	{
+		if (this->tracked_stracks[i].is_activated)
+			strack_pool.push_back(&this->tracked_stracks[i]);
+	}
+	for (int i = 0; i < this->lost_stracks.size(); i++)
+	{
+		strack_pool.push_back(&this->lost_stracks[i]);
+	}
+	STrack::multi_predict(strack_pool, this->kalman_filter, dt);
+
+	// 丢失超时的轨迹与update中一样移除
+	vector<STrack> lost_stracks;
+	for (int i = 0; i < this->lost_stracks.size(); i++)
+	{
+		if (this->frame_id - this->lost_stracks[i].end_frame() > this->_config.max_time_lost)
+		{
+			this->lost_stracks[i].mark_removed();
+			this->removed_stracks.push_back(this->lost_stracks[i]);
+		}
+		else
+		{
+			lost_stracks.push_back(this->lost_stracks[i]);
+		}
+	}
+	this->lost_stracks = lost_stracks;
+
+	visit_output(visitor);
+}
+
+void BYTETracker::update(const DetectionSpan& objects, const TrackVisitor& visitor, const DetectionFilter& filter, float dt)
 {
 
 	////////////////// Step 1: Get detections //////////////////
@@ -26,42 +99,49 @@ vector<STrack> BYTETracker::update(const vector<Object>& objects)
 	vector<STrack> refind_stracks;
 	vector<STrack> removed_stracks;
 	vector<STrack> lost_stracks;
-	vector<STrack> detections;
-	vector<STrack> detections_low;
+	vector<DetectionBox>& detections = this->detections_high;
+	vector<DetectionBox>& detections_low = this->detections_low;
+	vector<DetectionBox>& detections_cp = this->detections_rest;
+	detections.clear();
+	detections_low.clear();
+	detections_cp.clear();
 
-	vector<STrack> detections_cp;
 	vector<STrack> tracked_stracks_swap;
 	vector<STrack> resa, resb;
-	vector<STrack> output_stracks;
 
 	vector<STrack*> unconfirmed;
 	vector<STrack*> tracked_stracks;
 	vector<STrack*> strack_pool;
 	vector<STrack*> r_tracked_stracks;
 
-	if (objects.size() > 0)
+	for (int i = 0; i < objects.count; i++)
 	{
-		for (int i = 0; i < objects.size(); i++)
+		if (filter && !filter(i))
+			continue;
+
+		DetectionBox det;
+		det.tlbr[0] = objects.field<float>(i, objects.left);
+		det.tlbr[1] = objects.field<float>(i, objects.top);
+		det.tlbr[2] = objects.field<float>(i, objects.right);
+		det.tlbr[3] = objects.field<float>(i, objects.bottom);
+		if (objects.tlwh)
+		{
+			det.tlbr[2] += det.tlbr[0];
+			det.tlbr[3] += det.tlbr[1];
+		}
+		det.tlwh[0] = det.tlbr[0];
+		det.tlwh[1] = det.tlbr[1];
+		det.tlwh[2] = det.tlbr[2] - det.tlbr[0];
+		det.tlwh[3] = det.tlbr[3] - det.tlbr[1];
+		det.score = objects.score_of(i);
+
+		if (det.score >= _config.track_thresh)
+		{
+			detections.push_back(det);
+		}
+		else
 		{
-			vector<float> tlbr_;
-			tlbr_.resize(4);
-			tlbr_[0] = objects[i].rect[0];
-			tlbr_[1] = objects[i].rect[1];
-			tlbr_[2] = objects[i].rect[0] + objects[i].rect[2];
-			tlbr_[3] = objects[i].rect[1] + objects[i].rect[3];
-
-			float score = objects[i].prob;
-
-			STrack strack(STrack::tlbr_to_tlwh(tlbr_), score);
-			if (score >= _config.track_thresh)
-			{
-				detections.push_back(strack);
-			}
-			else
-			{
-				detections_low.push_back(strack);
-			}
-			
+			detections_low.push_back(det);
 		}
 	}
 
@@ -76,7 +156,15 @@ vector<STrack> BYTETracker::update(const vector<Object>& objects)
 
 	////////////////// Step 2: First association, with IoU //////////////////
 	strack_pool = joint_stracks(tracked_stracks, this->lost_stracks);
-	STrack::multi_predict(strack_pool, this->kalman_filter);
+	STrack::multi_predict(strack_pool, this->kalman_filter, dt);
+
+	this->_stats.frames++;
+	if (this->degraded)
+		this->_stats.degraded_frames++;
+
+	chrono::steady_clock::time_point association_tick;
+	if (this->_config.association_budget_ms > 0)
+		association_tick = chrono::steady_clock::now();
 
 	vector<vector<float> > dists;
 	int dist_size = 0, dist_size_size = 0;
@@ -89,15 +177,15 @@ vector<STrack> BYTETracker::update(const vector<Object>& objects)
 	for (int i = 0; i < matches.size(); i++)
 	{
 		STrack *track = strack_pool[matches[i][0]];
-		STrack *det = &detections[matches[i][1]];
+		DetectionBox *det = &detections[matches[i][1]];
 		if (track->state == TrackState::Tracked)
 		{
-			track->update(*det, this->frame_id);
+			track->update(det->tlwh, det->score, this->frame_id);
 			activated_stracks.push_back(*track);
 		}
 		else
 		{
-			track->re_activate(*det, this->frame_id, false);
+			track->re_activate(det->tlwh, det->score, this->frame_id);
 			refind_stracks.push_back(*track);
 		}
 	}
@@ -107,9 +195,7 @@ vector<STrack> BYTETracker::update(const vector<Object>& objects)
 	{
 		detections_cp.push_back(detections[u_detection[i]]);
 	}
-	detections.clear();
-	detections.assign(detections_low.begin(), detections_low.end());
-	
+
 	for (int i = 0; i < u_track.size(); i++)
 	{
 		if (strack_pool[u_track[i]]->state == TrackState::Tracked)
@@ -119,7 +205,7 @@ vector<STrack> BYTETracker::update(const vector<Object>& objects)
 	}
 
 	dists.clear();
-	dists = iou_distance(r_tracked_stracks, detections, dist_size, dist_size_size);
+	dists = iou_distance(r_tracked_stracks, detections_low, dist_size, dist_size_size);
 
 	matches.clear();
 	u_track.clear();
@@ -129,15 +215,15 @@ vector<STrack> BYTETracker::update(const vector<Object>& objects)
 	for (int i = 0; i < matches.size(); i++)
 	{
 		STrack *track = r_tracked_stracks[matches[i][0]];
-		STrack *det = &detections[matches[i][1]];
+		DetectionBox *det = &detections_low[matches[i][1]];
 		if (track->state == TrackState::Tracked)
 		{
-			track->update(*det, this->frame_id);
+			track->update(det->tlwh, det->score, this->frame_id);
 			activated_stracks.push_back(*track);
 		}
 		else
 		{
-			track->re_activate(*det, this->frame_id, false);
+			track->re_activate(det->tlwh, det->score, this->frame_id);
 			refind_stracks.push_back(*track);
 		}
 	}
@@ -153,11 +239,8 @@ vector<STrack> BYTETracker::update(const vector<Object>& objects)
 	}
 
 	// Deal with unconfirmed tracks, usually tracks with only one beginning frame
-	detections.clear();
-	detections.assign(detections_cp.begin(), detections_cp.end());
-
 	dists.clear();
-	dists = iou_distance(unconfirmed, detections, dist_size, dist_size_size);
+	dists = iou_distance(unconfirmed, detections_cp, dist_size, dist_size_size);
 
 	matches.clear();
 	vector<int> u_unconfirmed;
@@ -166,7 +249,8 @@ vector<STrack> BYTETracker::update(const vector<Object>& objects)
 
 	for (int i = 0; i < matches.size(); i++)
 	{
-		unconfirmed[matches[i][0]]->update(detections[matches[i][1]], this->frame_id);
+		DetectionBox *det = &detections_cp[matches[i][1]];
+		unconfirmed[matches[i][0]]->update(det->tlwh, det->score, this->frame_id);
 		activated_stracks.push_back(*unconfirmed[matches[i][0]]);
 	}
 
@@ -177,14 +261,21 @@ vector<STrack> BYTETracker::update(const vector<Object>& objects)
 		removed_stracks.push_back(*track);
 	}
 
+	if (this->_config.association_budget_ms > 0)
+	{
+		double elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - association_tick).count();
+		update_association_mode(elapsed, (strack_pool.size() + unconfirmed.size()) * (detections.size() + detections_low.size()));
+	}
+
 	////////////////// Step 4: Init new stracks //////////////////
 	for (int i = 0; i < u_detection.size(); i++)
 	{
-		STrack *track = &detections[u_detection[i]];
-		if (track->score < this->_config.high_thresh)
+		DetectionBox *det = &detections_cp[u_detection[i]];
+		if (det->score < this->_config.high_thresh)
 			continue;
-		track->activate(this->kalman_filter, this->frame_id);
-		activated_stracks.push_back(*track);
+		STrack track(vector<float>(det->tlwh, det->tlwh + 4), det->score);
+		track.activate(this->kalman_filter, this->frame_id, ++this->track_id_count);
+		activated_stracks.push_back(track);
 	}
 
 	////////////////// Step 5: Update state //////////////////
@@ -230,13 +321,6 @@ vector<STrack> BYTETracker::update(const vector<Object>& objects)
 	this->tracked_stracks.assign(resa.begin(), resa.end());
 	this->lost_stracks.clear();
 	this->lost_stracks.assign(resb.begin(), resb.end());
-	
-	for (int i = 0; i < this->tracked_stracks.size(); i++)
-	{
-		if (this->tracked_stracks[i].is_activated)
-		{
-			output_stracks.push_back(this->tracked_stracks[i]);
-		}
-	}
-	return output_stracks;
+
+	visit_output(visitor);
 }
\ No newline at end of file
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "STrack.h"
+#include <functional>
+#include <cstring>
 
 struct Object
 {
@@ -10,17 +12,81 @@ struct Object
     float prob;
 };
 
+// 外部检测框数组的带步长视图，各字段为相对元素起始地址的字节偏移，update直接从中读取
+struct DetectionSpan
+{
+	const char* data = nullptr;
+	int count = 0;
+	int stride = 0;				// 相邻两个元素之间的字节数
+	int left = 0, top = 4, right = 8, bottom = 12;
+	int score = -1;				// float，-1时所有框的score为1
+	int label = -1;				// int，-1时所有框的label为0
+	bool tlwh = false;			// right、bottom偏移处保存的是width、height
+
+	DetectionSpan() = default;
+	DetectionSpan(const void* data, int count, int stride, int left, int top, int right, int bottom, int score = -1, int label = -1, bool tlwh = false)
+		:data((const char*)data), count(count), stride(stride), left(left), top(top), right(right), bottom(bottom), score(score), label(label), tlwh(tlwh){}
+
+	template<typename _T>
+	_T field(int i, int offset) const
+	{
+		_T value;
+		memcpy(&value, data + (size_t)i * stride + offset, sizeof(value));
+		return value;
+	}
+
+	float score_of(int i) const {return score < 0 ? 1.0f : field<float>(i, score);}
+	int label_of(int i) const {return label < 0 ? 0 : field<int>(i, label);}
+};
+
+// 返回false的框不参与跟踪
+typedef function<bool(int index)> DetectionFilter;
+
+// 依次访问本帧输出的轨迹，引用只在回调内有效
+typedef function<void(const STrack& track)> TrackVisitor;
+
+struct TrackerStats
+{
+	uint64_t frames = 0;
+	uint64_t degraded_frames = 0;	// 超出association_budget_ms后以贪心IoU匹配完成关联的帧
+	double association_ms = 0;		// 关联耗时之和，只在设置了association_budget_ms时统计
+	uint64_t gated_pairs = 0;		// 有交集但被马氏距离门限屏蔽的轨迹-检测框对，只在开启gating时统计
+};
+
 class BYTETracker
 {
 public:
 	BYTETracker();
 	~BYTETracker();
 
-	vector<STrack> update(const vector<Object>& objects);
+	// 轨迹引用tracker内的kalman_filter，拷贝后会指向原tracker，因此禁止拷贝
+	BYTETracker(const BYTETracker&) = delete;
+	BYTETracker& operator=(const BYTETracker&) = delete;
+
+	// dt为距离上一次update/predict的时间，以帧为单位
+	vector<STrack> update(const vector<Object>& objects, float dt = 1);
+
+	// 直接读取调用方的检测框数组，输出通过visitor访问，输入输出都不做拷贝
+	void update(const DetectionSpan& detections, const TrackVisitor& visitor, const DetectionFilter& filter = nullptr, float dt = 1);
+
+	// 没有检测结果的帧(检测器跳帧)只做预测，轨迹沿运动模型外推，不会被标记为丢失
+	vector<STrack> predict(float dt = 1);
+	void predict(const TrackVisitor& visitor, float dt = 1);
 	tuple<uint8_t, uint8_t, uint8_t> get_color(int idx);
 	byte_kalman::Config& config();
+	const TrackerStats& stats() const;
+	void reset_stats();
 
 private:
+	// 关联过程中的检测框，只有成为新轨迹的框才构造STrack
+	struct DetectionBox
+	{
+		float tlwh[4];
+		float tlbr[4];
+		float score;
+	};
+
+	void visit_output(const TrackVisitor& visitor);
 	vector<STrack*> joint_stracks(vector<STrack*> &tlista, vector<STrack> &tlistb);
 	vector<STrack> joint_stracks(vector<STrack> &tlista, vector<STrack> &tlistb);
 
@@ -29,7 +95,11 @@ private:
 
 	void linear_assignment(vector<vector<float> > &cost_matrix, int cost_matrix_size, int cost_matrix_size_size, float thresh,
 		vector<vector<int> > &matches, vector<int> &unmatched_a, vector<int> &unmatched_b);
-	vector<vector<float> > iou_distance(vector<STrack*> &atracks, vector<STrack> &btracks, int &dist_size, int &dist_size_size);
+	void greedy_assignment(vector<vector<float> > &cost_matrix, float thresh,
+		vector<vector<int> > &matches, vector<int> &unmatched_a, vector<int> &unmatched_b);
+	void update_association_mode(double elapsed_ms, size_t load);
+	vector<vector<float> > iou_distance(vector<STrack*> &atracks, vector<DetectionBox> &btracks, int &dist_size, int &dist_size_size);
+	void gate_cost_matrix(vector<vector<float> > &cost_matrix, vector<STrack*> &atracks, vector<DetectionBox> &btracks);
 	vector<vector<float> > iou_distance(vector<STrack> &atracks, vector<STrack> &btracks);
 	vector<vector<float> > ious(vector<vector<float> > &atlbrs, vector<vector<float> > &btlbrs);
 
@@ -38,10 +108,28 @@ private:
 
 private:
 	int frame_id;
+	int track_id_count;
+	bool degraded = false;
+	size_t degraded_load = 0;
+	int degraded_updates = 0;
+	TrackerStats _stats;
 
 	vector<STrack> tracked_stracks;
 	vector<STrack> lost_stracks;
 	vector<STrack> removed_stracks;
+
+	// 每帧复用的检测框数组
+	vector<DetectionBox> detections_high;
+	vector<DetectionBox> detections_low;
+	vector<DetectionBox> detections_rest;
+
+	// 每帧复用的门限计算数组
+	vector<const KAL_MEAN*> gating_means;
+	vector<const KAL_COVA*> gating_covariances;
+	vector<DETECTBOX> gating_measurements;
+	vector<float> gating_distances;
+
+	// 所有轨迹共享的运动模型
 	byte_kalman::KalmanFilter kalman_filter;
 	byte_kalman::Config& _config = kalman_filter.config();
 };
\ No newline at end of file
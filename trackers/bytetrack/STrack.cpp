@@ -24,10 +24,10 @@ STrack::~STrack()
 {
 }
 
-void STrack::activate(byte_kalman::KalmanFilter &kalman_filter, int frame_id)
+void STrack::activate(const byte_kalman::KalmanFilter &kalman_filter, int frame_id, int track_id)
 {
-	this->kalman_filter = kalman_filter;
-	this->track_id = this->next_id();
+	this->kalman_filter = &kalman_filter;
+	this->track_id = track_id;
 
 	vector<float> _tlwh_tmp(4);
 	_tlwh_tmp[0] = this->_tlwh[0];
@@ -40,7 +40,7 @@ void STrack::activate(byte_kalman::KalmanFilter &kalman_filter, int frame_id)
 	xyah_box[1] = xyah[1];
 	xyah_box[2] = xyah[2];
 	xyah_box[3] = xyah[3];
-	auto mc = this->kalman_filter.initiate(xyah_box);
+	auto mc = this->kalman_filter->initiate(xyah_box);
 	this->mean = mc.first;
 	this->covariance = mc.second;
 
@@ -58,15 +58,29 @@ void STrack::activate(byte_kalman::KalmanFilter &kalman_filter, int frame_id)
 	this->start_frame = frame_id;
 }
 
-void STrack::re_activate(STrack &new_track, int frame_id, bool new_id)
+void STrack::re_activate(STrack &new_track, int frame_id, int new_id)
+{
+	re_activate(new_track.tlwh.data(), new_track.score, frame_id, new_id);
+}
+
+void STrack::update(STrack &new_track, int frame_id)
+{
+	update(new_track.tlwh.data(), new_track.score, frame_id);
+}
+
+static DETECTBOX tlwh_to_xyah_box(const float* tlwh)
 {
-	vector<float> xyah = tlwh_to_xyah(new_track.tlwh);
 	DETECTBOX xyah_box;
-	xyah_box[0] = xyah[0];
-	xyah_box[1] = xyah[1];
-	xyah_box[2] = xyah[2];
-	xyah_box[3] = xyah[3];
-	auto mc = this->kalman_filter.update(this->mean, this->covariance, xyah_box);
+	xyah_box[0] = tlwh[0] + tlwh[2] / 2;
+	xyah_box[1] = tlwh[1] + tlwh[3] / 2;
+	xyah_box[2] = tlwh[2] / tlwh[3];
+	xyah_box[3] = tlwh[3];
+	return xyah_box;
+}
+
+void STrack::re_activate(const float* tlwh, float score, int frame_id, int new_id)
+{
+	auto mc = this->kalman_filter->update(this->mean, this->covariance, tlwh_to_xyah_box(tlwh));
 	this->mean = mc.first;
 	this->covariance = mc.second;
 
@@ -77,24 +91,17 @@ void STrack::re_activate(STrack &new_track, int frame_id, bool new_id)
 	this->state = TrackState::Tracked;
 	this->is_activated = true;
 	this->frame_id = frame_id;
-	this->score = new_track.score;
-	if (new_id)
-		this->track_id = next_id();
+	this->score = score;
+	if (new_id > 0)
+		this->track_id = new_id;
 }
 
-void STrack::update(STrack &new_track, int frame_id)
+void STrack::update(const float* tlwh, float score, int frame_id)
 {
 	this->frame_id = frame_id;
 	this->tracklet_len++;
 
-	vector<float> xyah = tlwh_to_xyah(new_track.tlwh);
-	DETECTBOX xyah_box;
-	xyah_box[0] = xyah[0];
-	xyah_box[1] = xyah[1];
-	xyah_box[2] = xyah[2];
-	xyah_box[3] = xyah[3];
-
-	auto mc = this->kalman_filter.update(this->mean, this->covariance, xyah_box);
+	auto mc = this->kalman_filter->update(this->mean, this->covariance, tlwh_to_xyah_box(tlwh));
 	this->mean = mc.first;
 	this->covariance = mc.second;
 
@@ -104,7 +111,7 @@ void STrack::update(STrack &new_track, int frame_id)
 	this->state = TrackState::Tracked;
 	this->is_activated = true;
 
-	this->score = new_track.score;
+	this->score = score;
 }
 
 void STrack::static_tlwh()
@@ -167,19 +174,12 @@ void STrack::mark_removed()
 	state = TrackState::Removed;
 }
 
-int STrack::next_id()
-{
-	static int _count = 0;
-	_count++;
-	return _count;
-}
-
 int STrack::end_frame()
 {
 	return this->frame_id;
 }
 
-void STrack::multi_predict(vector<STrack*> &stracks, byte_kalman::KalmanFilter &kalman_filter)
+void STrack::multi_predict(vector<STrack*> &stracks, const byte_kalman::KalmanFilter &kalman_filter, float dt)
 {
 	for (int i = 0; i < stracks.size(); i++)
 	{
@@ -187,7 +187,7 @@ void STrack::multi_predict(vector<STrack*> &stracks, byte_kalman::KalmanFilter &
 		{
 			stracks[i]->mean[7] = 0;
 		}
-		kalman_filter.predict(stracks[i]->mean, stracks[i]->covariance);
+		kalman_filter.predict(stracks[i]->mean, stracks[i]->covariance, dt);
 		stracks[i]->static_tlwh();
 		stracks[i]->static_tlbr();
 	}
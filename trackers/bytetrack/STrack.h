@@ -13,20 +13,25 @@ public:
 	~STrack();
 
 	vector<float> static tlbr_to_tlwh(vector<float> &tlbr);
-	void static multi_predict(vector<STrack*> &stracks, byte_kalman::KalmanFilter &kalman_filter);
+	void static multi_predict(vector<STrack*> &stracks, const byte_kalman::KalmanFilter &kalman_filter, float dt = 1);
 	void static_tlwh();
 	void static_tlbr();
 	vector<float> tlwh_to_xyah(vector<float> tlwh_tmp);
 	vector<float> to_xyah();
 	void mark_lost();
 	void mark_removed();
-	int next_id();
 	int end_frame();
 	
-	void activate(byte_kalman::KalmanFilter &kalman_filter, int frame_id);
-	void re_activate(STrack &new_track, int frame_id, bool new_id = false);
+	// id由所属的BYTETracker分配，多个tracker可以在不同线程中同时运行
+	// kalman_filter归所属的BYTETracker所有，轨迹只引用它，生命周期不能超过该tracker
+	void activate(const byte_kalman::KalmanFilter &kalman_filter, int frame_id, int track_id);
+	void re_activate(STrack &new_track, int frame_id, int new_id = 0);
 	void update(STrack &new_track, int frame_id);
 
+	// 直接以检测框的tlwh更新，不需要为检测框构造STrack
+	void re_activate(const float* tlwh, float score, int frame_id, int new_id = 0);
+	void update(const float* tlwh, float score, int frame_id);
+
 public:
 	bool is_activated;
 	int track_id;
@@ -44,5 +49,5 @@ public:
 	float score;
 
 private:
-	byte_kalman::KalmanFilter kalman_filter;
+	const byte_kalman::KalmanFilter* kalman_filter = nullptr;
 };
\ No newline at end of file
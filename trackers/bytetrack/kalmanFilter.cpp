@@ -99,7 +99,11 @@ namespace byte_kalman
 		return this->_config;
 	}
 
-	KAL_DATA KalmanFilter::initiate(const DETECTBOX &measurement)
+	const Config& KalmanFilter::config() const{
+		return this->_config;
+	}
+
+	KAL_DATA KalmanFilter::initiate(const DETECTBOX &measurement) const
 	{
 		DETECTBOX mean_pos = measurement;
 		DETECTBOX mean_vel;
@@ -126,7 +130,7 @@ namespace byte_kalman
 		return std::make_pair(mean, var);
 	}
 
-	void KalmanFilter::predict(KAL_MEAN &mean, KAL_COVA &covariance)
+	void KalmanFilter::predict(KAL_MEAN &mean, KAL_COVA &covariance, float dt) const
 	{
 		//revise the data;
 		DETECTBOX std_pos;
@@ -145,17 +149,24 @@ namespace byte_kalman
 		KAL_MEAN tmp;
 		tmp.block<1, 4>(0, 0) = std_pos;
 		tmp.block<1, 4>(0, 4) = std_vel;
-		tmp = tmp.array().square();
+		tmp = tmp.array().square() * dt;
 		KAL_COVA motion_cov = tmp.asDiagonal();
-		KAL_MEAN mean1 = this->_motion_mat * mean.transpose();
-		KAL_COVA covariance1 = this->_motion_mat * covariance *(_motion_mat.transpose());
+
+		// 跳过的帧数不固定时，位置按 位置 + dt * 速度 外推
+		Eigen::Matrix<float, 8, 8, Eigen::RowMajor> motion_mat = this->_motion_mat;
+		if (dt != 1) {
+			for (int i = 0; i < 4; i++)
+				motion_mat(i, 4 + i) = dt;
+		}
+		KAL_MEAN mean1 = motion_mat * mean.transpose();
+		KAL_COVA covariance1 = motion_mat * covariance *(motion_mat.transpose());
 		covariance1 += motion_cov;
 
 		mean = mean1;
 		covariance = covariance1;
 	}
 
-	KAL_HDATA KalmanFilter::project(const KAL_MEAN &mean, const KAL_COVA &covariance)
+	KAL_HDATA KalmanFilter::project(const KAL_MEAN &mean, const KAL_COVA &covariance) const
 	{
 		DETECTBOX std;
 		std << _config.noise[0] * mean(3), _config.noise[1] * mean(3),
@@ -173,7 +184,7 @@ namespace byte_kalman
 		KalmanFilter::update(
 			const KAL_MEAN &mean,
 			const KAL_COVA &covariance,
-			const DETECTBOX &measurement)
+			const DETECTBOX &measurement) const
 	{
 		KAL_HDATA pa = project(mean, covariance);
 		KAL_HMEAN projected_mean = pa.first;
@@ -199,26 +210,54 @@ namespace byte_kalman
 			const KAL_MEAN &mean,
 			const KAL_COVA &covariance,
 			const std::vector<DETECTBOX> &measurements,
-			bool only_position)
+			bool only_position) const
 	{
-		KAL_HDATA pa = this->project(mean, covariance);
-		if (only_position) {
-			printf("not implement!");
-			exit(0);
-		}
-		KAL_HMEAN mean1 = pa.first;
-		KAL_HCOVA covariance1 = pa.second;
-
-		//    Eigen::Matrix<float, -1, 4, Eigen::RowMajor> d(size, 4);
-		DETECTBOXSS d(measurements.size(), 4);
-		int pos = 0;
-		for (DETECTBOX box : measurements) {
-			d.row(pos++) = box - mean1;
-		}
-		Eigen::Matrix<float, -1, -1, Eigen::RowMajor> factor = covariance1.llt().matrixL();
-		Eigen::Matrix<float, -1, -1> z = factor.triangularView<Eigen::Lower>().solve<Eigen::OnTheRight>(d).transpose();
-		auto zz = ((z.array())*(z.array())).matrix();
-		auto square_maha = zz.colwise().sum();
+		Eigen::Matrix<float, 1, -1> square_maha(1, measurements.size());
+		const KAL_MEAN* means[] = {&mean};
+		const KAL_COVA* covariances[] = {&covariance};
+		gating_distance(means, covariances, 1, measurements.data(), measurements.size(), square_maha.data(), only_position);
 		return square_maha;
 	}
+
+	void KalmanFilter::gating_distance(
+		const KAL_MEAN* const* means,
+		const KAL_COVA* const* covariances,
+		int num_tracks,
+		const DETECTBOX* measurements,
+		int num_measurements,
+		float* distances,
+		bool only_position) const
+	{
+		for (int i = 0; i < num_tracks; i++)
+		{
+			KAL_HDATA pa = this->project(*means[i], *covariances[i]);
+			const KAL_HMEAN& projected_mean = pa.first;
+			float* output = distances + (size_t)i * num_measurements;
+
+			// d^T * S^-1 * d = |L^-1 * d|^2，S = L * L^T，L^-1每条轨迹只求一次
+			if (only_position)
+			{
+				Eigen::Matrix2f inv_factor = pa.second.topLeftCorner<2, 2>().llt().matrixL().solve(Eigen::Matrix2f::Identity());
+				for (int j = 0; j < num_measurements; j++)
+				{
+					Eigen::Vector2f d(measurements[j](0) - projected_mean(0), measurements[j](1) - projected_mean(1));
+					output[j] = (inv_factor * d).squaredNorm();
+				}
+			}
+			else
+			{
+				Eigen::Matrix4f inv_factor = pa.second.llt().matrixL().solve(Eigen::Matrix4f::Identity());
+				for (int j = 0; j < num_measurements; j++)
+				{
+					Eigen::Vector4f d = (measurements[j] - projected_mean).transpose();
+					output[j] = (inv_factor * d).squaredNorm();
+				}
+			}
+		}
+	}
+
+	float KalmanFilter::gating_threshold(bool only_position) const
+	{
+		return chi2inv95[only_position ? 2 : 4];
+	}
 }
\ No newline at end of file
@@ -20,6 +20,18 @@ namespace byte_kalman
 		float match_thresh = 0.8;
 		int max_time_lost = 30;
 
+		// 关联耗时预算，毫秒，0为不限制。超过预算后改用贪心IoU匹配代替lapjv，
+		// 轨迹数x检测框数回落到触发时的association_recover_ratio以下时立即恢复，
+		// 否则每association_probe_interval帧试用一次lapjv，耗时在预算内就恢复
+		float association_budget_ms = 0;
+		float association_recover_ratio = 0.7;
+		int association_probe_interval = 30;
+
+		// 马氏距离门限，开启后关联前先屏蔽运动模型上不可能的轨迹-检测框对，门限为卡方分布的95%分位数
+		// gating_only_position时只用中心点x、y两维，不受宽高比和高度的测量噪声影响
+		bool gating = false;
+		bool gating_only_position = false;
+
 		Config& set_initiate_state(const std::vector<float>& values);
 		Config& set_per_frame_motion(const std::vector<float>& values);
 		Config& set_noise(const std::vector<float>& values);
@@ -27,6 +39,8 @@ namespace byte_kalman
 		Config& set_high_thresh(float value){this->high_thresh = value; return *this;};
 		Config& set_match_thresh(float value){this->match_thresh = value; return *this;};
 		Config& set_max_time_lost(int value){this->max_time_lost = value; return *this;};
+		Config& set_association_budget(float ms, float recover_ratio = 0.7, int probe_interval = 30){this->association_budget_ms = ms; this->association_recover_ratio = recover_ratio; this->association_probe_interval = probe_interval; return *this;};
+		Config& set_gating(bool enable, bool only_position = false){this->gating = enable; this->gating_only_position = only_position; return *this;};
 
 		Config();
 	};
@@ -38,18 +52,35 @@ namespace byte_kalman
 		KalmanFilter();
 
 		Config& config();
-		KAL_DATA initiate(const DETECTBOX& measurement);
-		void predict(KAL_MEAN& mean, KAL_COVA& covariance);
-		KAL_HDATA project(const KAL_MEAN& mean, const KAL_COVA& covariance);
+		const Config& config() const;
+
+		// 以下接口不修改滤波器本身，所有轨迹共享同一个实例，轨迹只保存各自的mean和covariance
+		KAL_DATA initiate(const DETECTBOX& measurement) const;
+		// dt为距离上一次预测的时间，以帧为单位，可以是小数。运动噪声按dt线性放大
+		void predict(KAL_MEAN& mean, KAL_COVA& covariance, float dt = 1) const;
+		KAL_HDATA project(const KAL_MEAN& mean, const KAL_COVA& covariance) const;
 		KAL_DATA update(const KAL_MEAN& mean,
 			const KAL_COVA& covariance,
-			const DETECTBOX& measurement);
+			const DETECTBOX& measurement) const;
 
 		Eigen::Matrix<float, 1, -1> gating_distance(
 			const KAL_MEAN& mean,
 			const KAL_COVA& covariance,
 			const std::vector<DETECTBOX>& measurements,
-			bool only_position = false);
+			bool only_position = false) const;
+
+		// 批量计算num_tracks条轨迹对num_measurements个测量的马氏距离平方，写入distances[i * num_measurements + j]
+		// 每条轨迹只做一次投影和Cholesky分解，全部为固定尺寸的矩阵运算
+		void gating_distance(
+			const KAL_MEAN* const* means,
+			const KAL_COVA* const* covariances,
+			int num_tracks,
+			const DETECTBOX* measurements,
+			int num_measurements,
+			float* distances,
+			bool only_position = false) const;
+
+		float gating_threshold(bool only_position = false) const;
 
 	private:
 		Config _config;
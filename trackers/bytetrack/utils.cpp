@@ -1,6 +1,7 @@
 #include "BYTETracker.h"
 #include "lapjv.h"
 #include <map>
+#include <algorithm>
 #include <iostream>
 
 using namespace std;
@@ -134,9 +135,75 @@ void BYTETracker::linear_assignment(vector<vector<float> > &cost_matrix, int cos
 		return;
 	}
 
-	vector<int> rowsol; vector<int> colsol;
-	float c = lapjv(cost_matrix, rowsol, colsol, true, thresh);
-	for (int i = 0; i < rowsol.size(); i++)
+	if (this->degraded)
+	{
+		greedy_assignment(cost_matrix, thresh, matches, unmatched_a, unmatched_b);
+		return;
+	}
+
+	// 没有任何代价低于thresh的行和列一定不会被匹配，去掉后再求解，门限屏蔽的对越多矩阵越小
+	int rows = cost_matrix.size();
+	int cols = cost_matrix[0].size();
+	vector<int> row_index, col_index;
+	vector<char> col_feasible(cols, 0);
+	for (int i = 0; i < rows; i++)
+	{
+		bool feasible = false;
+		for (int j = 0; j < cols; j++)
+		{
+			if (cost_matrix[i][j] < thresh)
+			{
+				feasible = true;
+				col_feasible[j] = 1;
+			}
+		}
+		if (feasible)
+			row_index.push_back(i);
+	}
+	for (int j = 0; j < cols; j++)
+	{
+		if (col_feasible[j])
+			col_index.push_back(j);
+	}
+
+	vector<int> rowsol(rows, -1), colsol(cols, -1);
+	if (!row_index.empty())
+	{
+		vector<vector<float> > compact_cost;
+		const vector<vector<float> >* cost = &cost_matrix;
+		if (row_index.size() < rows || col_index.size() < cols)
+		{
+			compact_cost.resize(row_index.size(), vector<float>(col_index.size()));
+			for (int i = 0; i < row_index.size(); i++)
+			{
+				for (int j = 0; j < col_index.size(); j++)
+				{
+					compact_cost[i][j] = cost_matrix[row_index[i]][col_index[j]];
+				}
+			}
+			cost = &compact_cost;
+		}
+		else
+		{
+			row_index.clear();
+			col_index.clear();
+		}
+
+		vector<int> compact_rowsol, compact_colsol;
+		lapjv(*cost, compact_rowsol, compact_colsol, true, thresh);
+		for (int i = 0; i < compact_rowsol.size(); i++)
+		{
+			if (compact_rowsol[i] < 0)
+				continue;
+
+			int row = row_index.empty() ? i : row_index[i];
+			int col = col_index.empty() ? compact_rowsol[i] : col_index[compact_rowsol[i]];
+			rowsol[row] = col;
+			colsol[col] = row;
+		}
+	}
+
+	for (int i = 0; i < rows; i++)
 	{
 		if (rowsol[i] >= 0)
 		{
@@ -151,7 +218,7 @@ void BYTETracker::linear_assignment(vector<vector<float> > &cost_matrix, int cos
 		}
 	}
 
-	for (int i = 0; i < colsol.size(); i++)
+	for (int i = 0; i < cols; i++)
 	{
 		if (colsol[i] < 0)
 		{
@@ -160,6 +227,72 @@ void BYTETracker::linear_assignment(vector<vector<float> > &cost_matrix, int cos
 	}
 }
 
+/* 按IoU距离从小到大依次接受行列都未被占用的对，代价是O(nm log nm)，不保证全局最优 */
+void BYTETracker::greedy_assignment(vector<vector<float> > &cost_matrix, float thresh,
+	vector<vector<int> > &matches, vector<int> &unmatched_a, vector<int> &unmatched_b)
+{
+	int rows = cost_matrix.size();
+	int cols = cost_matrix[0].size();
+	vector<pair<float, int> > pairs;
+	for (int i = 0; i < rows; i++)
+	{
+		for (int j = 0; j < cols; j++)
+		{
+			if (cost_matrix[i][j] < thresh)
+				pairs.push_back(make_pair(cost_matrix[i][j], i * cols + j));
+		}
+	}
+	sort(pairs.begin(), pairs.end());
+
+	vector<int> rowsol(rows, -1), colsol(cols, -1);
+	for (int i = 0; i < pairs.size(); i++)
+	{
+		int row = pairs[i].second / cols;
+		int col = pairs[i].second % cols;
+		if (rowsol[row] >= 0 || colsol[col] >= 0)
+			continue;
+
+		rowsol[row] = col;
+		colsol[col] = row;
+		vector<int> match;
+		match.push_back(row);
+		match.push_back(col);
+		matches.push_back(match);
+	}
+
+	for (int i = 0; i < rows; i++)
+	{
+		if (rowsol[i] < 0)
+			unmatched_a.push_back(i);
+	}
+	for (int i = 0; i < cols; i++)
+	{
+		if (colsol[i] < 0)
+			unmatched_b.push_back(i);
+	}
+}
+
+/* 超出预算时切换到贪心匹配并记录当时的负载，负载回落到记录值的recover_ratio以下后恢复lapjv
+   降级期间每probe_interval帧让下一帧试用lapjv，试用的耗时仍然超出预算才重新降级 */
+void BYTETracker::update_association_mode(double elapsed_ms, size_t load)
+{
+	this->_stats.association_ms += elapsed_ms;
+	if (!this->degraded)
+	{
+		if (elapsed_ms > this->_config.association_budget_ms)
+		{
+			this->degraded = true;
+			this->degraded_load = load;
+			this->degraded_updates = 0;
+		}
+	}
+	else if (load < this->degraded_load * this->_config.association_recover_ratio ||
+		(this->_config.association_probe_interval > 0 && ++this->degraded_updates >= this->_config.association_probe_interval))
+	{
+		this->degraded = false;
+	}
+}
+
 vector<vector<float> > BYTETracker::ious(vector<vector<float> > &atlbrs, vector<vector<float> > &btlbrs)
 {
 	vector<vector<float> > ious;
@@ -203,7 +336,7 @@ vector<vector<float> > BYTETracker::ious(vector<vector<float> > &atlbrs, vector<
 	return ious;
 }
 
-vector<vector<float> > BYTETracker::iou_distance(vector<STrack*> &atracks, vector<STrack> &btracks, int &dist_size, int &dist_size_size)
+vector<vector<float> > BYTETracker::iou_distance(vector<STrack*> &atracks, vector<DetectionBox> &btracks, int &dist_size, int &dist_size_size)
 {
 	vector<vector<float> > cost_matrix;
 	if (atracks.size() * btracks.size() == 0)
@@ -219,7 +352,7 @@ vector<vector<float> > BYTETracker::iou_distance(vector<STrack*> &atracks, vecto
 	}
 	for (int i = 0; i < btracks.size(); i++)
 	{
-		btlbrs.push_back(btracks[i].tlbr);
+		btlbrs.push_back(vector<float>(btracks[i].tlbr, btracks[i].tlbr + 4));
 	}
 
 	dist_size = atracks.size();
@@ -237,9 +370,56 @@ vector<vector<float> > BYTETracker::iou_distance(vector<STrack*> &atracks, vecto
 		cost_matrix.push_back(_iou);
 	}
 
+	if (this->_config.gating)
+		gate_cost_matrix(cost_matrix, atracks, btracks);
+
 	return cost_matrix;
 }
 
+/* 马氏距离超过门限的对代价置为1，与没有交集的框相同，linear_assignment中不会被匹配 */
+void BYTETracker::gate_cost_matrix(vector<vector<float> > &cost_matrix, vector<STrack*> &atracks, vector<DetectionBox> &btracks)
+{
+	int num_tracks = atracks.size();
+	int num_dets = btracks.size();
+	this->gating_means.resize(num_tracks);
+	this->gating_covariances.resize(num_tracks);
+	for (int i = 0; i < num_tracks; i++)
+	{
+		this->gating_means[i] = &atracks[i]->mean;
+		this->gating_covariances[i] = &atracks[i]->covariance;
+	}
+
+	this->gating_measurements.resize(num_dets);
+	for (int j = 0; j < num_dets; j++)
+	{
+		const float* tlwh = btracks[j].tlwh;
+		DETECTBOX& xyah = this->gating_measurements[j];
+		xyah[0] = tlwh[0] + tlwh[2] / 2;
+		xyah[1] = tlwh[1] + tlwh[3] / 2;
+		xyah[2] = tlwh[2] / tlwh[3];
+		xyah[3] = tlwh[3];
+	}
+
+	bool only_position = this->_config.gating_only_position;
+	this->gating_distances.resize((size_t)num_tracks * num_dets);
+	this->kalman_filter.gating_distance(this->gating_means.data(), this->gating_covariances.data(), num_tracks,
+		this->gating_measurements.data(), num_dets, this->gating_distances.data(), only_position);
+
+	float threshold = this->kalman_filter.gating_threshold(only_position);
+	for (int i = 0; i < num_tracks; i++)
+	{
+		const float* distance = this->gating_distances.data() + (size_t)i * num_dets;
+		for (int j = 0; j < num_dets; j++)
+		{
+			if (distance[j] > threshold && cost_matrix[i][j] < 1)
+			{
+				cost_matrix[i][j] = 1;
+				this->_stats.gated_pairs++;
+			}
+		}
+	}
+}
+
 vector<vector<float> > BYTETracker::iou_distance(vector<STrack> &atracks, vector<STrack> &btracks)
 {
 	vector<vector<float> > atlbrs, btlbrs;
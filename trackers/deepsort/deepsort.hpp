@@ -5,7 +5,12 @@
 #include <memory>
 #include <vector>
 #include <opencv2/opencv.hpp>
+#include "deepsort_core.hpp"
 
+/**
+ * DeepSORT的OpenCV接口，是deepsort_core.hpp之上的一层适配
+ * Box携带cv::Mat feature，update时打包成连续的float矩阵交给核心跟踪器
+ */
 namespace DeepSORT {
 
 struct Box{
@@ -29,37 +34,6 @@ inline cv::Rect convert_box_to_rect(const _T& b){
     return cv::Rect(b.left, b.top, b.right-b.left, b.bottom-b.top);
 }
 
-enum class State : int{
-    Tentative = 1,
-    Confirmed = 2,
-    Deleted   = 3
-};
-
-struct Config{
-
-    int max_age  = 150;
-    int nhit     = 5;
-    float distance_threshold = 1000;
-    int nbuckets = 0;
-    bool has_feature = false;
-
-    // kalman
-    // /** 初始状态 **/
-    float initiate_state[8];
-
-    // /** 每一侦的运动量协方差，下一侦 = 当前帧 + 运动量 **/
-    float per_frame_motion[8];
-
-    // /** 测量噪声，把输入映射到测量空间中后的噪声 **/
-    float noise[4];
-
-    Config& set_initiate_state(const std::vector<float>& values);
-    Config& set_per_frame_motion(const std::vector<float>& values);
-    Config& set_noise(const std::vector<float>& values);
-
-    Config();
-};
-
 typedef std::vector<Box> BBoxes;
 
 class TrackObject{
@@ -70,23 +44,38 @@ public:
     virtual Box last_position() const = 0;
 	virtual bool is_confirmed() const = 0;
 	virtual int time_since_update() const = 0;
+    // 平滑后的轨迹线，由轨迹存储增量维护，不做任何拷贝
+    virtual Span<TracePoint> trace() const = 0;
     virtual std::vector<cv::Point> trace_line() const = 0;
     virtual int trace_size() const = 0;
-    virtual Box& location(int time_since_update=0) = 0;
+    // 历史位置，不带feature
+    virtual Box location(int time_since_update=0) const = 0;
     virtual const cv::Mat& feature_bucket() const = 0;
+    // EMA模式下的滑动平均feature，Bucket模式下为空
+    virtual const cv::Mat& ema_feature() const = 0;
 };
 
 class Tracker{
 public:
-    virtual std::vector<TrackObject *> update(const BBoxes& boxes) = 0;
+    // 返回的TrackObject指针指向tracker内部的对象池，跨帧保持有效，直到该轨迹被删除(State::Deleted)后槽位被复用
+    virtual std::vector<TrackObject *> update(const BBoxes& boxes, float dt = 1) = 0;
+
+    // 直接读取调用方的检测框数组，features为CV_32F、第k行对应第k个通过filter的框，可以为空
+    // 返回的数组跨帧复用，在下一次update/predict之前有效
+    virtual const std::vector<TrackObject *>& update(const core::BoxSpan& boxes, const cv::Mat& features, const core::BoxFilter& filter = nullptr, float dt = 1) = 0;
+
+    // 检测器跳帧时只做预测，见core::Tracker::predict
+    virtual std::vector<TrackObject *> predict(float dt = 1) = 0;
+
+    // 匹配级联的统计，需要Config::telemetry = true
+    virtual const Telemetry& telemetry() const = 0;
+    virtual void reset_telemetry() = 0;
 };
 
 std::shared_ptr<Tracker> create_tracker(
     const Config& config = Config()
 );
 
-std::tuple<uint8_t, uint8_t, uint8_t> get_color(int idx);
-
 }
 
 #endif // DEEPSORT_HPP
\ No newline at end of file
@@ -0,0 +1,1488 @@
+#include "deepsort_core.hpp"
+#include "reid_index.hpp"
+
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <utility>
+#include "Eigen/Core"
+#include "Eigen/Cholesky"
+#include "Eigen/LU"
+#include <tuple>
+#include <cmath>
+#include <cstring>
+#include <cfloat>
+#include <iostream>
+#include <chrono>
+#include <stdio.h>
+
+namespace DeepSORT {
+
+    Config::Config(){
+        
+        float std_weight_position_ = 1 / 20.f;
+        float std_weight_velocity_ = 1 / 160.f;
+        float initiate_state[] = {
+            2.0f * std_weight_position_,
+            2.0f * std_weight_position_,
+            1e-2,
+            2.0f * std_weight_position_,
+            10.0f * std_weight_velocity_,
+            10.0f * std_weight_velocity_,
+            1e-5,
+            10.0f * std_weight_velocity_,
+        };
+
+        float noise[] = {
+            std_weight_position_,
+            std_weight_position_,
+            1e-1,
+            std_weight_position_
+        };
+
+        float per_frame_motion[] = {
+            std_weight_position_,
+            std_weight_position_,
+            1e-2,
+            std_weight_position_,
+            std_weight_velocity_,
+            std_weight_velocity_,
+            1e-5,
+            std_weight_velocity_,
+        };
+        memcpy(this->initiate_state, initiate_state, sizeof(initiate_state));
+        memcpy(this->noise, noise, sizeof(noise));
+        memcpy(this->per_frame_motion, per_frame_motion, sizeof(per_frame_motion));
+    }
+
+    Config& Config::set_initiate_state(const std::vector<float>& values){
+        if(values.size() != 8){
+            printf("set_initiate_state failed, Values.size(%d0) != 8\n", values.size());
+            return *this;
+        }
+        memcpy(this->initiate_state, values.data(), sizeof(this->initiate_state));
+        return *this;
+    }
+
+    Config& Config::set_per_frame_motion(const std::vector<float>& values){
+        if(values.size() != 8){
+            printf("set_per_frame_motion failed, Values.size(%d0) != 8\n", values.size());
+            return *this;
+        }
+        memcpy(this->per_frame_motion, values.data(), sizeof(this->per_frame_motion));
+        return *this;
+    }
+
+    Config& Config::set_noise(const std::vector<float>& values){
+        if(values.size() != 4){
+            printf("set_noise failed, Values.size(%d0) != 4\n", values.size());
+            return *this;
+        }
+        memcpy(this->noise, values.data(), sizeof(this->noise));
+        return *this;
+    }
+
+    std::tuple<uint8_t, uint8_t, uint8_t> get_color(int idx)
+    {
+        idx += 3;
+        return std::make_tuple(37 * idx % 255, 17 * idx % 255, 29 * idx % 255);
+    }
+
+    void Histogram::add(double value){
+        int bin = 0;
+        if(value >= 1){
+            int exponent = 0;
+            std::frexp(value, &exponent);
+            bin = std::min(exponent, NumBins - 1);
+        }
+        ++bins[bin];
+        ++count;
+        sum += value;
+        max = std::max(max, value);
+    }
+
+    double Histogram::percentile(double q) const{
+        if(count == 0)
+            return 0;
+
+        uint64_t target = std::max<uint64_t>(1, (uint64_t)std::ceil(q * count));
+        uint64_t accum = 0;
+        for(int i = 0; i < NumBins; ++i){
+            accum += bins[i];
+            if(accum >= target)
+                return std::min(max, i == 0 ? 1.0 : std::ldexp(1.0, i));
+        }
+        return max;
+    }
+
+namespace core {
+
+    struct BBoxXYAH{
+        int center_x, center_y;   
+        float aspect_ratio;       
+        int height;               
+
+        BBoxXYAH() = default;
+        BBoxXYAH(const Box &box) {
+            center_x = box.center_x();
+            center_y = box.center_y();
+            height = box.height();
+            aspect_ratio = box.width() / height;
+        }
+    };
+
+    static float chi2inv95_2[] = {
+        3.8415f,
+        5.9915f,
+        7.8147f,
+        9.4877f,
+        11.070f,
+        12.592f,
+        14.067f,
+        15.507f,
+        16.919
+    };
+
+    static float distance(const Box &box, const Box &box2) {
+        return hypot(box.center_x() - box2.center_x(), box.center_y() - box2.center_y());
+    }
+
+    static bool overlap(const Box &a, const Box &b) {
+        return std::min(a.right, b.right) > std::max(a.left, b.left) &&
+               std::min(a.bottom, b.bottom) > std::max(a.top, b.top);
+    }
+
+    static float dot(const float* a, const float* b, int n) {
+        float s = 0;
+        for(int i = 0; i < n; ++i)
+            s += a[i] * b[i];
+        return s;
+    }
+
+    /**
+     * @brief 定长环形缓冲区
+     * 每个元素同时写入pos和pos+capacity两处，最近的size个元素在内存中始终连续，可以直接作为Span返回
+     */
+    template<typename _T>
+    class MirrorRing{
+    public:
+        void reset(int capacity){
+            capacity_ = capacity;
+            head_ = 0;
+            size_ = 0;
+            buffer_.assign(capacity * 2, _T());
+        }
+
+        int size() const{return size_;}
+        bool full() const{return size_ == capacity_;}
+
+        // 满了以后覆盖最旧的元素，返回是否丢弃了旧元素
+        bool push_back(const _T& value){
+            bool dropped = full();
+            if(dropped){
+                head_ = (head_ + 1) % capacity_;
+                -- size_;
+            }
+            ++ size_;
+            set(size_ - 1, value);
+            return dropped;
+        }
+
+        void set(int i, const _T& value){
+            int pos = (head_ + i) % capacity_;
+            buffer_[pos] = value;
+            buffer_[pos + capacity_] = value;
+        }
+
+        const _T& operator[](int i) const{return buffer_[head_ + i];}
+        const _T* data() const{return buffer_.data() + head_;}
+
+    private:
+        std::vector<_T> buffer_;
+        int capacity_ = 0;
+        int head_ = 0;
+        int size_ = 0;
+    };
+
+    /**
+     * @brief 轨迹存储
+     * 只保存量化后的框位置(不带feature)，平滑轨迹线随push增量更新，每次只重算受影响的几个点
+     */
+    class TrajectoryStore{
+    public:
+        struct QuantBox{
+            int16_t left, top, right, bottom;
+        };
+
+        void reset(int capacity){
+            boxes_.reset(capacity);
+            line_.reset(capacity);
+        }
+
+        int size() const{return boxes_.size();}
+
+        Box box(int i) const{
+            auto& q = boxes_[i];
+            return Box(q.left, q.top, q.right, q.bottom);
+        }
+
+        Span<TracePoint> line() const{
+            return Span<TracePoint>(line_.data(), line_.size());
+        }
+
+        void push(const Box& box){
+            bool dropped = boxes_.push_back({quantize(box.left), quantize(box.top), quantize(box.right), quantize(box.bottom)});
+            line_.push_back(TracePoint());
+
+            // 新点影响其前Smooth/2个点的窗口，丢弃最旧点影响其后Smooth/2个点的窗口
+            const int count = boxes_.size();
+            for(int i = std::max(0, count - 1 - Smooth / 2); i < count; ++i)
+                smooth(i);
+
+            if(dropped){
+                for(int i = 0; i < std::min(Smooth / 2, count); ++i)
+                    smooth(i);
+            }
+        }
+
+    private:
+        static const int Smooth = 5;
+
+        static int16_t quantize(float v){
+            return (int16_t)std::max(-32768.0f, std::min(32767.0f, std::round(v)));
+        }
+
+        void smooth(int i){
+            const int count = boxes_.size();
+            int begin = std::max<int>(0, i - Smooth / 2);
+            int end = std::min<int>(i + Smooth / 2 + 1, count);
+            int x = 0;
+            int y = 0;
+            for (int j = begin; j < end; ++j) {
+                x += (boxes_[j].left + boxes_[j].right) / 2;
+                y += boxes_[j].bottom;
+            }
+            line_.set(i, TracePoint{x / (end - begin), y / (end - begin)});
+        }
+
+        MirrorRing<QuantBox> boxes_;
+        MirrorRing<TracePoint> line_;
+    };
+
+    class HungarianAlgorithm
+    {
+    public:
+        enum TMethod
+        {
+            optimal,
+            many_forbidden_assignments,
+            without_forbidden_assignments
+        };
+
+    public:
+        HungarianAlgorithm(){}
+        ~HungarianAlgorithm(){}
+
+        double Solve(std::vector<std::vector<double> >& DistMatrix, std::vector<int>& Assignment)
+        {
+            unsigned int nRows = DistMatrix.size();
+            unsigned int nCols = DistMatrix[0].size();
+
+            std::vector<double> distMatrixIn(nRows * nCols);
+            std::vector<int> assignment(nRows);
+            double cost = 0.0;
+
+            for (unsigned int i = 0; i < nRows; i++)
+                for (unsigned int j = 0; j < nCols; j++)
+                    distMatrixIn[i + nRows * j] = DistMatrix[i][j];
+            
+            // call solving function
+            assignmentoptimal(assignment.data(), &cost, distMatrixIn.data(), nRows, nCols);
+
+            Assignment.clear();
+            for (unsigned int r = 0; r < nRows; r++)
+                Assignment.push_back(assignment[r]);
+
+            return cost;
+        }
+
+    private:
+        void assignmentoptimal(int *assignment, double *cost, double *distMatrixIn, int nOfRows, int nOfColumns)
+        {
+            double *distMatrix, *distMatrixTemp, *distMatrixEnd, *columnEnd, value, minValue;
+            bool *coveredColumns, *coveredRows, *starMatrix, *newStarMatrix, *primeMatrix;
+            int nOfElements, minDim, row, col;
+
+            /* initialization */
+            *cost = 0;
+            for (row = 0; row<nOfRows; row++)
+                assignment[row] = -1;
+
+            /* generate working copy of distance Matrix */
+            /* check if all matrix elements are positive */
+            nOfElements = nOfRows * nOfColumns;
+            distMatrix = (double *)malloc(nOfElements * sizeof(double));
+            distMatrixEnd = distMatrix + nOfElements;
+
+            for (row = 0; row<nOfElements; row++)
+            {
+                value = distMatrixIn[row];
+                if (value < 0)
+                    std::cerr << "All matrix elements have to be non-negative." << std::endl;
+                distMatrix[row] = value;
+            }
+
+
+            /* memory allocation */
+            coveredColumns = (bool *)calloc(nOfColumns, sizeof(bool));
+            coveredRows = (bool *)calloc(nOfRows, sizeof(bool));
+            starMatrix = (bool *)calloc(nOfElements, sizeof(bool));
+            primeMatrix = (bool *)calloc(nOfElements, sizeof(bool));
+            newStarMatrix = (bool *)calloc(nOfElements, sizeof(bool)); /* used in step4 */
+
+            /* preliminary steps */
+            if (nOfRows <= nOfColumns)
+            {
+                minDim = nOfRows;
+
+                for (row = 0; row<nOfRows; row++)
+                {
+                    /* find the smallest element in the row */
+                    distMatrixTemp = distMatrix + row;
+                    minValue = *distMatrixTemp;
+                    distMatrixTemp += nOfRows;
+                    while (distMatrixTemp < distMatrixEnd)
+                    {
+                        value = *distMatrixTemp;
+                        if (value < minValue)
+                            minValue = value;
+                        distMatrixTemp += nOfRows;
+                    }
+
+                    /* subtract the smallest element from each element of the row */
+                    distMatrixTemp = distMatrix + row;
+                    while (distMatrixTemp < distMatrixEnd)
+                    {
+                        *distMatrixTemp -= minValue;
+                        distMatrixTemp += nOfRows;
+                    }
+                }
+
+                /* Steps 1 and 2a */
+                for (row = 0; row<nOfRows; row++)
+                    for (col = 0; col<nOfColumns; col++)
+                        if (fabs(distMatrix[row + nOfRows*col]) < DBL_EPSILON)
+                            if (!coveredColumns[col])
+                            {
+                                starMatrix[row + nOfRows*col] = true;
+                                coveredColumns[col] = true;
+                                break;
+                            }
+            }
+            else /* if(nOfRows > nOfColumns) */
+            {
+                minDim = nOfColumns;
+
+                for (col = 0; col<nOfColumns; col++)
+                {
+                    /* find the smallest element in the column */
+                    distMatrixTemp = distMatrix + nOfRows*col;
+                    columnEnd = distMatrixTemp + nOfRows;
+
+                    minValue = *distMatrixTemp++;
+                    while (distMatrixTemp < columnEnd)
+                    {
+                        value = *distMatrixTemp++;
+                        if (value < minValue)
+                            minValue = value;
+                    }
+
+                    /* subtract the smallest element from each element of the column */
+                    distMatrixTemp = distMatrix + nOfRows*col;
+                    while (distMatrixTemp < columnEnd)
+                        *distMatrixTemp++ -= minValue;
+                }
+
+                /* Steps 1 and 2a */
+                for (col = 0; col<nOfColumns; col++)
+                    for (row = 0; row<nOfRows; row++)
+                        if (fabs(distMatrix[row + nOfRows*col]) < DBL_EPSILON)
+                            if (!coveredRows[row])
+                            {
+                                starMatrix[row + nOfRows*col] = true;
+                                coveredColumns[col] = true;
+                                coveredRows[row] = true;
+                                break;
+                            }
+                for (row = 0; row<nOfRows; row++)
+                    coveredRows[row] = false;
+
+            }
+
+            /* move to step 2b */
+            step2b(assignment, distMatrix, starMatrix, newStarMatrix, primeMatrix, coveredColumns, coveredRows, nOfRows, nOfColumns, minDim);
+
+            /* compute cost and remove invalid assignments */
+            computeassignmentcost(assignment, cost, distMatrixIn, nOfRows);
+
+            /* free allocated memory */
+            free(distMatrix);
+            free(coveredColumns);
+            free(coveredRows);
+            free(starMatrix);
+            free(primeMatrix);
+            free(newStarMatrix);
+
+            return;
+        }
+
+        void buildassignmentvector(int *assignment, bool *starMatrix, int nOfRows, int nOfColumns)
+        {
+            int row, col;
+
+            for (row = 0; row<nOfRows; row++)
+                for (col = 0; col<nOfColumns; col++)
+                    if (starMatrix[row + nOfRows*col])
+                    {
+        #ifdef ONE_INDEXING
+                        assignment[row] = col + 1; /* MATLAB-Indexing */
+        #else
+                        assignment[row] = col;
+        #endif
+                        break;
+                    }
+        }
+
+        void computeassignmentcost(int *assignment, double *cost, double *distMatrix, int nOfRows)
+        {
+            int row, col;
+
+            for (row = 0; row<nOfRows; row++)
+            {
+                col = assignment[row];
+                if (col >= 0)
+                    *cost += distMatrix[row + nOfRows*col];
+            }
+        }
+
+        void step2a(int *assignment, double *distMatrix, bool *starMatrix, bool *newStarMatrix, bool *primeMatrix, bool *coveredColumns, bool *coveredRows, int nOfRows, int nOfColumns, int minDim)
+        {
+            bool *starMatrixTemp, *columnEnd;
+            int col;
+
+            /* cover every column containing a starred zero */
+            for (col = 0; col<nOfColumns; col++)
+            {
+                starMatrixTemp = starMatrix + nOfRows*col;
+                columnEnd = starMatrixTemp + nOfRows;
+                while (starMatrixTemp < columnEnd){
+                    if (*starMatrixTemp++)
+                    {
+                        coveredColumns[col] = true;
+                        break;
+                    }
+                }
+            }
+
+            /* move to step 3 */
+            step2b(assignment, distMatrix, starMatrix, newStarMatrix, primeMatrix, coveredColumns, coveredRows, nOfRows, nOfColumns, minDim);
+        }
+
+        void step2b(int *assignment, double *distMatrix, bool *starMatrix, bool *newStarMatrix, bool *primeMatrix, bool *coveredColumns, bool *coveredRows, int nOfRows, int nOfColumns, int minDim)
+        {
+            int col, nOfCoveredColumns;
+
+            /* count covered columns */
+            nOfCoveredColumns = 0;
+            for (col = 0; col<nOfColumns; col++)
+                if (coveredColumns[col])
+                    nOfCoveredColumns++;
+
+            if (nOfCoveredColumns == minDim)
+            {
+                /* algorithm finished */
+                buildassignmentvector(assignment, starMatrix, nOfRows, nOfColumns);
+            }
+            else
+            {
+                /* move to step 3 */
+                step3(assignment, distMatrix, starMatrix, newStarMatrix, primeMatrix, coveredColumns, coveredRows, nOfRows, nOfColumns, minDim);
+            }
+
+        }
+
+        void step3(int *assignment, double *distMatrix, bool *starMatrix, bool *newStarMatrix, bool *primeMatrix, bool *coveredColumns, bool *coveredRows, int nOfRows, int nOfColumns, int minDim)
+        {
+            bool zerosFound;
+            int row, col, starCol;
+
+            zerosFound = true;
+            while (zerosFound)
+            {
+                zerosFound = false;
+                for (col = 0; col<nOfColumns; col++)
+                    if (!coveredColumns[col])
+                        for (row = 0; row<nOfRows; row++)
+                            if ((!coveredRows[row]) && (fabs(distMatrix[row + nOfRows*col]) < DBL_EPSILON))
+                            {
+                                /* prime zero */
+                                primeMatrix[row + nOfRows*col] = true;
+
+                                /* find starred zero in current row */
+                                for (starCol = 0; starCol<nOfColumns; starCol++)
+                                    if (starMatrix[row + nOfRows*starCol])
+                                        break;
+
+                                if (starCol == nOfColumns) /* no starred zero found */
+                                {
+                                    /* move to step 4 */
+                                    step4(assignment, distMatrix, starMatrix, newStarMatrix, primeMatrix, coveredColumns, coveredRows, nOfRows, nOfColumns, minDim, row, col);
+                                    return;
+                                }
+                                else
+                                {
+                                    coveredRows[row] = true;
+                                    coveredColumns[starCol] = false;
+                                    zerosFound = true;
+                                    break;
+                                }
+                            }
+            }
+
+            /* move to step 5 */
+            step5(assignment, distMatrix, starMatrix, newStarMatrix, primeMatrix, coveredColumns, coveredRows, nOfRows, nOfColumns, minDim);
+        }
+
+        void step4(int *assignment, double *distMatrix, bool *starMatrix, bool *newStarMatrix, bool *primeMatrix, bool *coveredColumns, bool *coveredRows, int nOfRows, int nOfColumns, int minDim, int row, int col)
+        {
+            int n, starRow, starCol, primeRow, primeCol;
+            int nOfElements = nOfRows*nOfColumns;
+
+            /* generate temporary copy of starMatrix */
+            for (n = 0; n<nOfElements; n++)
+                newStarMatrix[n] = starMatrix[n];
+
+            /* star current zero */
+            newStarMatrix[row + nOfRows*col] = true;
+
+            /* find starred zero in current column */
+            starCol = col;
+            for (starRow = 0; starRow<nOfRows; starRow++)
+                if (starMatrix[starRow + nOfRows*starCol])
+                    break;
+
+            while (starRow<nOfRows)
+            {
+                /* unstar the starred zero */
+                newStarMatrix[starRow + nOfRows*starCol] = false;
+
+                /* find primed zero in current row */
+                primeRow = starRow;
+                for (primeCol = 0; primeCol<nOfColumns; primeCol++)
+                    if (primeMatrix[primeRow + nOfRows*primeCol])
+                        break;
+
+                /* star the primed zero */
+                newStarMatrix[primeRow + nOfRows*primeCol] = true;
+
+                /* find starred zero in current column */
+                starCol = primeCol;
+                for (starRow = 0; starRow<nOfRows; starRow++)
+                    if (starMatrix[starRow + nOfRows*starCol])
+                        break;
+            }
+
+            /* use temporary copy as new starMatrix */
+            /* delete all primes, uncover all rows */
+            for (n = 0; n<nOfElements; n++)
+            {
+                primeMatrix[n] = false;
+                starMatrix[n] = newStarMatrix[n];
+            }
+            for (n = 0; n<nOfRows; n++)
+                coveredRows[n] = false;
+
+            /* move to step 2a */
+            step2a(assignment, distMatrix, starMatrix, newStarMatrix, primeMatrix, coveredColumns, coveredRows, nOfRows, nOfColumns, minDim);
+        }
+
+        void step5(int *assignment, double *distMatrix, bool *starMatrix, bool *newStarMatrix, bool *primeMatrix, bool *coveredColumns, bool *coveredRows, int nOfRows, int nOfColumns, int minDim)
+        {
+            double h, value;
+            int row, col;
+
+            /* find smallest uncovered element h */
+            h = DBL_MAX;
+            for (row = 0; row<nOfRows; row++)
+                if (!coveredRows[row])
+                    for (col = 0; col<nOfColumns; col++)
+                        if (!coveredColumns[col])
+                        {
+                            value = distMatrix[row + nOfRows*col];
+                            if (value < h)
+                                h = value;
+                        }
+
+            /* add h to each covered row */
+            for (row = 0; row<nOfRows; row++)
+                if (coveredRows[row])
+                    for (col = 0; col<nOfColumns; col++)
+                        distMatrix[row + nOfRows*col] += h;
+
+            /* subtract h from each uncovered column */
+            for (col = 0; col<nOfColumns; col++)
+                if (!coveredColumns[col])
+                    for (row = 0; row<nOfRows; row++)
+                        distMatrix[row + nOfRows*col] -= h;
+
+            /* move to step 3 */
+            step3(assignment, distMatrix, starMatrix, newStarMatrix, primeMatrix, coveredColumns, coveredRows, nOfRows, nOfColumns, minDim);
+        }
+    };
+
+
+    class KalmanFilter
+    {
+    public:
+        KalmanFilter(const Config& config):config_(config) {
+            /* 匀速直线运动 */
+            motion_mat_ = Eigen::Matrix<float, 8, 8>::Identity(8, 8);
+            for (int i = 0; i < 4; ++i) {
+                motion_mat_(i, 4 + i) = 1;
+            }
+            update_mat_ = Eigen::Matrix<float, 4, 8>::Identity(4, 8);
+        }
+        ~KalmanFilter() {
+
+        }
+
+        void project(const Eigen::Matrix<float, 8, 1> &mean, 
+                    const Eigen::Matrix<float, 8, 8> &covariance,
+                    Eigen::Matrix<float, 4, 1> &mean_ret,
+                    Eigen::Matrix<float, 4, 4> &covariance_ret) {
+            Eigen::Matrix<float, 4, 1> std_vel;
+            
+            /* 测量噪声标准差 */
+            // std_vel << std_weight_position_ * mean(3, 0),
+            //         std_weight_position_ * mean(3, 0),
+            //         1e-1,
+            //         std_weight_position_ * mean(3, 0);
+            std_vel <<  config_.noise[0] * mean(3, 0),
+                        config_.noise[1] * mean(3, 0),
+                        config_.noise[2],
+                        config_.noise[3] * mean(3, 0);
+            std_vel = std_vel.array().pow(2).matrix();
+            Eigen::Matrix<float, 4, 4> innovation_cov(std_vel.asDiagonal());
+
+            mean_ret = update_mat_ * mean;
+            covariance_ret = update_mat_ * covariance * update_mat_.transpose() + innovation_cov;
+        }
+
+        /**
+         * @brief 马氏距离计算
+         * 
+         * @param mean 
+         * @param covariance 
+         * @param boxah 
+         * @param only_position 
+         * @return float 
+         */
+        float ma_distance(const Eigen::Matrix<float, 8, 1> &mean, 
+                        const Eigen::Matrix<float, 8, 8> &covariance,
+                        const BBoxXYAH &boxah,
+                        bool only_position =  false) {
+            // 
+            Eigen::Matrix<float, 4, 1> mean_ret;
+            Eigen::Matrix<float, 4, 4> covariance_ret;
+            this->project(mean, covariance, mean_ret, covariance_ret);
+
+            float squared_maha = 0;
+            if (only_position) {
+
+            }
+            else {
+                auto cholesky_factor = covariance_ret.llt();
+                Eigen::Matrix<float, 4, 1> matrix_boxah;
+                matrix_boxah << boxah.center_x, boxah.center_y, boxah.aspect_ratio, boxah.height;
+                auto d = matrix_boxah - mean_ret;
+                auto z = cholesky_factor.solve(d);
+                squared_maha = z.array().pow(2).sum();
+
+                Eigen::LLT<Eigen::Matrix<float, 4, 4>> a_factor(covariance_ret);
+                Eigen::Matrix<float, 4, 4> a = a_factor.matrixL();
+                Eigen::Map<Eigen::MatrixXf> a_map(a.data(), a.rows(), a.cols());
+                auto a_inv = a_map.inverse();
+                auto zz = d.transpose() * a_inv;
+                squared_maha = zz.array().pow(2).sum();
+            }
+
+            return squared_maha;
+        }
+
+        /* dt为距离上一次预测的时间，以帧为单位，运动噪声按dt线性放大 */
+        void predict(Eigen::Matrix<float, 8, 1> &mean, 
+                    Eigen::Matrix<float, 8, 8> &covariance,
+                    float dt = 1) {
+            Eigen::Matrix<float, 8, 1> std_pos_vel;
+
+            /* 预测下一步所在位置，那么std_pos则是模型对下一步预测的标准差。可以认为是一帧运动了多少 */
+            // std_pos_vel << std_weight_position_ * mean(3, 0),
+            //             std_weight_position_ * mean(3, 0),
+            //             1e-2,
+            //             std_weight_position_ * mean(3, 0),
+
+            //             std_weight_velocity_ * mean(3, 0),
+            //             std_weight_velocity_ * mean(3, 0),
+            //             1e-5,
+            //             std_weight_velocity_ * mean(3, 0);
+            std_pos_vel <<  config_.per_frame_motion[0] * mean(3, 0),
+                            config_.per_frame_motion[1] * mean(3, 0),
+                            config_.per_frame_motion[2],
+                            config_.per_frame_motion[3] * mean(3, 0),
+                            config_.per_frame_motion[4] * mean(3, 0),
+                            config_.per_frame_motion[5] * mean(3, 0),
+                            config_.per_frame_motion[6],
+                            config_.per_frame_motion[7] * mean(3, 0);
+            std_pos_vel = std_pos_vel.array().pow(2).matrix() * dt;
+            Eigen::Matrix<float, 8, 8> motion_cov(std_pos_vel.asDiagonal());
+
+            Eigen::Matrix<float, 8, 8> motion_mat = motion_mat_;
+            if(dt != 1){
+                for (int i = 0; i < 4; ++i)
+                    motion_mat(i, 4 + i) = dt;
+            }
+            mean = motion_mat * mean;
+            covariance = motion_mat * covariance * motion_mat.transpose() + motion_cov;
+        }
+
+        void update(const BBoxXYAH &boxah,
+                    Eigen::Matrix<float, 8, 1> &mean,
+                    Eigen::Matrix<float, 8, 8> &covariance) {
+            Eigen::Matrix<float, 4, 1> mean_ret;
+            Eigen::Matrix<float, 4, 4> covariance_ret;
+            project(mean, covariance, mean_ret, covariance_ret);
+
+            Eigen::Map<Eigen::MatrixXf> cov_map(covariance_ret.data(), covariance_ret.rows(), covariance_ret.cols());
+            auto cov_inv = cov_map.inverse();
+            auto kalman_gain = covariance * update_mat_.transpose() * cov_inv;
+
+            Eigen::Matrix<float, 4, 1> measure;
+            measure << boxah.center_x, boxah.center_y, boxah.aspect_ratio, boxah.height;
+            auto innovation = measure - mean_ret;
+            
+            mean = mean + kalman_gain * innovation;
+            covariance = covariance - kalman_gain * update_mat_ * covariance;
+        }
+
+        void initiate(const BBoxXYAH &boxah, Eigen::Matrix<float, 8, 1> &mean, 
+                    Eigen::Matrix<float, 8, 8> &covariance) {
+            mean << boxah.center_x, boxah.center_y, boxah.aspect_ratio,
+                boxah.height, 0.0f, 0.0f, 0.0f, 0.0f;
+
+            /** 初始状态 **/
+            Eigen::Matrix<float, 8, 1> std_val;
+            // std_val << 2.0f * std_weight_position_ * boxah.height,
+            //            2.0f * std_weight_position_ * boxah.height,
+            //            1e-2,
+            //            2.0f * std_weight_position_ * boxah.height,
+
+            //            10.0f * std_weight_velocity_ * boxah.height,
+            //            10.0f * std_weight_velocity_ * boxah.height,
+            //            1e-5,
+            //            10.0f * std_weight_velocity_ * boxah.height;
+            std_val << config_.initiate_state[0] * boxah.height,
+                       config_.initiate_state[1] * boxah.height,
+                       config_.initiate_state[2],
+                       config_.initiate_state[3] * boxah.height,
+                       config_.initiate_state[4] * boxah.height,
+                       config_.initiate_state[5] * boxah.height,
+                       config_.initiate_state[6],
+                       config_.initiate_state[7] * boxah.height;
+            covariance = Eigen::Matrix<float, 8, 8>(std_val.array().pow(2).matrix().asDiagonal());
+        }
+
+    private:
+        //float std_weight_position_{1.0f / 20};
+        //float std_weight_velocity_{1.0f / 160};
+
+        Eigen::Matrix<float, 8, 8> motion_mat_;
+        Eigen::Matrix<float, 4, 8> update_mat_;
+        Config config_;
+    };
+
+    class TrackObjectImpl : public TrackObject
+    {
+    public:
+        TrackObjectImpl(const Box &box,
+                    const float *feature, int dim,
+                    const Eigen::Matrix<float, 8, 1> &mean,
+                    const Eigen::Matrix<float, 8, 8> &covariance,
+                    int id_next, const Config& config)
+            :nbuckets_(config.nbuckets), max_age_(config.max_age), nhit_(config.nhit), has_feature_(config.has_feature),
+            feature_mode_(config.feature_mode), ema_alpha_(config.ema_alpha), dim_(dim)
+        {
+            bucket_size_   = feature_mode_ == FeatureMode::EMA ? config.ema_topk : nbuckets_;
+            last_position_ = Box(box.left, box.top, box.right, box.bottom);
+            covariance_    = covariance;
+            mean_          = mean;
+            id_            = id_next;
+            state_         = State::Tentative;
+
+            // 未开启feature时nbuckets可以为0，轨迹至少保留当前位置
+            trace_.reset(std::max(nbuckets_, 1));
+            trace_.push(box);
+
+            if(has_feature_ && feature != nullptr)
+                add_feature(feature);
+        }
+
+        virtual int time_since_update() const {return time_since_update_;}
+        virtual State state() const {return state_;}
+        virtual Box last_position() const {return last_position_;}
+        virtual int id() const {return id_;}
+        virtual int slot() const {return slot_;}
+        virtual bool is_confirmed() const {return state_ == State::Confirmed;}
+        bool has_feature() const {return has_feature_;}
+        bool ever_confirmed() const {return hits_ >= nhit_;}
+        void set_slot(int slot) {slot_ = slot;}
+
+        virtual int trace_size() const{
+            return trace_.size();
+        }
+
+        virtual Box location(int time_since_update) const{
+            if(time_since_update >= trace_.size() || time_since_update < 0){
+                printf("time_since_update[%d] out of range[%d]\n", time_since_update, trace_.size());
+                return Box(0, 0, 0, 0);
+            }
+            return trace_.box(trace_.size() - 1 - time_since_update);
+        }
+
+        Eigen::Matrix<float, 8, 1> get_mean() const {return mean_;}
+        Eigen::Matrix<float, 8, 8> get_covariance() const {return covariance_;}
+
+        virtual Box predict_box() const {
+            float center_x = mean_(0, 0);
+            float center_y = mean_(1, 0);
+            float aspect_ratio = mean_(2, 0);
+            float height = mean_(3, 0);
+            float width = aspect_ratio * height;
+
+            float left = int(center_x - width / 2);
+            float top = int(center_y - height / 2);
+            float right = int(center_x + width / 2);
+            float bottom = int(center_y + height / 2);
+
+            return Box(left, top, right, bottom);
+        }
+
+        void predict(KalmanFilter &km_filter, float dt) {
+            km_filter.predict(mean_, covariance_, dt);
+
+            ++ age_;
+            ++ time_since_update_;
+        }
+
+        /* 通过重识别找回的轨迹，直接恢复为确认状态 */
+        void mark_reidentified() {
+            state_ = State::Confirmed;
+            hits_  = std::max(hits_, nhit_);
+        }
+
+        /* 轨迹删除后的外观描述，EMA模式下即滑动平均feature，否则为feature_bucket的平均值 */
+        bool mean_feature(std::vector<float> &output) const {
+            if(feature_mode_ == FeatureMode::EMA){
+                output = ema_feature_;
+                return !output.empty();
+            }
+
+            if(bucket_rows_ == 0)
+                return false;
+
+            output.assign(dim_, 0);
+            for(int i = 0; i < bucket_rows_; ++i){
+                const float* row = feature_bucket_.data() + (size_t)i * dim_;
+                for(int j = 0; j < dim_; ++j)
+                    output[j] += row[j];
+            }
+            for(int j = 0; j < dim_; ++j)
+                output[j] /= bucket_rows_;
+            return true;
+        }
+
+        void mark_missed() {
+            if (state_ == State::Tentative || time_since_update_ > max_age_) {
+                state_ = State::Deleted;
+            }
+        }
+
+        void update(KalmanFilter &km_filter, const Box &box, const float *feature) {
+
+            // 缺少feature时该轨迹不再使用外观特征，由tracker计入Telemetry::missing_features
+            if(has_feature_ && feature == nullptr)
+                has_feature_ = false;
+
+            if(has_feature_)
+                add_feature(feature);
+
+            trace_.push(box);
+            km_filter.update(box, mean_, covariance_);
+            last_position_ = Box(box.left, box.top, box.right, box.bottom);
+            ++ hits_;
+            time_since_update_ = 0;
+
+            if (state_ == State::Tentative && hits_ >= nhit_) {
+                state_ = State::Confirmed;
+            }
+        }
+
+        virtual FeatureMatrix feature_bucket() const override{
+            if(bucket_rows_ == 0)
+                return FeatureMatrix();
+            return FeatureMatrix(feature_bucket_.data(), bucket_rows_, dim_);
+        }
+
+        virtual FeatureMatrix ema_feature() const override{
+            if(ema_feature_.empty())
+                return FeatureMatrix();
+            return FeatureMatrix(ema_feature_.data(), 1, dim_);
+        }
+
+        /* 外观距离 1 - cos，EMA模式下为一次点积，开启ema_topk或Bucket模式时与bucket中的feature取最大相似度 */
+        double appearance_distance(const float *feature) const {
+            double max_score = 0;
+            if(!ema_feature_.empty())
+                max_score = dot(ema_feature_.data(), feature, dim_);
+
+            for(int i = 0; i < bucket_rows_; ++i)
+                max_score = std::max<double>(max_score, dot(feature_bucket_.data() + (size_t)i * dim_, feature, dim_));
+            return 1 - max_score;
+        }
+
+        void add_feature(const float *feature) {
+            if(feature_mode_ == FeatureMode::EMA){
+                if(ema_feature_.empty()){
+                    ema_feature_.assign(feature, feature + dim_);
+                }else{
+                    for(int i = 0; i < dim_; ++i)
+                        ema_feature_[i] = ema_alpha_ * ema_feature_[i] + (1 - ema_alpha_) * feature[i];
+                }
+
+                float norm = std::sqrt(dot(ema_feature_.data(), ema_feature_.data(), dim_));
+                if(norm > 0){
+                    for(int i = 0; i < dim_; ++i)
+                        ema_feature_[i] /= norm;
+                }
+            }
+
+            if(bucket_size_ < 1)
+                return;
+
+            if(bucket_rows_ < bucket_size_){
+                if(feature_bucket_.empty())
+                    feature_bucket_.reserve((size_t)bucket_size_ * dim_);
+                feature_bucket_.insert(feature_bucket_.end(), feature, feature + dim_);
+                ++ bucket_rows_;
+            }else{
+                memcpy(feature_bucket_.data() + (size_t)(feature_cursor_++) * dim_, feature, sizeof(float) * dim_);
+
+                if(feature_cursor_ >= bucket_size_)
+                    feature_cursor_ = 0;
+            }
+        }
+
+        virtual Span<TracePoint> trace() const override{
+            return trace_.line();
+        }
+
+    private:
+        int time_since_update_{0};
+        State state_{State::Tentative};
+        int age_{1};
+        int hits_{1};
+        int id_;
+        int slot_ = -1;
+        int feature_cursor_ = 0;
+        TrajectoryStore trace_;
+        std::vector<float> feature_bucket_;
+        std::vector<float> ema_feature_;
+        int bucket_rows_ = 0;
+        bool has_feature_ = false;
+        FeatureMode feature_mode_ = FeatureMode::Bucket;
+        float ema_alpha_ = 0.9;
+        int bucket_size_ = 0;
+        int dim_ = 0;
+
+        int nbuckets_ = 100;
+        int max_age_ = 100;
+        int nhit_ = 3;
+
+        Box last_position_;
+        Eigen::Matrix<float, 8, 1> mean_;
+        Eigen::Matrix<float, 8, 8> covariance_;
+    };
+
+    class TrackerImpl : public Tracker
+    {
+    public:
+        TrackerImpl(const Config& config)
+        :config_(config),
+        kalman_(config),
+        distance_threshold_(config.distance_threshold),
+        max_age_(config.max_age),
+        nhit_(config.nhit),
+        has_feature_(config.has_feature),
+        reid_capacity_(config.reid_capacity),
+        reid_max_age_(config.reid_max_age),
+        reid_threshold_(config.reid_threshold),
+        association_budget_ms_(config.association_budget_ms),
+        association_recover_ratio_(config.association_recover_ratio),
+        association_probe_interval_(config.association_probe_interval),
+        telemetry_enabled_(config.telemetry) {
+        }
+
+        virtual ~TrackerImpl() {
+        }
+
+        const std::vector<TrackObject *>& get_objects() {
+            output_.assign(objects_.begin(), objects_.end());
+            return output_;
+        }
+
+        virtual const Telemetry& telemetry() const override{
+            return telemetry_;
+        }
+
+        virtual void reset_telemetry() override{
+            telemetry_ = Telemetry();
+        }
+
+        void predict_all(float dt) {
+            for (auto obj : objects_) {
+                obj->predict(kalman_, dt);
+            }
+        }
+
+        /* 跳帧时只做预测，time_since_update照常增加，确认状态的轨迹超过max_age后删除 */
+        virtual const std::vector<TrackObject *>& predict(float dt) override{
+
+            ++ frame_id_;
+            if(reid_index_)
+                reid_index_->evict(frame_id_);
+
+            predict_all(dt);
+            if(telemetry_enabled_)
+                ++ telemetry_.predicted_frames;
+
+            for (auto obj : objects_) {
+                if(obj->state() == State::Confirmed && obj->time_since_update() > max_age_)
+                    obj->mark_missed();
+            }
+            remove_deleted();
+            return get_objects();
+        }
+
+        virtual const std::vector<TrackObject *>& update(const Box* boxes, int count, const FeatureMatrix& features, float dt) override{
+
+            ++ frame_id_;
+            if(reid_index_)
+                reid_index_->evict(frame_id_);
+
+            features_ = features;
+            predict_all(dt);
+
+            int depth = 0;
+            if(telemetry_enabled_){
+                ++ telemetry_.frames;
+                telemetry_.detections += count;
+                if(degraded_)
+                    ++ telemetry_.degraded_frames;
+            }
+
+            std::chrono::steady_clock::time_point association_tick;
+            if(association_budget_ms_ > 0)
+                association_tick = std::chrono::steady_clock::now();
+
+            int level_max = max_age_;
+            State states[2] = {State::Confirmed, State::Tentative};
+            auto& unmatched_boxes_index = unmatched_boxes_index_;
+            auto& unmatched_objects_index = unmatched_objects_index_;
+            unmatched_boxes_index.clear();
+            unmatched_objects_index.clear();
+            for (int i = 0; i < count; ++i) {
+                unmatched_boxes_index.push_back(i);
+            }
+            for (int i = 0; i < objects_.size(); ++i) {
+                unmatched_objects_index.push_back(i);
+            }
+            boxes_flags_.assign(count, 0);
+            objects_flags_.assign(objects_.size(), 0);
+
+            auto& match_boxes_index = match_boxes_index_;
+            auto& match_objects_index = match_objects_index_;
+            for (auto state : states) {
+                for (int level = 0; level < level_max; ++level) {
+                    if (unmatched_boxes_index.size() == 0 || unmatched_objects_index.size() == 0) {
+                        break;
+                    }
+                    auto& objects_index = objects_index_;
+                    objects_index.clear();
+                    for (auto index : unmatched_objects_index) {
+                        if (objects_[index]->time_since_update() == level + 1 &&
+                            objects_[index]->state() == state) {
+                            objects_index.push_back(index);
+                        }
+                    }
+                    if (objects_index.size() == 0) {
+                        continue;
+                    }
+                    depth = std::max(depth, level + 1);
+
+                    // match
+                    match_boxes_index.clear();
+                    match_objects_index.clear();
+                    this->match(objects_index, unmatched_boxes_index, boxes,
+                                match_boxes_index, match_objects_index);
+
+                    // 从未匹配列表中移除本轮匹配上的，保持升序
+                    remove_matched(unmatched_boxes_index, match_boxes_index, boxes_flags_);
+                    remove_matched(unmatched_objects_index, match_objects_index, objects_flags_);
+
+                    // update
+                    int count = std::min<int>(match_objects_index.size(), match_boxes_index.size());
+                    for (int i = 0; i < count; ++i) {
+                        auto& box = boxes[match_boxes_index[i]];
+                        auto obj = objects_[match_objects_index[i]];
+                        auto feature = feature_of(box);
+                        if(telemetry_enabled_ && feature == nullptr && obj->has_feature())
+                            ++ telemetry_.missing_features;
+                        obj->update(kalman_, box, feature);
+                    }
+                    if(telemetry_enabled_)
+                        telemetry_.matches += count;
+                }
+            }
+
+            if(telemetry_enabled_)
+                telemetry_.cascade_depth.add(depth);
+
+            if(association_budget_ms_ > 0)
+                update_association_mode(association_tick, objects_.size() * (size_t)count);
+
+            for (auto index : unmatched_objects_index) {
+                objects_[index]->mark_missed();
+            }
+            for (auto index : unmatched_boxes_index) {
+                this->new_object(boxes[index]);
+            }
+            remove_deleted();
+            return get_objects();
+        }
+
+        /**
+         * 超出预算时切换到贪心分配并记录当时的负载，负载回落到记录值的recover_ratio以下后恢复匈牙利算法。
+         * 降级期间每probe_interval帧让下一帧试用匈牙利算法，试用的耗时仍然超出预算才重新降级
+         */
+        void update_association_mode(const std::chrono::steady_clock::time_point& tick, size_t load) {
+
+            if(!degraded_){
+                double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tick).count();
+                if(elapsed > association_budget_ms_){
+                    degraded_ = true;
+                    degraded_load_ = load;
+                    degraded_updates_ = 0;
+                }
+            }else if(load < degraded_load_ * association_recover_ratio_ ||
+                     (association_probe_interval_ > 0 && ++ degraded_updates_ >= association_probe_interval_)){
+                degraded_ = false;
+            }
+        }
+
+        /* 按代价从小到大依次接受行列都未被占用的对，代价不小于distance_threshold的对不参与 */
+        void greedy_assignment(const std::vector<std::vector<double>> &cost, std::vector<int> &assignment) {
+
+            auto& pairs = greedy_pairs_;
+            pairs.clear();
+            int cols = 0;
+            for (int i = 0; i < cost.size(); ++i) {
+                cols = cost[i].size();
+                for (int j = 0; j < cols; ++j) {
+                    if (cost[i][j] < distance_threshold_)
+                        pairs.emplace_back(cost[i][j], i * cols + j);
+                }
+            }
+            std::sort(pairs.begin(), pairs.end());
+
+            assignment.assign(cost.size(), -1);
+            auto& taken = greedy_taken_;
+            taken.assign(cols, 0);
+            for (auto& pair : pairs) {
+                int row = pair.second / cols;
+                int col = pair.second % cols;
+                if (assignment[row] >= 0 || taken[col])
+                    continue;
+
+                assignment[row] = col;
+                taken[col] = 1;
+            }
+        }
+
+        /* 通过filter的框收集到复用的数组中，不产生内存分配，feature_row为其在通过filter的框中的序号 */
+        virtual const std::vector<TrackObject *>& update(const BoxSpan& span, const FeatureMatrix& features, const BoxFilter& filter, float dt) override{
+
+            auto& boxes = span_boxes_;
+            boxes.clear();
+            for (int i = 0; i < span.count; ++i) {
+                if (filter && !filter(i))
+                    continue;
+                boxes.push_back(span.box(i, boxes.size()));
+            }
+            return update(boxes.data(), boxes.size(), features, dt);
+        }
+
+        static void remove_matched(std::vector<int> &unmatched, const std::vector<int> &matched, std::vector<char> &flags) {
+            for (auto index : matched)
+                flags[index] = 1;
+
+            unmatched.erase(std::remove_if(unmatched.begin(), unmatched.end(), [&](int index){return flags[index];}), unmatched.end());
+
+            for (auto index : matched)
+                flags[index] = 0;
+        }
+
+        const float* feature_of(const Box &box) const {
+            if(box.feature_row < 0 || box.feature_row >= features_.rows || features_.empty())
+                return nullptr;
+            return features_.row(box.feature_row);
+        }
+
+        void match(const std::vector<int> &objects_index,
+                const std::vector<int> &boxes_index,
+                const Box* boxes,
+                std::vector<int> &match_boxes_index,
+                std::vector<int> &match_objects_index) {
+            std::vector<std::vector<double>> cost_matrix_data;
+            int gated = 0;
+            for (auto obj_idx : objects_index) {
+                std::vector<double> cost_matrix_item;
+                Box predicted;
+                if (degraded_)
+                    predicted = objects_[obj_idx]->predict_box();
+
+                for (auto box_idx : boxes_index) {
+                    auto &TrackObject = *objects_[obj_idx];
+                    auto &box = boxes[box_idx];
+
+                    // 降级时不计算马氏距离，与预测框不相交的对直接排除
+                    bool is_gated = false;
+                    if (degraded_) {
+                        is_gated = !overlap(predicted, box);
+                    }else{
+                        auto maha_distance = kalman_.ma_distance(
+                            TrackObject.get_mean(), TrackObject.get_covariance(),
+                            BBoxXYAH(box), false
+                        );
+                        is_gated = maha_distance > chi2inv95_2[3];
+                    }
+
+                    double cost_data = 0;
+                    if (is_gated) {
+                        cost_data = 1e5;
+                        ++ gated;
+                    }
+                    else {
+                        const float* feature = feature_of(box);
+                        if(has_feature_ && feature != nullptr){
+                            cost_data = TrackObject.appearance_distance(feature);
+                        }else{
+                            cost_data = distance(TrackObject.last_position(), box);
+                        }
+                    }
+                    cost_matrix_item.push_back(cost_data);
+                }
+                cost_matrix_data.push_back(cost_matrix_item);
+            }
+
+            HungarianAlgorithm HungAlgo;
+            std::vector<int> assignment;
+            std::chrono::steady_clock::time_point tick;
+            if(telemetry_enabled_)
+                tick = std::chrono::steady_clock::now();
+
+            if(degraded_)
+                greedy_assignment(cost_matrix_data, assignment);
+            else
+                HungAlgo.Solve(cost_matrix_data, assignment);
+
+            if(telemetry_enabled_){
+                double elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - tick).count();
+                size_t pairs = objects_index.size() * boxes_index.size();
+                ++ telemetry_.cascade_rounds;
+                telemetry_.pairs_total += pairs;
+                telemetry_.pairs_gated += gated;
+                telemetry_.cost_matrix_size.add(pairs);
+                telemetry_.solver_time_us.add(elapsed);
+            }
+
+            for (int i = 0; i < assignment.size(); ++i) {
+                if (assignment[i] < 0) {
+                    continue;
+                }
+                int obj_index = objects_index[i];
+                int box_index = boxes_index[assignment[i]];
+                if (cost_matrix_data[i][assignment[i]] < distance_threshold_) {
+                    match_boxes_index.push_back(box_index);
+                    match_objects_index.push_back(obj_index);
+                }else if(telemetry_enabled_){
+                    ++ telemetry_.pairs_rejected;
+                }
+            }
+        }
+
+        /* 在已删除轨迹的索引中查找，找到则返回旧id并将其移出索引，否则返回0 */
+        int reidentify(const float *feature) {
+            if(!reid_index_ || feature == nullptr)
+                return 0;
+
+            ReIDMatch match;
+            if(reid_index_->search(feature, 1, &match) == 0 || match.distance >= reid_threshold_)
+                return 0;
+
+            reid_index_->remove(match.id);
+            return match.id;
+        }
+
+        void retire(const TrackObjectImpl &obj) {
+            if(!has_feature_ || reid_capacity_ < 1 || !obj.ever_confirmed())
+                return;
+
+            if(!obj.mean_feature(retired_feature_))
+                return;
+
+            if(!reid_index_){
+                ReIDIndexConfig config;
+                config.dim      = retired_feature_.size();
+                config.capacity = reid_capacity_;
+                config.max_age  = reid_max_age_;
+                reid_index_     = create_reid_index(config);
+                if(!reid_index_){
+                    reid_capacity_ = 0;
+                    return;
+                }
+            }
+            reid_index_->insert(obj.id(), retired_feature_.data(), frame_id_);
+        }
+
+        void new_object(const Box &box) {
+            Eigen::Matrix<float, 8, 1> mean;
+            Eigen::Matrix<float, 8, 8> covariance;
+            kalman_.initiate(BBoxXYAH(box), mean, covariance);
+
+            const float* feature = feature_of(box);
+            int id = reidentify(feature);
+            bool reidentified = id != 0;
+            if(!reidentified)
+                id = id_next_++;
+
+            if(telemetry_enabled_){
+                ++ telemetry_.new_objects;
+                if(reidentified)
+                    ++ telemetry_.reidentified;
+            }
+
+            int slot = 0;
+            if(free_slots_.empty()){
+                slot = pool_.size();
+                pool_.emplace_back(box, feature, features_.cols, mean, covariance, id, config_);
+            }else{
+                slot = free_slots_.back();
+                free_slots_.pop_back();
+                pool_[slot] = TrackObjectImpl(box, feature, features_.cols, mean, covariance, id, config_);
+            }
+
+            auto obj = &pool_[slot];
+            obj->set_slot(slot);
+            if(reidentified)
+                obj->mark_reidentified();
+            objects_.push_back(obj);
+        }
+
+        /* 原地删除Deleted状态的轨迹，其槽位归还给空闲链表，存活轨迹不发生任何拷贝 */
+        void remove_deleted() {
+            auto end = std::remove_if(objects_.begin(), objects_.end(),
+                [this](TrackObjectImpl *obj){
+                    if(obj->state() != State::Deleted)
+                        return false;
+
+                    retire(*obj);
+                    free_slots_.push_back(obj->slot());
+                    if(telemetry_enabled_)
+                        ++ telemetry_.deleted_objects;
+                    return true;
+                }
+            );
+            objects_.erase(end, objects_.end());
+        }
+
+    private:
+        int id_next_{1};
+
+        // 轨迹对象池，std::deque在尾部追加时不会移动已有元素，因此每个轨迹的地址在其生命周期内保持不变
+        std::deque<TrackObjectImpl> pool_;
+        std::vector<int> free_slots_;
+        std::vector<TrackObjectImpl*> objects_;
+        std::vector<TrackObject*> output_;
+        Config config_;
+        KalmanFilter kalman_;
+        float distance_threshold_ = 0;
+        int max_age_ = 100;
+        int nhit_ = 3;
+        bool has_feature_ = false;
+
+        // 每帧复用的临时数组
+        FeatureMatrix features_;
+        std::vector<Box> span_boxes_;
+        std::vector<int> unmatched_boxes_index_, unmatched_objects_index_;
+        std::vector<int> match_boxes_index_, match_objects_index_;
+        std::vector<int> objects_index_;
+        std::vector<char> boxes_flags_, objects_flags_;
+
+        int frame_id_ = 0;
+        int reid_capacity_ = 0;
+        int reid_max_age_ = 3000;
+        float reid_threshold_ = 0.2;
+        std::vector<float> retired_feature_;
+        std::shared_ptr<ReIDIndex> reid_index_;
+
+        float association_budget_ms_ = 0;
+        float association_recover_ratio_ = 0.7;
+        int association_probe_interval_ = 30;
+        bool degraded_ = false;
+        size_t degraded_load_ = 0;
+        int degraded_updates_ = 0;
+        std::vector<std::pair<double, int>> greedy_pairs_;
+        std::vector<char> greedy_taken_;
+
+        bool telemetry_enabled_ = false;
+        Telemetry telemetry_;
+    };
+
+    std::shared_ptr<Tracker> create_tracker(const Config& config) {
+
+        if(config.has_feature && config.feature_mode == FeatureMode::Bucket && config.nbuckets < 1 || config.max_age < 1 || config.nhit < 1){
+            printf("Invalid argument has_feature = %s, nbuckets = %d, max_age = %d, nhit = %d\n", config.has_feature ? "True":"False", config.nbuckets, config.max_age, config.nhit);
+            return nullptr;
+        }
+
+        if(config.feature_mode == FeatureMode::EMA && (config.ema_alpha < 0 || config.ema_alpha >= 1 || config.ema_topk < 0)){
+            printf("Invalid argument ema_alpha = %f, ema_topk = %d\n", config.ema_alpha, config.ema_topk);
+            return nullptr;
+        }
+
+        std::shared_ptr<TrackerImpl> tracker_ptr(new TrackerImpl(
+            config
+        ));
+        return tracker_ptr;
+    }
+}; // namespace core
+}; // namespace DeepSORT
@@ -0,0 +1,235 @@
+
+#ifndef DEEPSORT_CORE_HPP
+#define DEEPSORT_CORE_HPP
+
+#include <memory>
+#include <vector>
+#include <tuple>
+#include <functional>
+#include <cstring>
+#include <stdint.h>
+
+/**
+ * DeepSORT跟踪器核心，不依赖OpenCV
+ * 检测框为纯数据结构，feature以一个连续的float矩阵传入，每个框通过行号引用其feature，
+ * 传入检测结果的过程不做任何内存分配。OpenCV接口见deepsort.hpp
+ */
+namespace DeepSORT {
+
+// 轨迹线上的一个点，x为框中心，y为框底边
+struct TracePoint{
+    int x, y;
+};
+
+// 指向连续内存的只读视图，不拥有数据，在下一次Tracker::update之前有效
+template<typename _T>
+struct Span{
+    const _T* data = nullptr;
+    int size = 0;
+
+    Span() = default;
+    Span(const _T* data, int size):data(data), size(size){}
+    const _T* begin() const{return data;}
+    const _T* end() const{return data + size;}
+    const _T& operator[](int i) const{return data[i];}
+    bool empty() const{return size == 0;}
+};
+
+enum class State : int{
+    Tentative = 1,
+    Confirmed = 2,
+    Deleted   = 3
+};
+
+// 外观特征的保存方式
+enum class FeatureMode : int{
+    Bucket = 0,   // 保存最近nbuckets个feature，匹配时逐行比较取最大相似度
+    EMA    = 1    // 保存指数滑动平均并归一化的feature，匹配时只做一次点积
+};
+
+struct Config{
+
+    int max_age  = 150;
+    int nhit     = 5;
+    float distance_threshold = 1000;
+    int nbuckets = 0;
+    bool has_feature = false;
+
+    // 长时重识别，has_feature且reid_capacity > 0时启用
+    // 轨迹被删除后其feature_bucket的平均embedding进入ANN索引，新目标分配id之前先在索引中查找
+    int reid_capacity = 0;         // 索引最多保存的已删除轨迹数量
+    int reid_max_age  = 3000;      // 已删除轨迹在索引中保留的帧数
+    float reid_threshold = 0.2;    // 余弦距离小于该值时沿用旧id
+
+    // 外观特征模式，EMA模式下nbuckets只决定轨迹长度
+    FeatureMode feature_mode = FeatureMode::Bucket;
+    float ema_alpha = 0.9;         // ema = alpha * ema + (1 - alpha) * feature
+    int ema_topk    = 0;           // EMA模式下额外保存最近的k个feature，相似度取两者最大值
+
+    // 收集匹配过程的统计信息，见Tracker::telemetry，关闭时不做任何统计
+    bool telemetry = false;
+
+    // 关联耗时预算，毫秒，0为不限制。某帧的匹配级联耗时超过预算后，之后的帧以"与预测框相交"代替马氏距离门限，
+    // 并用贪心最近邻分配代替匈牙利算法。轨迹数x检测框数回落到触发时的association_recover_ratio以下时立即恢复，
+    // 否则每association_probe_interval帧试用一次匈牙利算法，耗时在预算内就恢复，一次偶然的超时不会一直降级
+    float association_budget_ms     = 0;
+    float association_recover_ratio = 0.7;
+    int association_probe_interval  = 30;
+
+    // kalman
+    // /** 初始状态 **/
+    float initiate_state[8];
+
+    // /** 每一侦的运动量协方差，下一侦 = 当前帧 + 运动量 **/
+    float per_frame_motion[8];
+
+    // /** 测量噪声，把输入映射到测量空间中后的噪声 **/
+    float noise[4];
+
+    Config& set_initiate_state(const std::vector<float>& values);
+    Config& set_per_frame_motion(const std::vector<float>& values);
+    Config& set_noise(const std::vector<float>& values);
+
+    Config();
+};
+
+std::tuple<uint8_t, uint8_t, uint8_t> get_color(int idx);
+
+// 以2的幂为边界的直方图，bins[0]统计[0, 1)，bins[i]统计[2^(i-1), 2^i)，最后一个bin包含所有更大的值
+struct Histogram{
+    static const int NumBins = 24;
+
+    uint64_t bins[NumBins] = {0};
+    uint64_t count = 0;
+    double sum = 0;
+    double max = 0;
+
+    void add(double value);
+    double mean() const{return count > 0 ? sum / count : 0;}
+    // 按bin上界估计的分位数，q取值[0, 1]
+    double percentile(double q) const;
+};
+
+// 匹配级联的统计，从create_tracker或上一次reset_telemetry开始累计
+struct Telemetry{
+    uint64_t frames            = 0;
+    uint64_t predicted_frames  = 0;   // 没有检测结果、只做预测的帧
+    uint64_t detections        = 0;
+    uint64_t matches           = 0;   // 级联中匹配上的检测框数量
+    uint64_t new_objects       = 0;
+    uint64_t reidentified      = 0;   // 新目标通过重识别沿用旧id的次数
+    uint64_t deleted_objects   = 0;
+    uint64_t cascade_rounds    = 0;   // 实际构建代价矩阵并求解的轮数
+    uint64_t pairs_total       = 0;   // 参与计算的(轨迹, 检测框)对
+    uint64_t pairs_gated       = 0;   // 被马氏距离门限排除的对
+    uint64_t pairs_rejected    = 0;   // 求解后代价超过distance_threshold而被丢弃的分配
+    uint64_t missing_features  = 0;   // has_feature但检测框没有feature，该轨迹随后不再使用外观特征
+    uint64_t degraded_frames   = 0;   // 超出association_budget_ms后以贪心分配完成匹配的帧
+
+    Histogram cascade_depth;          // 每帧级联达到的最大level(Confirmed与Tentative两轮中较大者)
+    Histogram cost_matrix_size;       // 每轮代价矩阵的元素个数
+    Histogram solver_time_us;         // 每轮匈牙利算法的耗时，微秒
+
+    double match_rate() const{return detections > 0 ? double(matches) / detections : 0;}
+    double gated_rate() const{return pairs_total > 0 ? double(pairs_gated) / pairs_total : 0;}
+};
+
+namespace core {
+
+struct Box{
+    float left, top, right, bottom;
+    int feature_row;    // 在FeatureMatrix中的行号，-1表示没有feature
+
+    Box() = default;
+    Box(float left, float top, float right, float bottom, int feature_row = -1)
+        :left(left), top(top), right(right), bottom(bottom), feature_row(feature_row){}
+    float width() const{return right - left;}
+    float height() const{return bottom - top;}
+    float center_x() const{return (left + right) / 2;}
+    float center_y() const{return (top + bottom) / 2;}
+};
+
+// 外部检测框数组的带步长视图，各字段为相对元素起始地址的字节偏移，update直接从中读取
+struct BoxSpan{
+    const char* data = nullptr;
+    int count  = 0;
+    int stride = 0;                              // 相邻两个元素之间的字节数
+    int left = 0, top = 4, right = 8, bottom = 12;
+    bool tlwh  = false;                          // right、bottom偏移处保存的是width、height
+
+    BoxSpan() = default;
+    BoxSpan(const void* data, int count, int stride, int left, int top, int right, int bottom, bool tlwh = false)
+        :data((const char*)data), count(count), stride(stride), left(left), top(top), right(right), bottom(bottom), tlwh(tlwh){}
+
+    float field(int i, int offset) const{
+        float value;
+        memcpy(&value, data + (size_t)i * stride + offset, sizeof(value));
+        return value;
+    }
+
+    Box box(int i, int feature_row = -1) const{
+        float l = field(i, left), t = field(i, top), r = field(i, right), b = field(i, bottom);
+        return tlwh ? Box(l, t, l + r, t + b, feature_row) : Box(l, t, r, b, feature_row);
+    }
+};
+
+// 返回false的框不参与跟踪
+typedef std::function<bool(int index)> BoxFilter;
+
+// 行优先的float矩阵视图，stride为相邻两行之间的float个数
+struct FeatureMatrix{
+    const float* data = nullptr;
+    int rows   = 0;
+    int cols   = 0;
+    int stride = 0;
+
+    FeatureMatrix() = default;
+    FeatureMatrix(const float* data, int rows, int cols, int stride = 0)
+        :data(data), rows(rows), cols(cols), stride(stride > 0 ? stride : cols){}
+    const float* row(int i) const{return data + (size_t)i * stride;}
+    bool empty() const{return data == nullptr || rows == 0 || cols == 0;}
+};
+
+class TrackObject{
+public:
+    virtual int id() const = 0;
+    // 在tracker对象池中的槽位，轨迹存活期间不变，可用于关联外部数据
+    virtual int slot() const = 0;
+    virtual State state() const = 0;
+    virtual Box predict_box() const = 0;
+    virtual Box last_position() const = 0;
+    virtual bool is_confirmed() const = 0;
+    virtual int time_since_update() const = 0;
+    virtual Span<TracePoint> trace() const = 0;
+    virtual int trace_size() const = 0;
+    virtual Box location(int time_since_update=0) const = 0;
+    virtual FeatureMatrix feature_bucket() const = 0;
+    virtual FeatureMatrix ema_feature() const = 0;
+};
+
+class Tracker{
+public:
+    // boxes[i].feature_row引用features中的行，返回的数组及其中的指针在下一次update之前有效，
+    // 指针本身跨帧有效，直到该轨迹被删除后槽位被复用
+    // dt为距离上一次update/predict的时间，以帧为单位，可以是小数
+    virtual const std::vector<TrackObject *>& update(const Box* boxes, int count, const FeatureMatrix& features = FeatureMatrix(), float dt = 1) = 0;
+
+    // 直接读取调用方的检测框数组，features的第k行对应第k个通过filter的框
+    virtual const std::vector<TrackObject *>& update(const BoxSpan& boxes, const FeatureMatrix& features = FeatureMatrix(), const BoxFilter& filter = nullptr, float dt = 1) = 0;
+
+    // 没有检测结果的帧(检测器跳帧)只做预测，不会因为缺少检测而删除Tentative轨迹
+    virtual const std::vector<TrackObject *>& predict(float dt = 1) = 0;
+
+    // Config::telemetry为false时始终为空
+    virtual const Telemetry& telemetry() const = 0;
+    virtual void reset_telemetry() = 0;
+};
+
+std::shared_ptr<Tracker> create_tracker(
+    const Config& config = Config()
+);
+
+}; // namespace core
+}; // namespace DeepSORT
+
+#endif // DEEPSORT_CORE_HPP
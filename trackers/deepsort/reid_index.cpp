@@ -0,0 +1,520 @@
+#include "reid_index.hpp"
+
+#include <vector>
+#include <queue>
+#include <unordered_map>
+#include <algorithm>
+#include <functional>
+#include <random>
+#include <cmath>
+#include <cstring>
+#include <stdio.h>
+
+namespace DeepSORT {
+
+    class HNSWIndex : public ReIDIndex
+    {
+    public:
+        HNSWIndex(const ReIDIndexConfig& config):config_(config), rng_(100){
+            max_links0_ = config_.M * 2;
+            level_mult_ = 1 / std::log((double)std::max(config_.M, 2));
+
+            data_.resize((size_t)config_.capacity * config_.dim);
+            links0_.resize((size_t)config_.capacity * (max_links0_ + 1), 0);
+            upper_links_.resize(config_.capacity);
+            nodes_.resize(config_.capacity);
+            visited_.resize(config_.capacity, 0);
+            query_.resize(config_.dim);
+            id_to_slot_.reserve(config_.capacity);
+        }
+
+        virtual void insert(int id, const float* feature, int timestamp) override{
+
+            remove(id);
+            if(used_ == config_.capacity)
+                make_room();
+
+            int slot = used_++;
+            float* v = vec(slot);
+            memcpy(v, feature, sizeof(float) * config_.dim);
+            normalize(v);
+
+            Node& node    = nodes_[slot];
+            node.id        = id;
+            node.timestamp = timestamp;
+            node.level     = random_level();
+            node.deleted   = false;
+            id_to_slot_[id] = slot;
+            ++ live_;
+
+            reset_links(slot);
+            link(slot);
+        }
+
+        virtual int search(const float* feature, int k, ReIDMatch* matches) override{
+
+            if(live_ == 0 || k < 1)
+                return 0;
+
+            memcpy(query_.data(), feature, sizeof(float) * config_.dim);
+            normalize(query_.data());
+
+            const float* q = query_.data();
+            int cur = entry_;
+            float dcur = distance(q, vec(cur));
+            for(int level = max_level_; level > 0; --level)
+                greedy(q, level, cur, dcur);
+
+            search_layer(q, cur, std::max(config_.ef_search, k), 0, true, candidates_);
+
+            int count = std::min<int>(k, candidates_.size());
+            for(int i = 0; i < count; ++i){
+                matches[i].id = nodes_[candidates_[i].second].id;
+                matches[i].distance = candidates_[i].first;
+            }
+            return count;
+        }
+
+        virtual bool remove(int id) override{
+            auto iter = id_to_slot_.find(id);
+            if(iter == id_to_slot_.end())
+                return false;
+
+            mark_deleted(iter->second);
+            return true;
+        }
+
+        virtual void evict(int timestamp) override{
+
+            // slot按插入顺序分配，时间戳单调不减，因此从最旧的slot开始向后扫描即可
+            const int expire = timestamp - config_.max_age;
+            while(oldest_ < used_ && (nodes_[oldest_].deleted || nodes_[oldest_].timestamp < expire)){
+                if(!nodes_[oldest_].deleted)
+                    mark_deleted(oldest_);
+                ++ oldest_;
+            }
+
+            if(live_ == 0)
+                clear();
+        }
+
+        virtual int size() const override{
+            return live_;
+        }
+
+        virtual size_t memory_bytes() const override{
+            size_t bytes = data_.size() * sizeof(float) + links0_.size() * sizeof(int)
+                + nodes_.size() * sizeof(Node) + visited_.size() * sizeof(unsigned int)
+                + id_to_slot_.bucket_count() * sizeof(void*) + id_to_slot_.size() * (sizeof(void*) + 2 * sizeof(int));
+            for(auto& links : upper_links_)
+                bytes += links.capacity() * sizeof(int);
+            return bytes;
+        }
+
+    private:
+        typedef std::pair<float, int> DistSlot;
+
+        struct Node{
+            int id;
+            int timestamp;
+            int level;
+            bool deleted;
+        };
+
+        float* vec(int slot){return data_.data() + (size_t)slot * config_.dim;}
+
+        // 第一个元素为邻居数量，其后为邻居slot
+        int* links(int slot, int level){
+            if(level == 0)
+                return links0_.data() + (size_t)slot * (max_links0_ + 1);
+            return upper_links_[slot].data() + (level - 1) * (config_.M + 1);
+        }
+
+        float distance(const float* a, const float* b) const{
+            float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+            int i = 0;
+            for(; i + 4 <= config_.dim; i += 4){
+                s0 += a[i] * b[i];
+                s1 += a[i + 1] * b[i + 1];
+                s2 += a[i + 2] * b[i + 2];
+                s3 += a[i + 3] * b[i + 3];
+            }
+            for(; i < config_.dim; ++i)
+                s0 += a[i] * b[i];
+            return 1 - (s0 + s1 + s2 + s3);
+        }
+
+        void normalize(float* v) const{
+            float norm = 0;
+            for(int i = 0; i < config_.dim; ++i)
+                norm += v[i] * v[i];
+
+            norm = std::sqrt(norm);
+            if(norm < 1e-12f) return;
+
+            for(int i = 0; i < config_.dim; ++i)
+                v[i] /= norm;
+        }
+
+        int random_level(){
+            std::uniform_real_distribution<double> uniform(0.0, 1.0);
+            double r = std::max(uniform(rng_), 1e-9);
+            return std::min(16, (int)(-std::log(r) * level_mult_));
+        }
+
+        void reset_links(int slot){
+            links0_[(size_t)slot * (max_links0_ + 1)] = 0;
+            upper_links_[slot].assign(nodes_[slot].level * (config_.M + 1), 0);
+        }
+
+        void mark_deleted(int slot){
+            nodes_[slot].deleted = true;
+            id_to_slot_.erase(nodes_[slot].id);
+            -- live_;
+        }
+
+        void clear(){
+            for(int i = 0; i < used_; ++i)
+                std::vector<int>().swap(upper_links_[i]);
+
+            id_to_slot_.clear();
+            used_      = 0;
+            live_      = 0;
+            oldest_    = 0;
+            entry_     = -1;
+            max_level_ = 0;
+        }
+
+        /**
+         * 容量用尽：已删除的节点不足capacity/4时从最旧的存活节点开始淘汰补足，每次至少空出capacity/4个slot。
+         * 已删除的节点超过一半时重建图，否则只压缩并修补失去的边，不会因为零星的删除而每次插入都重建
+         */
+        void make_room(){
+
+            const int target = std::max(1, config_.capacity / 4);
+            for(int i = oldest_; i < used_ && used_ - live_ < target; ++i){
+                if(!nodes_[i].deleted)
+                    mark_deleted(i);
+            }
+
+            if((used_ - live_) * 2 > used_)
+                rebuild();
+            else
+                compact();
+        }
+
+        /* 把存活节点压缩到前面并逐个重新插入 */
+        void rebuild(){
+
+            int n = 0;
+            for(int i = 0; i < used_; ++i){
+                if(nodes_[i].deleted) continue;
+
+                if(i != n){
+                    memcpy(vec(n), vec(i), sizeof(float) * config_.dim);
+                    nodes_[n] = nodes_[i];
+                    id_to_slot_[nodes_[n].id] = n;
+                }
+                ++ n;
+            }
+
+            for(int i = n; i < used_; ++i)
+                std::vector<int>().swap(upper_links_[i]);
+
+            used_      = n;
+            oldest_    = 0;
+            entry_     = -1;
+            max_level_ = 0;
+            for(int i = 0; i < n; ++i){
+                reset_links(i);
+                link(i);
+            }
+        }
+
+        /**
+         * 存活节点失去邻居时，在原有的存活邻居和被删邻居的存活邻居中用启发式重新选择，然后压缩到前面。
+         * 只计算二跳候选的距离，不做ef_construction的搜索。新的邻居表先全部算好再搬移，避免读到已改写的表
+         */
+        void compact(){
+
+            remap_.assign(used_, -1);
+            int n = 0;
+            int entry = -1;
+            for(int i = 0; i < used_; ++i){
+                if(nodes_[i].deleted) continue;
+
+                remap_[i] = n++;
+                if(entry == -1 || nodes_[i].level > nodes_[entry].level)
+                    entry = i;
+            }
+
+            // 每个存活节点的每一层依次写入: 邻居数量, 邻居(新的slot)
+            repaired_.clear();
+            for(int i = 0; i < used_; ++i){
+                if(nodes_[i].deleted) continue;
+
+                const float* v = vec(i);
+                for(int level = 0; level <= nodes_[i].level; ++level){
+
+                    const int max_links = level == 0 ? max_links0_ : config_.M;
+                    if(++visit_tag_ == 0){
+                        std::fill(visited_.begin(), visited_.end(), 0);
+                        visit_tag_ = 1;
+                    }
+                    visited_[i] = visit_tag_;
+
+                    int* l = links(i, level);
+                    bool lost = false;
+                    overflow_.clear();
+                    for(int k = 1; k <= l[0]; ++k){
+                        int j = l[k];
+                        if(visited_[j] == visit_tag_) continue;
+                        visited_[j] = visit_tag_;
+
+                        if(!nodes_[j].deleted){
+                            overflow_.emplace_back(-1, j);
+                            continue;
+                        }
+
+                        lost = true;
+                        int* lj = links(j, level);
+                        for(int m = 1; m <= lj[0]; ++m){
+                            int c = lj[m];
+                            if(nodes_[c].deleted || visited_[c] == visit_tag_) continue;
+                            visited_[c] = visit_tag_;
+                            overflow_.emplace_back(-1, c);
+                        }
+                    }
+
+                    // 没有失去邻居的表原样保留，否则在原有的存活邻居和二跳候选中用启发式重新选择
+                    if(lost){
+                        for(auto& c : overflow_)
+                            c.first = distance(v, vec(c.second));
+                        std::sort(overflow_.begin(), overflow_.end());
+                        select_neighbors(overflow_, max_links);
+                    }
+
+                    repaired_.push_back(overflow_.size());
+                    for(auto& c : overflow_)
+                        repaired_.push_back(remap_[c.second]);
+                }
+            }
+
+            const int* p = repaired_.data();
+            for(int i = 0; i < used_; ++i){
+                if(nodes_[i].deleted) continue;
+
+                int slot = remap_[i];
+                if(slot != i){
+                    memcpy(vec(slot), vec(i), sizeof(float) * config_.dim);
+                    nodes_[slot] = nodes_[i];
+                    upper_links_[slot].swap(upper_links_[i]);
+                    id_to_slot_[nodes_[slot].id] = slot;
+                }
+
+                for(int level = 0; level <= nodes_[slot].level; ++level){
+                    int* l = links(slot, level);
+                    memcpy(l, p, sizeof(int) * (p[0] + 1));
+                    p += p[0] + 1;
+                }
+            }
+
+            for(int i = n; i < used_; ++i)
+                std::vector<int>().swap(upper_links_[i]);
+
+            used_      = n;
+            oldest_    = 0;
+            entry_     = entry == -1 ? -1 : remap_[entry];
+            max_level_ = entry == -1 ? 0 : nodes_[entry_].level;
+        }
+
+        void greedy(const float* q, int level, int& cur, float& dcur){
+            bool changed = true;
+            while(changed){
+                changed = false;
+                int* l = links(cur, level);
+                for(int i = 1; i <= l[0]; ++i){
+                    float d = distance(q, vec(l[i]));
+                    if(d < dcur){
+                        dcur = d;
+                        cur = l[i];
+                        changed = true;
+                    }
+                }
+            }
+        }
+
+        /**
+         * @brief 在指定层上做best-first搜索，结果按距离升序写入output
+         * skip_deleted为true时已删除的节点只参与路由，不出现在结果中
+         */
+        void search_layer(const float* q, int entry, int ef, int level, bool skip_deleted, std::vector<DistSlot>& output){
+
+            if(++visit_tag_ == 0){
+                std::fill(visited_.begin(), visited_.end(), 0);
+                visit_tag_ = 1;
+            }
+
+            std::priority_queue<DistSlot> top;
+            std::priority_queue<DistSlot, std::vector<DistSlot>, std::greater<DistSlot>> candidates;
+
+            float d = distance(q, vec(entry));
+            visited_[entry] = visit_tag_;
+            candidates.emplace(d, entry);
+            if(!skip_deleted || !nodes_[entry].deleted)
+                top.emplace(d, entry);
+
+            while(!candidates.empty()){
+                auto current = candidates.top();
+                if((int)top.size() >= ef && current.first > top.top().first)
+                    break;
+                candidates.pop();
+
+                int* l = links(current.second, level);
+                for(int i = 1; i <= l[0]; ++i){
+                    int n = l[i];
+                    if(visited_[n] == visit_tag_) continue;
+                    visited_[n] = visit_tag_;
+
+                    float dn = distance(q, vec(n));
+                    if((int)top.size() < ef || dn < top.top().first){
+                        candidates.emplace(dn, n);
+                        if(!skip_deleted || !nodes_[n].deleted){
+                            top.emplace(dn, n);
+                            if((int)top.size() > ef)
+                                top.pop();
+                        }
+                    }
+                }
+            }
+
+            output.resize(top.size());
+            for(int i = (int)top.size() - 1; i >= 0; --i){
+                output[i] = top.top();
+                top.pop();
+            }
+        }
+
+        /**
+         * @brief HNSW启发式邻居选择
+         * candidates按到基准点的距离升序排列，只有当候选点到基准点比到所有已选邻居都近时才保留，
+         * 这样邻居在方向上更分散，图的可导航性比简单取最近的M个好得多
+         */
+        void select_neighbors(std::vector<DistSlot>& candidates, int max_links){
+            int selected = 0;
+            for(int i = 0; i < candidates.size() && selected < max_links; ++i){
+                const float* v = vec(candidates[i].second);
+                bool keep = true;
+                for(int j = 0; j < selected; ++j){
+                    if(distance(v, vec(candidates[j].second)) < candidates[i].first){
+                        keep = false;
+                        break;
+                    }
+                }
+                if(keep)
+                    candidates[selected++] = candidates[i];
+            }
+            candidates.resize(selected);
+        }
+
+        void add_link(int from, int to, int level){
+            const int max_links = level == 0 ? max_links0_ : config_.M;
+            int* l = links(from, level);
+            if(l[0] < max_links){
+                l[++l[0]] = to;
+                return;
+            }
+
+            // 邻居已满，在原邻居和新节点中重新选择
+            const float* v = vec(from);
+            overflow_.clear();
+            overflow_.emplace_back(distance(v, vec(to)), to);
+            for(int i = 1; i <= l[0]; ++i)
+                overflow_.emplace_back(distance(v, vec(l[i])), l[i]);
+
+            std::sort(overflow_.begin(), overflow_.end());
+            select_neighbors(overflow_, max_links);
+
+            l[0] = overflow_.size();
+            for(int i = 0; i < overflow_.size(); ++i)
+                l[i + 1] = overflow_[i].second;
+        }
+
+        void link(int slot){
+
+            const int level = nodes_[slot].level;
+            if(entry_ == -1){
+                entry_ = slot;
+                max_level_ = level;
+                return;
+            }
+
+            const float* q = vec(slot);
+            int cur = entry_;
+            float dcur = distance(q, vec(cur));
+            for(int l = max_level_; l > level; --l)
+                greedy(q, l, cur, dcur);
+
+            for(int l = std::min(level, max_level_); l >= 0; --l){
+                search_layer(q, cur, config_.ef_construction, l, false, candidates_);
+
+                if(!candidates_.empty())
+                    cur = candidates_[0].second;
+
+                select_neighbors(candidates_, config_.M);
+                int* own = links(slot, l);
+                own[0] = candidates_.size();
+                for(int i = 0; i < candidates_.size(); ++i)
+                    own[i + 1] = candidates_[i].second;
+
+                for(int i = 0; i < candidates_.size(); ++i)
+                    add_link(candidates_[i].second, slot, l);
+            }
+
+            if(level > max_level_){
+                max_level_ = level;
+                entry_ = slot;
+            }
+        }
+
+    private:
+        ReIDIndexConfig config_;
+        int max_links0_ = 0;
+        double level_mult_ = 0;
+        std::mt19937 rng_;
+
+        std::vector<float> data_;
+        std::vector<int> links0_;
+        std::vector<std::vector<int>> upper_links_;
+        std::vector<Node> nodes_;
+        std::unordered_map<int, int> id_to_slot_;
+
+        std::vector<unsigned int> visited_;
+        unsigned int visit_tag_ = 0;
+        std::vector<float> query_;
+        std::vector<DistSlot> candidates_;
+        std::vector<DistSlot> overflow_;
+        std::vector<int> remap_;
+        std::vector<int> repaired_;
+
+        int used_      = 0;
+        int live_      = 0;
+        int oldest_    = 0;
+        int entry_     = -1;
+        int max_level_ = 0;
+    };
+
+    std::shared_ptr<ReIDIndex> create_reid_index(const ReIDIndexConfig& config) {
+
+        if(config.dim < 1 || config.capacity < 1 || config.M < 2 || config.ef_construction < 1 || config.ef_search < 1){
+            printf("Invalid argument dim = %d, capacity = %d, M = %d, ef_construction = %d, ef_search = %d\n",
+                config.dim, config.capacity, config.M, config.ef_construction, config.ef_search);
+            return nullptr;
+        }
+
+        std::shared_ptr<HNSWIndex> index_ptr(new HNSWIndex(
+            config
+        ));
+        return index_ptr;
+    }
+};
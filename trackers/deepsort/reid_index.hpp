@@ -0,0 +1,50 @@
+
+#ifndef REID_INDEX_HPP
+#define REID_INDEX_HPP
+
+#include <memory>
+#include <vector>
+
+namespace DeepSORT {
+
+struct ReIDIndexConfig{
+
+    int dim             = 512;
+    int capacity        = 20000;   // 最多保存的embedding数量，内存在创建时一次性分配
+    int max_age         = 3000;    // 超过max_age帧的embedding会被淘汰
+
+    // HNSW参数
+    int M               = 16;      // 每层的邻居数，第0层为2*M
+    int ef_construction = 100;
+    int ef_search       = 64;
+};
+
+struct ReIDMatch{
+    int id;
+    float distance;    // 1 - cos
+};
+
+/**
+ * @brief 已退出跟踪的轨迹embedding的近似最近邻索引(HNSW)
+ *
+ * 插入和查询都是增量的，删除仅做标记，已删除节点仍参与路由。
+ * 当容量用尽时，已删除的节点不足capacity/4则淘汰最旧的embedding补足，再用剩余的存活节点重建图，
+ * 每次重建至少空出capacity/4个位置，因此内存始终以capacity为上限，重建的开销按插入次数均摊
+ */
+class ReIDIndex{
+public:
+    virtual void insert(int id, const float* feature, int timestamp) = 0;
+    virtual int search(const float* feature, int k, ReIDMatch* matches) = 0;
+    virtual bool remove(int id) = 0;
+    virtual void evict(int timestamp) = 0;
+    virtual int size() const = 0;
+    virtual size_t memory_bytes() const = 0;
+};
+
+std::shared_ptr<ReIDIndex> create_reid_index(
+    const ReIDIndexConfig& config = ReIDIndexConfig()
+);
+
+}
+
+#endif // REID_INDEX_HPP
@@ -0,0 +1,320 @@
+#include "mot_metrics.hpp"
+#include "tracklog/track_log.hpp"
+#include "bytetrack/lapjv.h"
+
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <utility>
+#include <cstring>
+#include <stdlib.h>
+#include <stdio.h>
+
+namespace Eval {
+
+    const Box* Sequence::frame(int frame, int& count) const{
+        int index = frame - first_frame_;
+        if(index < 0 || index >= num_frames()){
+            count = 0;
+            return nullptr;
+        }
+        count = offset_[index + 1] - offset_[index];
+        return boxes_.data() + offset_[index];
+    }
+
+    void Sequence::append(int frame, const Box& box){
+        if(boxes_.empty() && offset_.size() == 1)
+            first_frame_ = frame;
+
+        int index = frame - first_frame_;
+        while(offset_.size() < index + 2)
+            offset_.push_back(boxes_.size());
+
+        boxes_.push_back(box);
+        offset_.back() = boxes_.size();
+    }
+
+    static bool load_log(const std::string& file, bool ground_truth, std::vector<std::pair<int, Box>>& items){
+
+        auto reader = TrackLog::open_reader(file);
+        if(reader == nullptr)
+            return false;
+
+        reader->range(reader->first_frame(), reader->last_frame() + 1, [&](const TrackLog::FrameView& view){
+            for(int i = 0; i < view.count; ++i){
+                int id = view.track_id[i];
+                if(ground_truth != (id >= 0))
+                    continue;
+                items.emplace_back(view.frame, Box(view.left[i], view.top[i], view.right[i], view.bottom[i], view.score[i], id));
+            }
+        });
+        return true;
+    }
+
+    static bool load_text(const std::string& file, bool ground_truth, std::vector<std::pair<int, Box>>& items){
+
+        FILE* f = fopen(file.c_str(), "rb");
+        if(f == nullptr){
+            printf("Open %s failed.\n", file.c_str());
+            return false;
+        }
+
+        char line[512];
+        while(fgets(line, sizeof(line), f)){
+
+            int frame = 0, id = -1, label = 0;
+            float left, top, width, height, right, bottom, score = 1;
+            if(strchr(line, ',') != nullptr){
+                // MOTChallenge: frame,id,left,top,width,height,conf[,class,visibility]，真值中conf为是否参与评估的标记
+                int cls = 1;
+                int n = sscanf(line, "%d,%d,%f,%f,%f,%f,%f,%d", &frame, &id, &left, &top, &width, &height, &score, &cls);
+                if(n < 6)
+                    continue;
+
+                if(ground_truth){
+                    if(n >= 7 && score == 0) continue;
+                    if(n >= 8 && cls != 1) continue;
+                    score = 1;
+                }else{
+                    id = -1;
+                }
+                items.emplace_back(frame, Box(left, top, left + width, top + height, score, id));
+            }else{
+                int n = sscanf(line, "%d %f %f %f %f %f %d %d", &frame, &left, &top, &right, &bottom, &score, &label, &id);
+                if(n < 6)
+                    continue;
+
+                if(n < 8) id = -1;
+                if(ground_truth != (id >= 0))
+                    continue;
+                items.emplace_back(frame, Box(left, top, right, bottom, score, id));
+            }
+        }
+        fclose(f);
+        return true;
+    }
+
+    bool load_sequence(const std::string& file, bool ground_truth, Sequence& sequence){
+
+        std::vector<std::pair<int, Box>> items;
+        bool ok = TrackLog::is_log_file(file) ? load_log(file, ground_truth, items) : load_text(file, ground_truth, items);
+        if(!ok)
+            return false;
+
+        // MOTChallenge的真值按id排序，这里统一按帧号稳定排序
+        std::stable_sort(items.begin(), items.end(), [](const std::pair<int, Box>& a, const std::pair<int, Box>& b){
+            return a.first < b.first;
+        });
+
+        sequence = Sequence();
+        for(auto& item : items)
+            sequence.append(item.first, item.second);
+        return true;
+    }
+
+    static float iou(const Box& a, const Box& b){
+        float w = std::min(a.right, b.right) - std::max(a.left, b.left);
+        float h = std::min(a.bottom, b.bottom) - std::max(a.top, b.top);
+        if(w <= 0 || h <= 0)
+            return 0;
+
+        float inter = w * h;
+        float area = (a.right - a.left) * (a.bottom - a.top) + (b.right - b.left) * (b.bottom - b.top) - inter;
+        return area > 0 ? inter / area : 0;
+    }
+
+    /* 求解n x n的最小代价分配，rows[i]为第i行分配到的列 */
+    static bool solve_assignment(int n, std::vector<double>& cost, std::vector<int>& rows, std::vector<int>& cols){
+
+        std::vector<double*> ptrs(n);
+        for(int i = 0; i < n; ++i)
+            ptrs[i] = cost.data() + (size_t)i * n;
+
+        rows.resize(n);
+        cols.resize(n);
+        return lapjv_internal(n, ptrs.data(), rows.data(), cols.data()) == 0;
+    }
+
+    class AccumulatorImpl : public Accumulator{
+    public:
+        AccumulatorImpl(float iou_threshold):iou_threshold_(iou_threshold){}
+
+        virtual void update(const Box* gt, int num_gt, const Box* hyp, int num_hyp) override{
+
+            metrics_.frames++;
+            metrics_.num_gt  += num_gt;
+            metrics_.num_hyp += num_hyp;
+
+            gt_index_.resize(num_gt);
+            for(int i = 0; i < num_gt; ++i){
+                gt_index_[i] = dense_id(gt_ids_, gt[i].id, gt_frames_);
+                gt_frames_[gt_index_[i]]++;
+            }
+
+            hyp_index_.resize(num_hyp);
+            for(int j = 0; j < num_hyp; ++j){
+                hyp_index_[j] = dense_id(hyp_ids_, hyp[j].id, hyp_frames_);
+                hyp_frames_[hyp_index_[j]]++;
+            }
+            last_match_.resize(gt_frames_.size(), -1);
+
+            // IoU矩阵，同时统计IDF1所需的(gt id, hyp id)共现帧数
+            ious_.resize((size_t)num_gt * num_hyp);
+            for(int i = 0; i < num_gt; ++i){
+                for(int j = 0; j < num_hyp; ++j){
+                    float v = iou(gt[i], hyp[j]);
+                    ious_[i * num_hyp + j] = v;
+                    if(v >= iou_threshold_)
+                        pair_frames_[pair_key(gt_index_[i], hyp_index_[j])]++;
+                }
+            }
+
+            // 1. 上一帧的对应关系仍满足门限时保持不变
+            gt_match_.assign(num_gt, -1);
+            hyp_taken_.assign(num_hyp, 0);
+            for(int i = 0; i < num_gt; ++i){
+                int last = last_match_[gt_index_[i]];
+                if(last < 0)
+                    continue;
+
+                for(int j = 0; j < num_hyp; ++j){
+                    if(hyp_index_[j] == last && !hyp_taken_[j] && ious_[i * num_hyp + j] >= iou_threshold_){
+                        gt_match_[i] = j;
+                        hyp_taken_[j] = 1;
+                        break;
+                    }
+                }
+            }
+
+            // 2. 其余的按1 - IoU做最小代价分配
+            free_gt_.clear();
+            free_hyp_.clear();
+            for(int i = 0; i < num_gt; ++i)
+                if(gt_match_[i] < 0) free_gt_.push_back(i);
+            for(int j = 0; j < num_hyp; ++j)
+                if(!hyp_taken_[j]) free_hyp_.push_back(j);
+
+            int n = std::max(free_gt_.size(), free_hyp_.size());
+            if(!free_gt_.empty() && !free_hyp_.empty()){
+                cost_.assign((size_t)n * n, LARGE);
+                for(int a = 0; a < free_gt_.size(); ++a){
+                    for(int b = 0; b < free_hyp_.size(); ++b){
+                        float v = ious_[free_gt_[a] * num_hyp + free_hyp_[b]];
+                        if(v >= iou_threshold_)
+                            cost_[(size_t)a * n + b] = 1 - v;
+                    }
+                }
+
+                if(solve_assignment(n, cost_, rows_, cols_)){
+                    for(int a = 0; a < free_gt_.size(); ++a){
+                        int b = rows_[a];
+                        if(b < 0 || b >= free_hyp_.size())
+                            continue;
+
+                        int i = free_gt_[a], j = free_hyp_[b];
+                        if(ious_[i * num_hyp + j] < iou_threshold_)
+                            continue;
+
+                        gt_match_[i] = j;
+                        hyp_taken_[j] = 1;
+                        int last = last_match_[gt_index_[i]];
+                        if(last >= 0 && last != hyp_index_[j])
+                            metrics_.id_switches++;
+                    }
+                }
+            }
+
+            for(int i = 0; i < num_gt; ++i){
+                if(gt_match_[i] < 0){
+                    metrics_.fn++;
+                    continue;
+                }
+                metrics_.tp++;
+                last_match_[gt_index_[i]] = hyp_index_[gt_match_[i]];
+            }
+            metrics_.fp += num_hyp - std::count(hyp_taken_.begin(), hyp_taken_.end(), 1);
+        }
+
+        /* IDF1: 在(gt id, hyp id)之间求共现帧数之和最大的一一对应，idtp为该最大值 */
+        virtual Metrics finish() override{
+
+            metrics_.gt_ids  = gt_frames_.size();
+            metrics_.hyp_ids = hyp_frames_.size();
+            metrics_.idtp    = 0;
+            if(pair_frames_.empty())
+                return metrics_;
+
+            // 只有出现在共现表中的id参与求解
+            std::unordered_map<int, int> gt_remap, hyp_remap;
+            int max_frames = 0;
+            for(auto& item : pair_frames_){
+                gt_remap.insert(std::make_pair(int(item.first >> 32), (int)gt_remap.size()));
+                hyp_remap.insert(std::make_pair(int(item.first & 0xFFFFFFFF), (int)hyp_remap.size()));
+                max_frames = std::max(max_frames, item.second);
+            }
+
+            int n = std::max(gt_remap.size(), hyp_remap.size());
+            cost_.assign((size_t)n * n, max_frames);
+            for(auto& item : pair_frames_){
+                int a = gt_remap[int(item.first >> 32)];
+                int b = hyp_remap[int(item.first & 0xFFFFFFFF)];
+                cost_[(size_t)a * n + b] = max_frames - item.second;
+            }
+
+            if(!solve_assignment(n, cost_, rows_, cols_)){
+                printf("IDF1 assignment failed, %d x %d\n", (int)gt_remap.size(), (int)hyp_remap.size());
+                return metrics_;
+            }
+
+            for(int a = 0; a < n; ++a){
+                if(rows_[a] >= 0)
+                    metrics_.idtp += max_frames - (int64_t)cost_[(size_t)a * n + rows_[a]];
+            }
+            return metrics_;
+        }
+
+    private:
+        static int64_t pair_key(int gt, int hyp){
+            return ((int64_t)gt << 32) | (uint32_t)hyp;
+        }
+
+        static int dense_id(std::unordered_map<int, int>& ids, int id, std::vector<int>& frames){
+            auto it = ids.find(id);
+            if(it != ids.end())
+                return it->second;
+
+            int index = frames.size();
+            ids[id] = index;
+            frames.push_back(0);
+            return index;
+        }
+
+    private:
+        float iou_threshold_ = 0.5f;
+        Metrics metrics_;
+
+        std::unordered_map<int, int> gt_ids_, hyp_ids_;
+        std::vector<int> gt_frames_, hyp_frames_;
+        std::vector<int> last_match_;                    // 每个gt id上一次匹配的hyp id
+        std::unordered_map<int64_t, int> pair_frames_;
+
+        // 每帧复用的临时数组
+        std::vector<int> gt_index_, hyp_index_;
+        std::vector<float> ious_;
+        std::vector<int> gt_match_;
+        std::vector<char> hyp_taken_;
+        std::vector<int> free_gt_, free_hyp_;
+        std::vector<double> cost_;
+        std::vector<int> rows_, cols_;
+    };
+
+    std::shared_ptr<Accumulator> create_accumulator(float iou_threshold){
+
+        if(iou_threshold <= 0 || iou_threshold > 1){
+            printf("Invalid iou_threshold = %f\n", iou_threshold);
+            return nullptr;
+        }
+        return std::make_shared<AccumulatorImpl>(iou_threshold);
+    }
+
+}; // namespace Eval
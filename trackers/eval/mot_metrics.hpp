@@ -0,0 +1,84 @@
+
+#ifndef MOT_METRICS_HPP
+#define MOT_METRICS_HPP
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/**
+ * 离线评估用的标注序列与MOT指标
+ * CLEAR MOT(MOTA、ID switch)与IDF1的定义与MOTChallenge的评估脚本一致，匹配门限为IoU >= iou_threshold
+ */
+namespace Eval {
+
+struct Box{
+    float left, top, right, bottom;
+    float score = 1;
+    int id      = -1;    // 检测结果为-1
+
+    Box() = default;
+    Box(float left, float top, float right, float bottom, float score = 1, int id = -1)
+        :left(left), top(top), right(right), bottom(bottom), score(score), id(id){}
+};
+
+/* 按帧组织的只读序列，加载一次后在所有线程间共享 */
+class Sequence{
+public:
+    int first_frame() const{return first_frame_;}
+    int last_frame() const{return first_frame_ + (int)offset_.size() - 2;}
+    int num_frames() const{return offset_.size() - 1;}
+    size_t num_boxes() const{return boxes_.size();}
+    bool empty() const{return boxes_.empty();}
+
+    // 不在范围内的帧返回count = 0
+    const Box* frame(int frame, int& count) const;
+
+    // 按帧序追加，frame必须不小于上一次追加的帧
+    void append(int frame, const Box& box);
+
+private:
+    int first_frame_ = 0;
+    std::vector<int> offset_{0};
+    std::vector<Box> boxes_;
+};
+
+/**
+ * @brief 加载检测结果或真值
+ *   TrackLog二进制文件：检测结果取track_id为-1的记录，真值取track_id >= 0的记录
+ *   MOTChallenge文本：每行 "frame,id,left,top,width,height,conf[,class,visibility]"，conf为0或class不为1的行被忽略
+ *   track.meta.txt文本：每行 "frame left top right bottom score [label [track_id]]"
+ */
+bool load_sequence(const std::string& file, bool ground_truth, Sequence& sequence);
+
+struct Metrics{
+    int frames       = 0;
+    int64_t num_gt   = 0;
+    int64_t num_hyp  = 0;
+    int64_t tp       = 0;
+    int64_t fp       = 0;
+    int64_t fn       = 0;
+    int64_t id_switches = 0;
+    int64_t idtp     = 0;     // 全局id一一对应后匹配上的框数
+    int gt_ids       = 0;
+    int hyp_ids      = 0;
+
+    double mota() const{return num_gt > 0 ? 1.0 - double(fn + fp + id_switches) / num_gt : 0;}
+    double recall() const{return num_gt > 0 ? double(tp) / num_gt : 0;}
+    double precision() const{return num_hyp > 0 ? double(tp) / num_hyp : 0;}
+    double idf1() const{return num_gt + num_hyp > 0 ? 2.0 * idtp / (num_gt + num_hyp) : 0;}
+};
+
+/* 逐帧累计一条序列的指标，finish时求解IDF1的全局id对应 */
+class Accumulator{
+public:
+    virtual void update(const Box* gt, int num_gt, const Box* hyp, int num_hyp) = 0;
+    virtual Metrics finish() = 0;
+};
+
+std::shared_ptr<Accumulator> create_accumulator(float iou_threshold = 0.5f);
+
+}; // namespace Eval
+
+#endif // MOT_METRICS_HPP
@@ -0,0 +1,278 @@
+#include "param_sweep.hpp"
+#include "bytetrack/BYTETracker.h"
+#include "deepsort/deepsort_core.hpp"
+
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <stdio.h>
+
+namespace Eval {
+
+    static std::string format_vector(const std::vector<float>& values){
+        if(values.empty())
+            return "default";
+
+        std::string output = "[";
+        char buffer[32];
+        for(int i = 0; i < values.size(); ++i){
+            snprintf(buffer, sizeof(buffer), i == 0 ? "%g" : ",%g", values[i]);
+            output += buffer;
+        }
+        return output + "]";
+    }
+
+    std::string ByteTrackParams::describe() const{
+        char buffer[256];
+        snprintf(buffer, sizeof(buffer), "track_thresh=%g high_thresh=%g match_thresh=%g max_time_lost=%d ",
+            track_thresh, high_thresh, match_thresh, max_time_lost);
+        return buffer + ("motion=" + format_vector(per_frame_motion)) + " noise=" + format_vector(noise);
+    }
+
+    std::string DeepSORTParams::describe() const{
+        char buffer[256];
+        snprintf(buffer, sizeof(buffer), "distance_threshold=%g nhit=%d max_age=%d nbuckets=%d features=%s ",
+            distance_threshold, nhit, max_age, nbuckets,
+            !features ? "none" : feature_mode == DeepSORT::FeatureMode::EMA ? "ema" : "bucket");
+        return buffer + ("motion=" + format_vector(per_frame_motion)) + " noise=" + format_vector(noise);
+    }
+
+    class ByteTrackTrial : public Trial{
+    public:
+        ByteTrackTrial(const ByteTrackParams& params){
+            auto& config = tracker_.config();
+            config.set_track_thresh(params.track_thresh)
+                  .set_high_thresh(params.high_thresh)
+                  .set_match_thresh(params.match_thresh)
+                  .set_max_time_lost(params.max_time_lost);
+            if(!params.per_frame_motion.empty()) config.set_per_frame_motion(params.per_frame_motion);
+            if(!params.noise.empty()) config.set_noise(params.noise);
+        }
+
+        virtual void track(int frame, const Box* detections, int count, std::vector<Box>& tracks) override{
+
+            objects_.resize(count);
+            for(int i = 0; i < count; ++i){
+                auto& box = detections[i];
+                auto& obj = objects_[i];
+                obj.rect[0] = box.left;
+                obj.rect[1] = box.top;
+                obj.rect[2] = box.right - box.left;
+                obj.rect[3] = box.bottom - box.top;
+                obj.prob  = box.score;
+                obj.label = 0;
+            }
+
+            auto output = tracker_.update(objects_);
+            tracks.clear();
+            for(auto& track : output){
+                auto& tlwh = track.tlwh;
+                tracks.emplace_back(tlwh[0], tlwh[1], tlwh[0] + tlwh[2], tlwh[1] + tlwh[3], track.score, track.track_id);
+            }
+        }
+
+    private:
+        BYTETracker tracker_;
+        std::vector<Object> objects_;
+    };
+
+    class DeepSORTTrial : public Trial{
+    public:
+        bool startup(const DeepSORTParams& params){
+            DeepSORT::Config config;
+            config.distance_threshold = params.distance_threshold;
+            config.nhit = params.nhit;
+            config.max_age = params.max_age;
+            config.nbuckets = params.nbuckets;
+            config.feature_mode = params.feature_mode;
+            config.has_feature = (bool)params.features;
+            if(!params.per_frame_motion.empty()) config.set_per_frame_motion(params.per_frame_motion);
+            if(!params.noise.empty()) config.set_noise(params.noise);
+
+            features_ = params.features;
+            tracker_ = DeepSORT::core::create_tracker(config);
+            return tracker_ != nullptr;
+        }
+
+        virtual void track(int frame, const Box* detections, int count, std::vector<Box>& tracks) override{
+
+            DeepSORT::core::FeatureMatrix features;
+            if(features_)
+                features = features_(frame);
+
+            boxes_.resize(count);
+            for(int i = 0; i < count; ++i){
+                auto& box = detections[i];
+                boxes_[i] = DeepSORT::core::Box(box.left, box.top, box.right, box.bottom, i < features.rows ? i : -1);
+            }
+
+            auto& objects = tracker_->update(boxes_.data(), count, features);
+            tracks.clear();
+            for(auto obj : objects){
+                if(!obj->is_confirmed() || obj->time_since_update() > 0)
+                    continue;
+
+                auto box = obj->last_position();
+                tracks.emplace_back(box.left, box.top, box.right, box.bottom, 1, obj->id());
+            }
+        }
+
+    private:
+        std::shared_ptr<DeepSORT::core::Tracker> tracker_;
+        std::vector<DeepSORT::core::Box> boxes_;
+        FeatureSource features_;
+    };
+
+    std::shared_ptr<Trial> create_bytetrack_trial(const ByteTrackParams& params){
+        return std::make_shared<ByteTrackTrial>(params);
+    }
+
+    std::shared_ptr<Trial> create_deepsort_trial(const DeepSORTParams& params){
+        std::shared_ptr<DeepSORTTrial> instance(new DeepSORTTrial());
+        if(!instance->startup(params))
+            instance.reset();
+        return instance;
+    }
+
+    std::vector<ByteTrackParams> ByteTrackGrid::expand() const{
+        std::vector<ByteTrackParams> output;
+        ByteTrackParams p;
+        for(auto a : track_thresh)
+        for(auto b : high_thresh)
+        for(auto c : match_thresh)
+        for(auto d : max_time_lost)
+        for(auto& e : per_frame_motion)
+        for(auto& f : noise){
+            p.track_thresh = a;
+            p.high_thresh = b;
+            p.match_thresh = c;
+            p.max_time_lost = d;
+            p.per_frame_motion = e;
+            p.noise = f;
+            output.push_back(p);
+        }
+        return output;
+    }
+
+    std::vector<DeepSORTParams> DeepSORTGrid::expand() const{
+        std::vector<DeepSORTParams> output;
+        DeepSORTParams p;
+        for(auto a : distance_threshold)
+        for(auto b : nhit)
+        for(auto c : max_age)
+        for(auto d : nbuckets)
+        for(auto e : feature_mode)
+        for(auto& f : per_frame_motion)
+        for(auto& g : noise){
+            p.distance_threshold = a;
+            p.nhit = b;
+            p.max_age = c;
+            p.nbuckets = d;
+            p.feature_mode = e;
+            p.features = features;
+            p.per_frame_motion = f;
+            p.noise = g;
+            output.push_back(p);
+        }
+        return output;
+    }
+
+    static bool run_trial(
+        const Sequence& detections, const Sequence& ground_truth, int first, int last,
+        Trial& trial, float iou_threshold, TrialResult& result
+    ){
+        auto accumulator = create_accumulator(iou_threshold);
+        if(accumulator == nullptr)
+            return false;
+
+        std::vector<Box> tracks;
+        std::vector<float> frame_ms;
+        frame_ms.reserve(last - first + 1);
+        for(int frame = first; frame <= last; ++frame){
+
+            int num_det = 0, num_gt = 0;
+            auto det = detections.frame(frame, num_det);
+            auto gt = ground_truth.frame(frame, num_gt);
+
+            auto tick = std::chrono::steady_clock::now();
+            trial.track(frame, det, num_det, tracks);
+            frame_ms.push_back(std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - tick).count());
+
+            accumulator->update(gt, num_gt, tracks.data(), tracks.size());
+        }
+
+        result.metrics = accumulator->finish();
+        if(!frame_ms.empty()){
+            double sum = 0;
+            for(auto v : frame_ms) sum += v;
+            result.mean_frame_ms = sum / frame_ms.size();
+
+            auto p99 = frame_ms.begin() + (frame_ms.size() - 1) * 99 / 100;
+            std::nth_element(frame_ms.begin(), p99, frame_ms.end());
+            result.p99_frame_ms = *p99;
+        }
+        return true;
+    }
+
+    std::vector<TrialResult> run_sweep(
+        const Sequence& detections, const Sequence& ground_truth,
+        int num_configs, const TrialFactory& factory,
+        const SweepConfig& config
+    ){
+        std::vector<TrialResult> results;
+        if(ground_truth.empty() || num_configs < 1){
+            printf("Nothing to sweep, %d configs, %d ground truth boxes\n", num_configs, (int)ground_truth.num_boxes());
+            return results;
+        }
+
+        int first = ground_truth.first_frame(), last = ground_truth.last_frame();
+        if(!detections.empty()){
+            first = std::min(first, detections.first_frame());
+            last  = std::max(last, detections.last_frame());
+        }
+
+        int num_threads = config.num_threads;
+        if(num_threads < 1)
+            num_threads = std::max(1u, std::thread::hardware_concurrency());
+        num_threads = std::min(num_threads, num_configs);
+
+        results.resize(num_configs);
+        std::vector<char> ok(num_configs, 0);
+        std::atomic<int> next{0};
+        std::vector<std::thread> workers;
+        for(int t = 0; t < num_threads; ++t){
+            workers.emplace_back([&]{
+                int index = 0;
+                while((index = next++) < num_configs){
+                    auto trial = factory(index);
+                    results[index].config_index = index;
+                    if(trial == nullptr)
+                        continue;
+                    ok[index] = run_trial(detections, ground_truth, first, last, *trial, config.iou_threshold, results[index]);
+                }
+            });
+        }
+        for(auto& worker : workers)
+            worker.join();
+
+        // 创建失败的配置不参与排名
+        std::vector<TrialResult> output;
+        for(int i = 0; i < num_configs; ++i){
+            if(!ok[i])
+                continue;
+
+            auto& result = results[i];
+            result.within_limit = config.latency_limit_ms <= 0 || result.p99_frame_ms <= config.latency_limit_ms;
+            output.push_back(result);
+        }
+
+        std::stable_sort(output.begin(), output.end(), [](const TrialResult& a, const TrialResult& b){
+            if(a.within_limit != b.within_limit) return a.within_limit;
+            if(a.metrics.mota() != b.metrics.mota()) return a.metrics.mota() > b.metrics.mota();
+            return a.metrics.idf1() > b.metrics.idf1();
+        });
+        return output;
+    }
+
+}; // namespace Eval
@@ -0,0 +1,113 @@
+
+#ifndef PARAM_SWEEP_HPP
+#define PARAM_SWEEP_HPP
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <functional>
+#include "mot_metrics.hpp"
+#include "deepsort/deepsort_core.hpp"
+
+/**
+ * 离线参数搜索
+ * 检测结果与真值只加载一次，所有配置在线程池中并行地各自跑完整条序列，
+ * 每个配置的跟踪器实例互相独立，共享的Sequence只读
+ */
+namespace Eval {
+
+// 一个配置的跟踪器，逐帧输入检测框，输出带id的跟踪框，frame为检测框在Sequence中的帧号
+class Trial{
+public:
+    virtual void track(int frame, const Box* detections, int count, std::vector<Box>& tracks) = 0;
+};
+
+// 在工作线程中调用，必须可重入
+typedef std::function<std::shared_ptr<Trial>(int config_index)> TrialFactory;
+
+struct SweepConfig{
+    int num_threads        = 0;       // 0为硬件线程数
+    float iou_threshold    = 0.5f;
+    float latency_limit_ms = 0;       // 每帧跟踪耗时p99超过该值的配置排在最后，0为不限制
+};
+
+struct TrialResult{
+    int config_index     = 0;
+    Metrics metrics;
+    double mean_frame_ms = 0;
+    double p99_frame_ms  = 0;
+    bool within_limit    = true;
+};
+
+/**
+ * @brief 并行评估num_configs个配置，结果先按是否满足latency_limit_ms、再按MOTA、IDF1降序排列
+ *        帧范围为检测结果与真值的并集，中间没有检测结果的帧以空输入调用Trial::track
+ */
+std::vector<TrialResult> run_sweep(
+    const Sequence& detections, const Sequence& ground_truth,
+    int num_configs, const TrialFactory& factory,
+    const SweepConfig& config = SweepConfig()
+);
+
+struct ByteTrackParams{
+    float track_thresh  = 0.5;
+    float high_thresh   = 0.6;
+    float match_thresh  = 0.8;
+    int max_time_lost   = 30;
+    std::vector<float> per_frame_motion;    // 为空时使用默认值，否则为8个值
+    std::vector<float> noise;               // 为空时使用默认值，否则为4个值
+
+    std::string describe() const;
+};
+
+/**
+ * 第frame帧检测框的外观特征，第k行对应Sequence::frame返回的第k个框，行数应等于该帧的框数，
+ * 缺少feature的框会让匹配上它的轨迹此后不再使用外观特征。在工作线程中调用，必须可重入，
+ * 返回的矩阵在整个sweep期间有效
+ */
+typedef std::function<DeepSORT::core::FeatureMatrix(int frame)> FeatureSource;
+
+struct DeepSORTParams{
+    float distance_threshold = 100;
+    int nhit     = 5;
+    int max_age  = 150;
+    int nbuckets = 30;                      // Bucket模式保存的feature数，同时决定轨迹长度，EMA模式下只决定轨迹长度
+    DeepSORT::FeatureMode feature_mode = DeepSORT::FeatureMode::Bucket;
+    FeatureSource features;                 // 为空时只用运动信息匹配，nbuckets与feature_mode只影响轨迹长度
+    std::vector<float> per_frame_motion;
+    std::vector<float> noise;
+
+    std::string describe() const;
+};
+
+std::shared_ptr<Trial> create_bytetrack_trial(const ByteTrackParams& params);
+std::shared_ptr<Trial> create_deepsort_trial(const DeepSORTParams& params);
+
+// 参数网格，expand按笛卡尔积展开
+struct ByteTrackGrid{
+    std::vector<float> track_thresh{0.5f};
+    std::vector<float> high_thresh{0.6f};
+    std::vector<float> match_thresh{0.8f};
+    std::vector<int> max_time_lost{30};
+    std::vector<std::vector<float>> per_frame_motion{{}};
+    std::vector<std::vector<float>> noise{{}};
+
+    std::vector<ByteTrackParams> expand() const;
+};
+
+struct DeepSORTGrid{
+    std::vector<float> distance_threshold{100};
+    std::vector<int> nhit{5};
+    std::vector<int> max_age{150};
+    std::vector<int> nbuckets{30};
+    std::vector<DeepSORT::FeatureMode> feature_mode{DeepSORT::FeatureMode::Bucket};
+    std::vector<std::vector<float>> per_frame_motion{{}};
+    std::vector<std::vector<float>> noise{{}};
+    FeatureSource features;                 // 不参与展开，所有配置共用
+
+    std::vector<DeepSORTParams> expand() const;
+};
+
+}; // namespace Eval
+
+#endif // PARAM_SWEEP_HPP
@@ -5,8 +5,20 @@
 #include <app/yolo.hpp>
 #include <opencv2/opencv.hpp>
 #include <algorithm>
+#include <map>
 #include "bytetrack/BYTETracker.h"
 #include "deepsort/deepsort.hpp"
+#include "deepsort/reid_index.hpp"
+#include "pipeline/pipeline.hpp"
+#include "pipeline/batch_frontend.hpp"
+#include "pipeline/renderer.hpp"
+#include "reid/crop_batch.hpp"
+#include "tracklog/track_log.hpp"
+#include "eval/param_sweep.hpp"
+#include <random>
+#include <chrono>
+#include <thread>
+#include <cstddef>
 #include <stdio.h>
 
 using namespace std;
@@ -30,63 +42,115 @@ static const char* cocolabels[] = {
 
 bool onnx_hub(const char* name, const char* save_to);
 
-template<typename _Cond>
-vector<Object> det2tracks(const ObjectDetector::BoxArray& array, const _Cond& cond){
+/* Yolo引擎作为流水线的检测器，commit在引擎自己的线程里执行 */
+class YoloDetector : public Pipeline::Detector{
+public:
+    YoloDetector(const shared_ptr<Yolo::Infer>& engine):engine_(engine){}
 
-    vector<Object> outputs;
-    for(int i = 0; i < array.size(); ++i){
-        auto& abox = array[i];
+    virtual bool detect(Pipeline::Frame& frame) override{
+        auto boxes = engine_->commit(TRT::cvmat2image(frame.image)).get();
+        frame.detections.resize(boxes.size());
+        for(int i = 0; i < boxes.size(); ++i){
+            auto& box = boxes[i];
+            frame.detections[i] = {box.left, box.top, box.right, box.bottom, box.confidence, box.class_label};
+        }
+        return true;
+    }
 
-        if(!cond(abox)) continue;
+private:
+    shared_ptr<Yolo::Infer> engine_;
+};
 
-        Object obox;
-        obox.prob = abox.confidence;
-        obox.label = abox.class_label;
-        obox.rect[0] = abox.left;
-        obox.rect[1] = abox.top;
-        obox.rect[2] = abox.right - abox.left;
-        obox.rect[3] = abox.bottom - abox.top;
-        outputs.emplace_back(obox);
-    }
-    return outputs;
-}
+/* Yolo检测之后在同一个线程里为行人框提取ReID特征，features的第k行对应detections中第k个行人框 */
+class YoloReIDDetector : public Pipeline::Detector{
+public:
+    YoloReIDDetector(const shared_ptr<Yolo::Infer>& engine, const shared_ptr<TRT::Infer>& extractor)
+        :engine_(engine), extractor_(extractor), batcher_(ReID::create_crop_batcher()){}
+
+    virtual bool detect(Pipeline::Frame& frame) override{
+
+        auto boxes = engine_->commit(TRT::cvmat2image(frame.image)).get();
+        frame.detections.resize(boxes.size());
+        crops_.clear();
+        for(int i = 0; i < boxes.size(); ++i){
+            auto& box = boxes[i];
+            frame.detections[i] = {box.left, box.top, box.right, box.bottom, box.confidence, box.class_label};
+            if(box.class_label == 0)
+                crops_.push_back({box.left, box.top, box.right, box.bottom});
+        }
 
-template<typename _Cond>
-DeepSORT::BBoxes det2boxes(const ObjectDetector::BoxArray& array, const _Cond& cond){
+        // 一帧中所有框一次预处理，直接写入extractor的输入tensor，每个batch只forward一次
+        auto inputtensor = extractor_->input();
+        auto outputtensor = extractor_->output();
+        int max_batch_size = extractor_->get_max_batch_size();
+        ReID::Image image(frame.image.data, frame.image.cols, frame.image.rows, frame.image.step);
+        frame.features.create(crops_.size(), outputtensor->size(1), CV_32F);
+        for(int begin = 0; begin < crops_.size(); begin += max_batch_size){
 
-    DeepSORT::BBoxes outputs;
-    for(int i = 0; i < array.size(); ++i){
-        auto& abox = array[i];
+            int batch = std::min<int>(max_batch_size, crops_.size() - begin);
+            inputtensor->resize_single_dim(0, batch);
+            batcher_->process(image, crops_.data() + begin, batch, inputtensor->cpu<float>());
+            extractor_->forward();
 
-        if(!cond(abox)) continue;
-        outputs.emplace_back(abox.left, abox.top, abox.right, abox.bottom);
+            for(int i = 0; i < batch; ++i){
+                cv::Mat ofeat(1, outputtensor->size(1), CV_32F, outputtensor->cpu<float>(i));
+                cv::Mat row = frame.features.row(begin + i);
+                cv::normalize(ofeat, row, 1.0f, 0.0f, cv::NORM_L2);
+            }
+        }
+        return true;
     }
-    return outputs;
-}
 
-static void inference_bytetrack(int deviceid, const string& engine_file, TRT::Mode mode, Yolo::Type type, const string& model_name){
+private:
+    shared_ptr<Yolo::Infer> engine_;
+    shared_ptr<TRT::Infer> extractor_;
+    shared_ptr<ReID::CropBatcher> batcher_;
+    vector<ReID::CropBox> crops_;
+};
 
-    auto engine = Yolo::create_infer(
-        engine_file,                // engine file
-        type,                       // yolo type, Yolo::Type::V5 / Yolo::Type::X
-        deviceid,                   // gpu id
-        0.25f,                      // confidence threshold
-        0.45f,                      // nms threshold
-        Yolo::NMSMethod::FastGPU,   // NMS method, fast GPU / CPU
-        1024,                       // max objects
-        false                       // preprocess use multi stream
-    );
-    if(engine == nullptr){
-        INFOE("Engine is nullptr");
-        return;
+/* 多路流共享一个Yolo引擎，一个batch的图像通过commits一次提交 */
+class YoloBatchDetector : public Pipeline::BatchDetector{
+public:
+    YoloBatchDetector(const shared_ptr<Yolo::Infer>& engine, int max_batch_size):engine_(engine), max_batch_size_(max_batch_size){}
+
+    virtual int max_batch_size() const override{return max_batch_size_;}
+
+    virtual bool detect(const vector<Pipeline::Frame*>& frames) override{
+
+        vector<TRT::Image> images;
+        for(auto frame : frames)
+            images.emplace_back(TRT::cvmat2image(frame->image));
+
+        auto futures = engine_->commits(images);
+        for(int i = 0; i < frames.size(); ++i){
+            auto boxes = futures[i].get();
+            auto& detections = frames[i]->detections;
+            detections.resize(boxes.size());
+            for(int j = 0; j < boxes.size(); ++j){
+                auto& box = boxes[j];
+                detections[j] = {box.left, box.top, box.right, box.bottom, box.confidence, box.class_label};
+            }
+        }
+        return true;
     }
 
-    VideoCapture cap("1652153992351250.mp4");
+private:
+    shared_ptr<Yolo::Infer> engine_;
+    int max_batch_size_;
+};
+
+/* decode -> detect -> track -> render 各自一个线程，检测器可以替换为回放的CPU替身
+   画框和编码在Renderer的线程中进行，跟不上时丢帧，不会拖慢跟踪。headless为true时不画框也不写视频 */
+static void pipeline_bytetrack(
+    const shared_ptr<Pipeline::Detector>& detector, const string& video_file, const string& meta_file,
+    const Pipeline::PipelineConfig& config = Pipeline::PipelineConfig(), bool headless = false
+){
+
+    VideoCapture cap(video_file);
     auto fps = cap.get(cv::CAP_PROP_FPS);
     int width = cap.get(cv::CAP_PROP_FRAME_WIDTH);
     int height = cap.get(cv::CAP_PROP_FRAME_HEIGHT);
     BYTETracker tracker;
-    cv::Mat image;
     tracker.config().set_initiate_state({
         0.1,  0.1,  0.1,  0.1,
         0.2,  0.2,  1,    0.2
@@ -95,45 +159,134 @@ static void inference_bytetrack(int deviceid, const string& engine_file, TRT::Mo
         0.2,  0.2,  1,    0.2
     }).set_max_time_lost(150);
 
-    VideoWriter writer("output.mp4", cv::VideoWriter::fourcc('M', 'P', 'E', 'G'), fps, cv::Size(width, height));
-    auto cond = [](const ObjectDetector::Box& b){return b.class_label == 0;};
+    VideoWriter writer;
+    if(!headless)
+        writer.open("output.mp4", cv::VideoWriter::fourcc('M', 'P', 'E', 'G'), fps, cv::Size(width, height));
+
+    TrackLog::WriterConfig log_config;
+    log_config.truncate = true;
+    auto log = meta_file.empty() ? nullptr : TrackLog::create_writer(meta_file, log_config);
+    vector<TrackLog::Record> records;
+    double frame_interval = fps > 0 ? 1000 / fps : 0;
+    double last_timestamp = -1;
+
+    Pipeline::Stages stages;
+    stages.decode = [&](Pipeline::Frame& frame){
+        if(!cap.read(frame.image))
+            return false;
+
+        frame.timestamp = cap.get(cv::CAP_PROP_POS_MSEC);
+        return true;
+    };
 
-    FILE* f = fopen("track.meta.txt", "wb");
-    int t = 0;
-    while(cap.read(image)){
+    stages.detector = detector;
+    stages.track = [&](Pipeline::Frame& frame){
 
-        auto boxes = engine->commit(TRT::cvmat2image(image)).get();
-        for(auto& box : boxes){
+        auto& detections = frame.detections;
+        records.clear();
+        for(auto& box : detections){
             if(box.class_label != 0) continue;
 
-            fprintf(f, "%d %f %f %f %f %f\n", t, box.left, box.top, box.right, box.bottom, box.confidence);
+            records.emplace_back(box.left, box.top, box.right, box.bottom, box.confidence, box.class_label);
         }
-        t++;
 
-        auto tracks = tracker.update(det2tracks(boxes, cond));
-        for(auto& track : tracks){
+        if(log && frame.detected) log->append(frame.index, records.data(), records.size());
 
-            vector<float> tlwh = track.tlwh;
-			bool vertical = tlwh[2] / tlwh[3] > 1.6;
-			if (tlwh[2] * tlwh[3] > 20 && !vertical)
-			{
-				auto s = tracker.get_color(track.track_id);
-                rectangle(image, Rect(tlwh[0], tlwh[1], tlwh[2], tlwh[3] * 0.3), Scalar(get<0>(s), get<1>(s), get<2>(s)), -1);
+        // 以帧间隔为单位的时间差，解码丢帧或时间戳不均匀时dt不为1
+        float dt = 1;
+        if(last_timestamp >= 0 && frame_interval > 0 && frame.timestamp > last_timestamp)
+            dt = (frame.timestamp - last_timestamp) / frame_interval;
+        last_timestamp = frame.timestamp;
 
-				putText(image, format("%d", track.track_id), Point(tlwh[0], tlwh[1] - 10), 
-                        0, 2, Scalar(0, 0, 255), 3, LINE_AA);
-                rectangle(image, Rect(tlwh[0], tlwh[1], tlwh[2], tlwh[3]), Scalar(get<0>(s), get<1>(s), get<2>(s)), 3);
-			}
+        // 跟踪器直接读取frame.detections，输出通过回调写入frame.tracks，边界上没有中间数组
+        auto visitor = [&](const STrack& track){
+            auto& tlwh = track.tlwh;
+            frame.tracks.push_back({tlwh[0], tlwh[1], tlwh[0] + tlwh[2], tlwh[1] + tlwh[3], track.track_id});
+        };
+
+        if(frame.detected){
+            DetectionSpan span(
+                detections.data(), detections.size(), sizeof(Pipeline::Detection),
+                offsetof(Pipeline::Detection, left), offsetof(Pipeline::Detection, top),
+                offsetof(Pipeline::Detection, right), offsetof(Pipeline::Detection, bottom),
+                offsetof(Pipeline::Detection, confidence), offsetof(Pipeline::Detection, class_label)
+            );
+            tracker.update(span, visitor, [&](int i){return detections[i].class_label == 0;}, dt);
+        }else{
+            tracker.predict(visitor, dt);
         }
-        writer.write(image);
-        printf("process.\n");
+    };
+
+    shared_ptr<Pipeline::Renderer> renderer;
+    if(!headless){
+        renderer = Pipeline::create_renderer([&](Pipeline::RenderFrame& frame){
+
+            auto& image = frame.image;
+            for(auto& track : frame.tracks){
+
+                float w = track.right - track.left;
+                float h = track.bottom - track.top;
+                bool vertical = w / h > 1.6;
+                if (w * h > 20 && !vertical)
+                {
+                    auto s = tracker.get_color(track.id);
+                    rectangle(image, Rect(track.left, track.top, w, h * 0.3), Scalar(get<0>(s), get<1>(s), get<2>(s)), -1);
+
+                    putText(image, format("%d", track.id), Point(track.left, track.top - 10), 
+                            0, 2, Scalar(0, 0, 255), 3, LINE_AA);
+                    rectangle(image, Rect(track.left, track.top, w, h), Scalar(get<0>(s), get<1>(s), get<2>(s)), 3);
+                }
+            }
+            writer.write(image);
+        });
+
+        // render级只把画面和轨迹交给渲染线程，交换回来的旧缓冲区供decode复用
+        stages.render = [&](Pipeline::Frame& frame){
+            renderer->submit(frame.index, frame.image, frame.tracks.data(), frame.tracks.size());
+        };
+    }
+
+    auto runner = Pipeline::create_runner(stages, config);
+    if(runner == nullptr){
+        INFOE("Create pipeline failed");
+        return;
     }
-    fclose(f);
+
+    runner->run();
+    Pipeline::print_stats(*runner);
+    if(renderer){
+        renderer->close();
+        Pipeline::print_stats(renderer->stats());
+    }
+
+    if(log) log->close();
     writer.release();
     printf("Done.\n");
 }
 
-static void inference_deepsort(int deviceid, const string& engine_file, TRT::Mode mode, Yolo::Type type, const string& model_name){
+static void inference_bytetrack(int deviceid, const string& engine_file, TRT::Mode mode, Yolo::Type type, const string& model_name){
+
+    auto engine = Yolo::create_infer(
+        engine_file,                // engine file
+        type,                       // yolo type, Yolo::Type::V5 / Yolo::Type::X
+        deviceid,                   // gpu id
+        0.25f,                      // confidence threshold
+        0.45f,                      // nms threshold
+        Yolo::NMSMethod::FastGPU,   // NMS method, fast GPU / CPU
+        1024,                       // max objects
+        false                       // preprocess use multi stream
+    );
+    if(engine == nullptr){
+        INFOE("Engine is nullptr");
+        return;
+    }
+
+    pipeline_bytetrack(make_shared<YoloDetector>(engine), "1652153992351250.mp4", "track.meta.bin");
+}
+
+/* 多路视频共享一个Yolo引擎，每路一条流水线，detect阶段提交到动态batch前端，由YoloBatchDetector通过commits成批推理
+   每路的检测结果记录到track.meta.<i>.bin，多路同时运行时不画框也不写视频 */
+static void inference_multistream(int deviceid, const string& engine_file, Yolo::Type type, const vector<string>& videos, int max_batch_size = 8, float max_wait_ms = 5){
 
     auto engine = Yolo::create_infer(
         engine_file,                // engine file
@@ -145,9 +298,70 @@ static void inference_deepsort(int deviceid, const string& engine_file, TRT::Mod
         1024,                       // max objects
         false                       // preprocess use multi stream
     );
+    if(engine == nullptr){
+        INFOE("Engine is nullptr");
+        return;
+    }
+
+    Pipeline::BatchConfig config;
+    config.max_batch_size = max_batch_size;
+    config.max_wait_ms = max_wait_ms;
+    auto frontend = Pipeline::create_batch_frontend(make_shared<YoloBatchDetector>(engine, max_batch_size), config);
+    if(frontend == nullptr){
+        INFOE("Create batch frontend failed");
+        return;
+    }
 
+    vector<thread> streams;
+    for(int s = 0; s < videos.size(); ++s){
+        streams.emplace_back([&, s]{
+            pipeline_bytetrack(Pipeline::create_frontend_detector(frontend, s), videos[s], iLogger::format("track.meta.%d.bin", s), Pipeline::PipelineConfig(), true);
+        });
+    }
+    for(auto& t : streams)
+        t.join();
+
+    auto stats = frontend->stats();
+    INFO("%d streams, %d frames in %d batches, batch size %.2f, wait %.2f / %.2f ms, detect %.2f ms",
+        (int)videos.size(), (int)stats.frames, (int)stats.batches, stats.mean_batch_size(),
+        stats.mean_wait_ms(), stats.max_wait_ms, stats.mean_detect_ms()
+    );
+}
+
+/* 不需要GPU，回放inference_bytetrack记录的检测结果，latency_ms模拟检测器耗时，detect_stride > 1时检测器跳帧
+   dedup_distance >= 0时画面与上一次检测的帧几乎相同则跳过检测，统计中给出去重的比例和每帧哈希耗时 */
+static void replay_bytetrack(const string& meta_file = "track.meta.bin", float latency_ms = 10, int detect_stride = 1, int dedup_distance = -1){
+
+    auto detector = Pipeline::create_replay_detector(meta_file, latency_ms);
+    if(detector == nullptr){
+        INFOE("Load %s failed", meta_file.c_str());
+        return;
+    }
+
+    Pipeline::PipelineConfig config;
+    config.detect_stride = detect_stride;
+    config.dedup_distance = dedup_distance;
+    pipeline_bytetrack(detector, "1652153992351250.mp4", "", config);
+}
+
+/* decode -> detect(Yolo + ReID) -> track -> render 各自一个线程，与pipeline_bytetrack的结构相同
+   画框、放大跟随目标和编码都在渲染线程中进行，headless为true时全部跳过 */
+static void inference_deepsort(int deviceid, const string& engine_file, TRT::Mode mode, Yolo::Type type, const string& model_name, bool headless = false){
+
+    auto engine = Yolo::create_infer(
+        engine_file,                // engine file
+        type,                       // yolo type, Yolo::Type::V5 / Yolo::Type::X
+        deviceid,                   // gpu id
+        0.25f,                      // confidence threshold
+        0.45f,                      // nms threshold
+        Yolo::NMSMethod::FastGPU,   // NMS method, fast GPU / CPU
+        1024,                       // max objects
+        false                       // preprocess use multi stream
+    );
+
+    // 256x256，BGR，像素值0~255，与fastreid.onnx的输入一致
     auto extractor = TRT::load_infer("fastreid.trtmodel");
-    if(engine == nullptr){
+    if(engine == nullptr || extractor == nullptr){
         INFOE("Engine is nullptr");
         return;
     }
@@ -159,7 +373,6 @@ static void inference_deepsort(int deviceid, const string& engine_file, TRT::Mod
     int height = cap.get(cv::CAP_PROP_FRAME_HEIGHT);
 
     auto config = DeepSORT::Config();
-    cv::Mat image;
     config.set_initiate_state({
         0.3,  0.3,  0.5,  0.1,
         0.5,  0.5,  1,    0.2
@@ -172,109 +385,603 @@ static void inference_deepsort(int deviceid, const string& engine_file, TRT::Mod
     config.nhit = 3;
     config.nbuckets = 30;
     config.max_age = 150;
+    config.telemetry = true;
     auto tracker = DeepSORT::create_tracker(config);
 
-    VideoWriter writer("output.mp4", cv::VideoWriter::fourcc('M', 'P', 'E', 'G'), fps, cv::Size(width, height));
-    auto cond = [](const ObjectDetector::Box& b){return b.class_label == 0;};
+    TrackLog::WriterConfig log_config;
+    log_config.truncate = true;
+    auto log = TrackLog::create_writer("track.meta.bin", log_config);
+    vector<TrackLog::Record> records;
+    double frame_interval = fps > 0 ? 1000 / fps : 0;
+    double last_timestamp = -1;
+    int since_detected = 0;
 
-    FILE* f = fopen("track.meta.txt", "wb");
-    int t = 0;
-    while(cap.read(image)){
-        // if(t < 100 || t >350){
-        //     t++;
-        //     continue;
-        // }
+    // 每detect_stride帧检测一次，其余帧跟踪器只做预测
+    Pipeline::PipelineConfig pipeline_config;
+    pipeline_config.detect_stride = 1;
 
-        auto boxes = engine->commit(TRT::cvmat2image(image)).get();
-        for(auto& box : boxes){
-            if(box.class_label != 0) continue;
+    Pipeline::Stages stages;
+    stages.decode = [&](Pipeline::Frame& frame){
+        if(!cap.read(frame.image))
+            return false;
+
+        frame.timestamp = cap.get(cv::CAP_PROP_POS_MSEC);
+        return true;
+    };
+
+    stages.detector = make_shared<YoloReIDDetector>(engine, extractor);
+    stages.track = [&](Pipeline::Frame& frame){
+
+        auto& detections = frame.detections;
+        auto cond = [&](int i){return detections[i].class_label == 0;};
+        if(log && frame.detected){
+            records.clear();
+            for(auto& box : detections){
+                if(box.class_label != 0) continue;
+
+                records.emplace_back(box.left, box.top, box.right, box.bottom, box.confidence, box.class_label);
+            }
+            log->append(frame.index, records.data(), records.size());
+        }
+
+        // 以帧间隔为单位的时间差，解码丢帧或时间戳不均匀时dt不为1
+        float dt = 1;
+        if(last_timestamp >= 0 && frame_interval > 0 && frame.timestamp > last_timestamp)
+            dt = (frame.timestamp - last_timestamp) / frame_interval;
+        last_timestamp = frame.timestamp;
+
+        // 跟踪器直接读取frame.detections，frame.features的第k行对应第k个通过cond的框
+        DeepSORT::core::BoxSpan span(
+            detections.data(), detections.size(), sizeof(Pipeline::Detection),
+            offsetof(Pipeline::Detection, left), offsetof(Pipeline::Detection, top),
+            offsetof(Pipeline::Detection, right), offsetof(Pipeline::Detection, bottom)
+        );
+        const auto& tracks = frame.detected ? tracker->update(span, frame.features, cond, dt) : tracker->predict(dt);
+        since_detected = frame.detected ? 0 : since_detected + 1;
+        if(headless)
+            return;
+
+        // 跳过检测的帧上画出上一次检测之后仍在跟踪的目标的预测位置
+        for(auto& track : tracks){
+            bool alive = track->time_since_update() <= since_detected;
+            if (track->is_confirmed() && alive)
+            {
+                auto loc = frame.detected ? track->location() : track->predict_box();
+                frame.tracks.push_back({loc.left, loc.top, loc.right, loc.bottom, track->id()});
+            }
+        }
+    };
+
+    VideoWriter writer;
+    shared_ptr<Pipeline::Renderer> renderer;
+    if(!headless){
+        writer.open("output.mp4", cv::VideoWriter::fourcc('M', 'P', 'E', 'G'), fps, cv::Size(width, height));
+        renderer = Pipeline::create_renderer([&](Pipeline::RenderFrame& frame){
+
+            auto& image = frame.image;
+            putText(image, format("%d", frame.index), Point(10, 60), 0, 2, Scalar(0, 0, 255), 3, LINE_AA);
+
+            const Pipeline::TrackBox* focus = nullptr;
+            for(auto& track : frame.tracks){
+                auto s = DeepSORT::get_color(track.id);
+                if(track.id == 1)
+                    focus = &track;
+
+                putText(image, format("%d", track.id), Point(track.left, track.top+60), 
+                        0, 2, Scalar(0, 0, 255), 3, LINE_AA);
+                rectangle(image, Rect(track.left, track.top, track.right - track.left, track.bottom - track.top), Scalar(get<0>(s), get<1>(s), get<2>(s)), 3);
+            }
 
-            fprintf(f, "%d %f %f %f %f %f\n", t, box.left, box.top, box.right, box.bottom, box.confidence);
+            // 以1号目标为中心放大
+            if(focus){
+
+                float cx = (focus->left + focus->right) * 0.5f;
+                float cy = (focus->top + focus->bottom) * 0.5f;
+                int height = focus->bottom - focus->top;
+
+                int dsth = image.rows * 0.7;
+                float scale = dsth / (float)height;
+                cv::Mat T0 = cv::Mat::eye(3, 3, CV_32F);
+                cv::Mat S = cv::Mat::eye(3, 3, CV_32F);
+                cv::Mat T1 = cv::Mat::eye(3, 3, CV_32F);
+                T0.at<float>(0, 2) = -cx;
+                T0.at<float>(1, 2) = -cy;
+                S.at<float>(0, 0) = scale;
+                S.at<float>(1, 1) = scale;
+                T1.at<float>(0, 2) = image.cols*0.5;
+                T1.at<float>(1, 2) = image.rows*0.5;
+                cv::Mat M = cv::Mat(T1 * S * T0)(cv::Range(0, 2), cv::Range(0, 3));
+                cv::warpAffine(image, image, M, image.size(), 1, 0, cv::Scalar::all(128));
+            }
+            writer.write(image);
+        });
+
+        // render级只把画面和轨迹交给渲染线程，交换回来的旧缓冲区供decode复用
+        stages.render = [&](Pipeline::Frame& frame){
+            renderer->submit(frame.index, frame.image, frame.tracks.data(), frame.tracks.size());
+        };
+    }
+
+    auto runner = Pipeline::create_runner(stages, pipeline_config);
+    if(runner == nullptr){
+        INFOE("Create pipeline failed");
+        return;
+    }
+
+    runner->run();
+    Pipeline::print_stats(*runner);
+    if(renderer){
+        renderer->close();
+        Pipeline::print_stats(renderer->stats());
+    }
+    if(log) log->close();
+    writer.release();
+
+    auto& telemetry = tracker->telemetry();
+    INFO("deepsort: %d frames, match rate %.3f, gated %.3f, cascade depth p50 = %.0f p99 = %.0f, cost matrix mean = %.1f, solver mean = %.1f us p99 = %.0f us, degraded %d frames",
+        (int)telemetry.frames, telemetry.match_rate(), telemetry.gated_rate(),
+        telemetry.cascade_depth.percentile(0.5), telemetry.cascade_depth.percentile(0.99),
+        telemetry.cost_matrix_size.mean(), telemetry.solver_time_us.mean(), telemetry.solver_time_us.percentile(0.99),
+        (int)telemetry.degraded_frames
+    );
+    printf("Done.\n");
+}
+
+/* 已删除轨迹ANN索引的召回率和延迟，以暴力搜索的结果为准 */
+static void benchmark_reid_index(int count = 20000, int dim = 512, int nquery = 1000, float noise = 0.5f){
+
+    DeepSORT::ReIDIndexConfig config;
+    config.dim      = dim;
+    config.capacity = count;
+    config.max_age  = count;
+    auto index = DeepSORT::create_reid_index(config);
+
+    std::mt19937 rng(7);
+    std::normal_distribution<float> normal;
+    vector<float> features((size_t)count * dim);
+    for(int i = 0; i < count; ++i){
+        float* f = features.data() + (size_t)i * dim;
+        float norm = 0;
+        for(int j = 0; j < dim; ++j){
+            f[j] = normal(rng);
+            norm += f[j] * f[j];
         }
-        t++;
-
-        DeepSORT::BBoxes dbboxes;
-        for(auto& box : boxes){
-			if (box.class_label == 0)
-			{
-                auto roi = cv::Rect(cv::Point(box.left, box.top), cv::Point(box.right, box.bottom));
-                roi = roi & cv::Rect(0, 0, image.cols, image.rows);
-                cv::Mat crop = image(roi).clone();
-                cv::resize(crop, crop, cv::Size(256, 256));
-                crop.convertTo(crop, CV_32F);
-
-                cv::Mat ms[3];
-                auto inputtensor = extractor->input();
-                auto outputtensor = extractor->output();
-                printf("inputtensor.shape = %s\n", inputtensor->shape_string());
-
-                for(int n = 0; n < 3; ++n){
-                    ms[n] = cv::Mat(256, 256, CV_32F, inputtensor->cpu<float>(0, n));
+        norm = sqrt(norm);
+        for(int j = 0; j < dim; ++j)
+            f[j] /= norm;
+    }
+
+    auto tic = chrono::high_resolution_clock::now();
+    for(int i = 0; i < count; ++i)
+        index->insert(i + 1, features.data() + (size_t)i * dim, i);
+    double insert_us = chrono::duration<double, micro>(chrono::high_resolution_clock::now() - tic).count() / count;
+
+    // 查询为某个已存储embedding加噪声，与暴力搜索的最近邻比较
+    int hit = 0;
+    double query_us = 0;
+    vector<float> query(dim);
+    for(int n = 0; n < nquery; ++n){
+        const float* src = features.data() + (size_t)(rng() % count) * dim;
+        for(int j = 0; j < dim; ++j)
+            query[j] = src[j] + noise * normal(rng) / sqrt((float)dim);
+
+        int best = 0;
+        float best_score = -1e9;
+        for(int i = 0; i < count; ++i){
+            const float* f = features.data() + (size_t)i * dim;
+            float score = 0;
+            for(int j = 0; j < dim; ++j)
+                score += f[j] * query[j];
+
+            if(score > best_score){
+                best_score = score;
+                best = i + 1;
+            }
+        }
+
+        DeepSORT::ReIDMatch match;
+        tic = chrono::high_resolution_clock::now();
+        int found = index->search(query.data(), 1, &match);
+        query_us += chrono::duration<double, micro>(chrono::high_resolution_clock::now() - tic).count();
+        if(found == 1 && match.id == best)
+            hit++;
+    }
+
+    INFO("reid index: %d x %d, insert %.1f us, query %.1f us, recall@1 %.4f, memory %.1f MB",
+        count, dim, insert_us, query_us / nquery, hit / (float)nquery, index->memory_bytes() / 1024.0f / 1024.0f);
+}
+
+/**
+ * 在合成数据上比较Bucket和EMA两种外观模式的吞吐、覆盖率和ID切换次数，只用到不依赖OpenCV的跟踪器核心
+ * 合成的行人匀速运动、相互交叉、10%漏检，feature为身份向量加上模长为feature_noise的随机向量后归一化。
+ * 同一个人两次检测的余弦距离约为1 - 1 / (1 + noise^2)，noise = 0.7时在distance_threshold附近，两种模式的差别最明显
+ * coverage为被已确认轨迹匹配上的检测框比例
+ */
+static void benchmark_appearance_mode(int num_people = 40, int num_frames = 1500, int dim = 512, float feature_noise = 0.7f){
+
+    std::mt19937 rng(11);
+    std::normal_distribution<float> normal;
+    std::uniform_real_distribution<float> uniform(0, 1);
+
+    auto random_unit = [&](float* f, float scale){
+        float norm = 0;
+        for(int i = 0; i < dim; ++i){
+            f[i] = normal(rng);
+            norm += f[i] * f[i];
+        }
+        norm = sqrt(norm) / scale;
+        for(int i = 0; i < dim; ++i)
+            f[i] /= norm;
+    };
+
+    vector<float> identities((size_t)num_people * dim);
+    vector<float> position(num_people * 2), velocity(num_people * 2);
+    for(int i = 0; i < num_people; ++i){
+        random_unit(identities.data() + (size_t)i * dim, 1);
+        position[i * 2 + 0] = uniform(rng) * 1920;
+        position[i * 2 + 1] = uniform(rng) * 1080;
+        velocity[i * 2 + 0] = (uniform(rng) - 0.5f) * 8;
+        velocity[i * 2 + 1] = (uniform(rng) - 0.5f) * 4;
+    }
+
+    // 每帧的检测框、真值id和feature矩阵，boxes[k].feature_row = k
+    vector<vector<DeepSORT::core::Box>> boxes(num_frames);
+    vector<vector<int>> gt_ids(num_frames);
+    vector<vector<float>> features(num_frames);
+    vector<float> noise(dim);
+    int num_detections = 0;
+    for(int t = 0; t < num_frames; ++t){
+        for(int i = 0; i < num_people; ++i){
+            float* p = position.data() + i * 2;
+            float* v = velocity.data() + i * 2;
+            p[0] += v[0];
+            p[1] += v[1];
+            if(p[0] < 0 || p[0] > 1920) v[0] = -v[0];
+            if(p[1] < 0 || p[1] > 1080) v[1] = -v[1];
+
+            // 10%漏检
+            if(uniform(rng) < 0.1f) continue;
+
+            int row = boxes[t].size();
+            boxes[t].emplace_back(p[0] - 30, p[1] - 80, p[0] + 30, p[1] + 80, row);
+            gt_ids[t].push_back(i);
+
+            random_unit(noise.data(), feature_noise);
+            const float* identity = identities.data() + (size_t)i * dim;
+            float norm = 0;
+            for(int j = 0; j < dim; ++j){
+                noise[j] += identity[j];
+                norm += noise[j] * noise[j];
+            }
+            norm = sqrt(norm);
+            for(int j = 0; j < dim; ++j)
+                features[t].push_back(noise[j] / norm);
+            num_detections++;
+        }
+    }
+
+    auto run = [&](const char* name, DeepSORT::FeatureMode mode, int topk){
+
+        DeepSORT::Config config;
+        config.has_feature = true;
+        config.distance_threshold = 0.3;
+        config.nhit = 3;
+        config.nbuckets = 30;
+        config.max_age = 150;
+        config.feature_mode = mode;
+        config.ema_topk = topk;
+        auto tracker = DeepSORT::core::create_tracker(config);
+
+        map<int, int> gt_to_track;
+        int id_switch = 0;
+        int covered = 0;
+        double total_ms = 0;
+        for(int t = 0; t < num_frames; ++t){
+
+            auto& frame = boxes[t];
+            DeepSORT::core::FeatureMatrix matrix(features[t].data(), frame.size(), dim);
+            auto tic = chrono::high_resolution_clock::now();
+            auto& tracks = tracker->update(frame.data(), frame.size(), matrix);
+            total_ms += chrono::duration<double, milli>(chrono::high_resolution_clock::now() - tic).count();
+
+            // 刚更新过的轨迹的last_position就是匹配上的检测框
+            for(auto track : tracks){
+                if(!track->is_confirmed() || track->time_since_update() != 0) continue;
+
+                auto last = track->last_position();
+                for(int k = 0; k < frame.size(); ++k){
+                    if(fabs(frame[k].center_x() - last.center_x()) > 1 || fabs(frame[k].center_y() - last.center_y()) > 1) continue;
+
+                    auto iter = gt_to_track.find(gt_ids[t][k]);
+                    if(iter != gt_to_track.end() && iter->second != track->id())
+                        id_switch++;
+                    gt_to_track[gt_ids[t][k]] = track->id();
+                    covered++;
+                    break;
                 }
-                cv::split(crop, ms);
-                extractor->forward();
-
-                cv::Mat ofeat(1, outputtensor->size(1), CV_32F, outputtensor->cpu<float>());
-                cv::normalize(ofeat, ofeat, 1.0f, 0.0f, cv::NORM_L2);
-
-                DeepSORT::Box dbox;
-                dbox.left = box.left;
-                dbox.top = box.top;
-                dbox.right = box.right;
-                dbox.bottom = box.bottom;
-                dbox.feature = ofeat.clone();
-                dbboxes.emplace_back(dbox);
-			}
+            }
         }
+        INFO("%s: %.3f ms/frame, coverage %.3f, id switch = %d", name, total_ms / num_frames, covered / (float)max(1, num_detections), id_switch);
+    };
 
-        putText(image, format("%d", t), Point(10, 60), 0, 2, Scalar(0, 0, 255), 3, LINE_AA);
-        auto tracks = tracker->update(dbboxes);
-        DeepSORT::Box track_loc;
-        bool has_obj = false;
-        for(auto& track : tracks){
+    run("bucket(30)", DeepSORT::FeatureMode::Bucket, 0);
+    run("ema", DeepSORT::FeatureMode::EMA, 0);
+    run("ema+top3", DeepSORT::FeatureMode::EMA, 3);
+}
+
+/* ReID批量预处理在CPU上的耗时，特征由替身提取器计算，不需要GPU */
+static void benchmark_crop_batch(int num_boxes = 32, int repeat = 50){
+
+    cv::Mat image(1080, 1920, CV_8UC3);
+    cv::randu(image, cv::Scalar::all(0), cv::Scalar::all(255));
+
+    mt19937 rng(3);
+    uniform_real_distribution<float> uniform(0, 1);
+    vector<ReID::CropBox> crops;
+    for(int i = 0; i < num_boxes; ++i){
+        float x = uniform(rng) * 1800, y = uniform(rng) * 700;
+        crops.push_back({x, y, x + 40 + uniform(rng) * 120, y + 100 + uniform(rng) * 300});
+    }
+
+    auto extractor = ReID::create_dummy_extractor();
+    ReID::Image frame(image.data, image.cols, image.rows, image.step);
+    for(int num_threads : {1, 0}){
+
+        ReID::CropConfig config;
+        config.num_threads = num_threads;
+        auto batcher = ReID::create_crop_batcher(config);
+        vector<float> input(batcher->sample_size() * num_boxes);
+        vector<float> output(extractor->dim() * num_boxes);
+
+        double crop_ms = 0, extract_ms = 0;
+        for(int i = 0; i < repeat; ++i){
+            auto tick = chrono::steady_clock::now();
+            batcher->process(frame, crops.data(), num_boxes, input.data());
+            auto tock = chrono::steady_clock::now();
+            extractor->forward(input.data(), num_boxes, output.data());
+            crop_ms += chrono::duration<double, milli>(tock - tick).count();
+            extract_ms += chrono::duration<double, milli>(chrono::steady_clock::now() - tock).count();
+        }
+        INFO("crop batch: %d boxes, threads = %d, preprocess %.3f ms/frame, dummy extractor %.3f ms/frame",
+            num_boxes, num_threads, crop_ms / repeat, extract_ms / repeat
+        );
+    }
+}
+
+/* 多路流动态batch的调度开销与延迟，检测器为CPU替身，每路流按fps送帧并按帧序更新自己的跟踪器
+   每路流最多depth帧在途，frame来自一个环形缓冲区，等待下一帧期间按提交顺序取回已兑现的结果。
+   out of order为同一路流中后提交的帧先于前面的帧兑现的次数，前端按提交顺序兑现时应为0 */
+static void benchmark_batching(int num_streams = 8, int num_frames = 300, float fps = 60, int depth = 4){
+
+    struct Slot{
+        Pipeline::Frame frame;
+        shared_future<bool> future;
+        chrono::steady_clock::time_point commit_time;
+        bool reported = false;
+    };
+
+    auto detector = Pipeline::create_mock_batch_detector(8, 1, 16);
+    auto run = [&](int max_batch_size, float max_wait_ms){
+
+        Pipeline::BatchConfig config;
+        config.max_batch_size = max_batch_size;
+        config.max_wait_ms = max_wait_ms;
+        auto frontend = Pipeline::create_batch_frontend(detector, config);
+
+        vector<double> latency(num_streams, 0);
+        vector<int> out_of_order(num_streams, 0);
+        vector<int> max_inflight(num_streams, 0);
+        vector<thread> streams;
+        auto begin = chrono::steady_clock::now();
+        auto interval = chrono::microseconds(int(1000000 / fps));
+        for(int s = 0; s < num_streams; ++s){
+            streams.emplace_back([&, s]{
+
+                BYTETracker tracker;
+                vector<Slot> ring(depth);
+                int head = 0, inflight = 0;
+                int next_index = 0;
+
+                auto ready = [](const Slot& slot){
+                    return slot.future.wait_for(chrono::seconds(0)) == future_status::ready;
+                };
+
+                // 先记录后面的帧是否已兑现，再确认最早的帧尚未兑现，两者同时成立说明兑现顺序与提交顺序不一致
+                auto check_order = [&]{
+                    vector<int> resolved;
+                    for(int k = 1; k < inflight; ++k){
+                        auto& slot = ring[(head + k) % depth];
+                        if(!slot.reported && ready(slot))
+                            resolved.push_back((head + k) % depth);
+                    }
+
+                    if(resolved.empty() || ready(ring[head]))
+                        return;
+
+                    for(int k : resolved)
+                        ring[k].reported = true;
+                    out_of_order[s] += resolved.size();
+                };
+
+                // 以1ms为粒度等待最早的一帧，期间持续检查兑现顺序，超过deadline时返回false
+                auto wait_head = [&](chrono::steady_clock::time_point deadline){
+                    while(true){
+                        check_order();
+                        auto until = min(deadline, chrono::steady_clock::now() + chrono::milliseconds(1));
+                        if(ring[head].future.wait_until(until) == future_status::ready)
+                            return true;
+                        if(until == deadline)
+                            return false;
+                    }
+                };
+
+                auto consume = [&]{
+                    auto& slot = ring[head];
+                    slot.future.get();
+                    latency[s] += chrono::duration<double, milli>(chrono::steady_clock::now() - slot.commit_time).count();
+
+                    auto& frame = slot.frame;
+                    if(frame.index != next_index)
+                        INFOE("Stream %d expects frame %d, got %d", s, next_index, frame.index);
+                    next_index = frame.index + 1;
+
+                    vector<Object> objects;
+                    for(auto& box : frame.detections){
+                        Object obox;
+                        obox.prob = box.confidence;
+                        obox.label = box.class_label;
+                        obox.rect[0] = box.left;
+                        obox.rect[1] = box.top;
+                        obox.rect[2] = box.right - box.left;
+                        obox.rect[3] = box.bottom - box.top;
+                        objects.emplace_back(obox);
+                    }
+                    tracker.update(objects);
+
+                    head = (head + 1) % depth;
+                    inflight--;
+                };
+
+                for(int i = 0; i < num_frames; ++i){
+                    // 各路流错开相位，模拟互不同步的摄像头
+                    auto deadline = begin + interval * i + interval * s / num_streams;
+                    while(inflight > 0 && wait_head(deadline))
+                        consume();
 
-			if (track->is_confirmed() && track->time_since_update() == 0)
-			{
-				auto s = DeepSORT::get_color(track->id());
-                auto loc = track->location();
+                    // 环形缓冲区已满，解码侧只能等待最早的一帧
+                    if(inflight == depth){
+                        wait_head(chrono::steady_clock::time_point::max());
+                        consume();
+                    }
+                    this_thread::sleep_until(deadline);
 
-                if(track->id() == 1){
-                    has_obj = true;
-                    track_loc = loc;
+                    auto& slot = ring[(head + inflight) % depth];
+                    slot.frame.index = i;
+                    slot.frame.detections.clear();
+                    slot.reported = false;
+                    slot.commit_time = chrono::steady_clock::now();
+                    slot.future = frontend->commit(s, &slot.frame);
+                    inflight++;
+                    max_inflight[s] = max(max_inflight[s], inflight);
                 }
-				putText(image, format("%d", track->id()), Point(loc.left, loc.top+60), 
-                        0, 2, Scalar(0, 0, 255), 3, LINE_AA);
-                rectangle(image, Rect(loc.left, loc.top, loc.width(), loc.height()), Scalar(get<0>(s), get<1>(s), get<2>(s)), 3);
-			}
+
+                while(inflight > 0){
+                    wait_head(chrono::steady_clock::time_point::max());
+                    consume();
+                }
+            });
         }
+        for(auto& t : streams)
+            t.join();
+
+        double wall_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - begin).count();
+        auto stats = frontend->stats();
+        double mean_latency = 0;
+        int errors = 0;
+        int inflight = 0;
+        for(int s = 0; s < num_streams; ++s){
+            mean_latency += latency[s] / num_frames / num_streams;
+            errors += out_of_order[s];
+            inflight = max(inflight, max_inflight[s]);
+        }
+        INFO("batch %2d, wait %4.1f ms: %.1f fps, batch size %.2f (full %.0f%%), wait %.2f / %.2f ms, detect %.2f ms, latency %.2f ms, in flight %d, out of order %d",
+            max_batch_size, max_wait_ms, stats.frames / wall_ms * 1000, stats.mean_batch_size(),
+            stats.batches > 0 ? 100.0 * stats.full_batches / stats.batches : 0, stats.mean_wait_ms(), stats.max_wait_ms,
+            stats.mean_detect_ms(), mean_latency, inflight, errors
+        );
+    };
 
-        if(has_obj){
-
-            auto center = track_loc.center();
-            int width = track_loc.width();
-            int height = track_loc.height();
-
-            int dsth = image.rows * 0.7;
-            float scale = dsth / (float)height;
-            cv::Mat T0 = cv::Mat::eye(3, 3, CV_32F);
-            cv::Mat S = cv::Mat::eye(3, 3, CV_32F);
-            cv::Mat T1 = cv::Mat::eye(3, 3, CV_32F);
-            T0.at<float>(0, 2) = -center.x;
-            T0.at<float>(1, 2) = -center.y;
-            S.at<float>(0, 0) = scale;
-            S.at<float>(1, 1) = scale;
-            T1.at<float>(0, 2) = image.cols*0.5;
-            T1.at<float>(1, 2) = image.rows*0.5;
-            cv::Mat M = cv::Mat(T1 * S * T0)(cv::Range(0, 2), cv::Range(0, 3));
-            cv::warpAffine(image, image, M, image.size(), 1, 0, cv::Scalar::all(128));
+    run(1, 0);
+    run(4, 2);
+    run(8, 2);
+    run(8, 10);
+    run(16, 10);
+}
+
+/* 负载不变时单帧超出关联预算后能回到lapjv：warmup帧之后把预算临时改为1ns让一帧超时，
+   此后负载与耗时都没有变化，应当恰好降级probe_interval帧，随后的试探帧恢复lapjv并保持 */
+static bool check_association_recovery(int num_objects = 100, int probe_interval = 30){
+
+    BYTETracker tracker;
+    tracker.config().set_association_budget(1000, 0.7, probe_interval);
+
+    vector<Object> objects(num_objects);
+    auto run = [&](int frames){
+        for(int t = 0; t < frames; ++t){
+            for(int i = 0; i < num_objects; ++i){
+                auto& obj = objects[i];
+                obj.rect[0] = (i % 10) * 100 + tracker.stats().frames * 2.0f;
+                obj.rect[1] = (i / 10) * 160;
+                obj.rect[2] = 60;
+                obj.rect[3] = 150;
+                obj.prob    = 0.9;
+                obj.label   = 0;
+            }
+            tracker.update(objects);
         }
+    };
+
+    run(10);
+    tracker.config().association_budget_ms = 1e-6;
+    run(1);
+    tracker.config().association_budget_ms = 1000;
 
-        writer.write(image);
-        printf("process.\n");
+    run(probe_interval);
+    uint64_t degraded = tracker.stats().degraded_frames;
+    run(probe_interval);
+    uint64_t degraded_after_probe = tracker.stats().degraded_frames - degraded;
+
+    bool ok = degraded == probe_interval && degraded_after_probe == 0;
+    INFO("association recovery: degraded %d frames after one over-budget frame, %d frames after probe, %s",
+        (int)degraded, (int)degraded_after_probe, ok ? "passed" : "failed"
+    );
+    return ok;
+}
+
+/* 离线参数搜索，检测结果为inference_bytetrack记录的track.meta.bin，真值为MOTChallenge格式的gt.txt */
+static void sweep_trackers(const string& det_file = "track.meta.bin", const string& gt_file = "gt.txt", float latency_limit_ms = 5, int top = 5){
+
+    Eval::Sequence detections, ground_truth;
+    if(!Eval::load_sequence(det_file, false, detections) || !Eval::load_sequence(gt_file, true, ground_truth)){
+        INFOE("Load %s or %s failed", det_file.c_str(), gt_file.c_str());
+        return;
     }
-    fclose(f);
-    writer.release();
-    printf("Done.\n");
+
+    Eval::SweepConfig config;
+    config.latency_limit_ms = latency_limit_ms;
+
+    auto report = [&](const char* name, const vector<Eval::TrialResult>& results, const function<string(int)>& describe){
+        INFO("%s: %d configs", name, (int)results.size());
+        for(int i = 0; i < min<int>(top, results.size()); ++i){
+            auto& r = results[i];
+            INFO("  MOTA %.3f IDF1 %.3f IDSW %d, %.3f ms/frame p99 %.3f ms%s, %s",
+                r.metrics.mota(), r.metrics.idf1(), (int)r.metrics.id_switches, r.mean_frame_ms, r.p99_frame_ms,
+                r.within_limit ? "" : " (over limit)", describe(r.config_index).c_str()
+            );
+        }
+    };
+
+    Eval::ByteTrackGrid bytetrack_grid;
+    bytetrack_grid.track_thresh  = {0.3f, 0.4f, 0.5f, 0.6f};
+    bytetrack_grid.high_thresh   = {0.5f, 0.6f, 0.7f};
+    bytetrack_grid.match_thresh  = {0.7f, 0.8f, 0.9f};
+    bytetrack_grid.max_time_lost = {30, 90, 150};
+    bytetrack_grid.per_frame_motion = {{}, {0.1, 0.1, 0.1, 0.1, 0.2, 0.2, 1, 0.2}};
+    auto bytetrack_params = bytetrack_grid.expand();
+    auto bytetrack_results = Eval::run_sweep(detections, ground_truth, bytetrack_params.size(), [&](int i){
+        return Eval::create_bytetrack_trial(bytetrack_params[i]);
+    }, config);
+    report("bytetrack", bytetrack_results, [&](int i){return bytetrack_params[i].describe();});
+
+    Eval::DeepSORTGrid deepsort_grid;
+    deepsort_grid.distance_threshold = {30, 100, 300, 1000};
+    deepsort_grid.nhit    = {2, 3, 5};
+    deepsort_grid.max_age = {30, 150};
+    auto deepsort_params = deepsort_grid.expand();
+    auto deepsort_results = Eval::run_sweep(detections, ground_truth, deepsort_params.size(), [&](int i){
+        return Eval::create_deepsort_trial(deepsort_params[i]);
+    }, config);
+    report("deepsort", deepsort_results, [&](int i){return deepsort_params[i].describe();});
 }
 
 static void test(Yolo::Type type, TRT::Mode mode, const string& model){
@@ -332,5 +1039,13 @@ int main(){
     TRT::init_nv_plugins();
     test(Yolo::Type::V5, TRT::Mode::FP32, "yolov5s");
     //test(Yolo::Type::V3, TRT::Mode::FP32, "yolov3");
+    //benchmark_reid_index();
+    //benchmark_appearance_mode();
+    //replay_bytetrack();
+    //benchmark_crop_batch();
+    //benchmark_batching();
+    //check_association_recovery();
+    //inference_multistream(0, "yolov5s.FP32.trtmodel", Yolo::Type::V5, {"1652153992351250.mp4", "1652153992351250.mp4"});
+    //sweep_trackers();
     return 0;
 }
\ No newline at end of file
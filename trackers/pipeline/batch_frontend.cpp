@@ -0,0 +1,243 @@
+#include "batch_frontend.hpp"
+
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+#include <stdio.h>
+
+namespace Pipeline {
+
+    typedef std::chrono::steady_clock Clock;
+
+    static double elapsed_ms(const Clock::time_point& begin, const Clock::time_point& end = Clock::now()){
+        return std::chrono::duration<double, std::milli>(end - begin).count();
+    }
+
+    class MockBatchDetector : public BatchDetector{
+    public:
+        MockBatchDetector(float base_latency_ms, float per_image_ms, int max_batch_size, int boxes_per_image)
+            :base_latency_ms_(base_latency_ms), per_image_ms_(per_image_ms), max_batch_size_(max_batch_size), boxes_per_image_(boxes_per_image){}
+
+        virtual int max_batch_size() const override{return max_batch_size_;}
+
+        virtual bool detect(const std::vector<Frame*>& frames) override{
+
+            if(frames.size() > max_batch_size_){
+                printf("Batch %d exceeds max batch size %d\n", (int)frames.size(), max_batch_size_);
+                return false;
+            }
+
+            float latency = base_latency_ms_ + per_image_ms_ * frames.size();
+            std::this_thread::sleep_for(std::chrono::microseconds(int(latency * 1000)));
+
+            // 第i个框从(100 * i, 50 * i)出发，每帧移动(2, 1)个像素
+            for(auto frame : frames){
+                frame->detections.resize(boxes_per_image_);
+                for(int i = 0; i < boxes_per_image_; ++i){
+                    float x = 100 * i + 2 * frame->index;
+                    float y = 50 * i + frame->index;
+                    frame->detections[i] = {x, y, x + 60, y + 150, 0.9f, 0};
+                }
+            }
+            return true;
+        }
+
+    private:
+        float base_latency_ms_;
+        float per_image_ms_;
+        int max_batch_size_;
+        int boxes_per_image_;
+    };
+
+    std::shared_ptr<BatchDetector> create_mock_batch_detector(float base_latency_ms, float per_image_ms, int max_batch_size, int boxes_per_image){
+
+        if(max_batch_size < 1 || base_latency_ms < 0 || per_image_ms < 0 || boxes_per_image < 0){
+            printf("Invalid mock detector, max_batch_size = %d, base_latency_ms = %f, per_image_ms = %f, boxes_per_image = %d\n",
+                max_batch_size, base_latency_ms, per_image_ms, boxes_per_image);
+            return nullptr;
+        }
+        return std::make_shared<MockBatchDetector>(base_latency_ms, per_image_ms, max_batch_size, boxes_per_image);
+    }
+
+    class BatchFrontendImpl : public BatchFrontend{
+    public:
+        virtual ~BatchFrontendImpl(){
+            {
+                std::unique_lock<std::mutex> l(lock_);
+                stop_ = true;
+            }
+            cv_.notify_all();
+            if(worker_.joinable())
+                worker_.join();
+        }
+
+        bool startup(const std::shared_ptr<BatchDetector>& detector, const BatchConfig& config){
+
+            if(detector == nullptr || config.max_batch_size < 1 || config.max_wait_ms < 0){
+                printf("Invalid batch frontend, max_batch_size = %d, max_wait_ms = %f\n", config.max_batch_size, config.max_wait_ms);
+                return false;
+            }
+
+            detector_ = detector;
+            config_ = config;
+            config_.max_batch_size = std::min(config.max_batch_size, detector->max_batch_size());
+            worker_ = std::thread(&BatchFrontendImpl::worker, this);
+            return true;
+        }
+
+        virtual std::shared_future<bool> commit(int stream, Frame* frame) override{
+
+            Job job;
+            job.stream = stream;
+            job.frame  = frame;
+            job.commit_time = Clock::now();
+            std::shared_future<bool> future = job.result.get_future().share();
+            {
+                std::unique_lock<std::mutex> l(lock_);
+                if(stop_){
+                    job.result.set_value(false);
+                    return future;
+                }
+                jobs_.emplace_back(std::move(job));
+            }
+            cv_.notify_one();
+            return future;
+        }
+
+        virtual BatchStats stats() const override{
+            std::unique_lock<std::mutex> l(lock_);
+            return stats_;
+        }
+
+        virtual void reset_stats() override{
+            std::unique_lock<std::mutex> l(lock_);
+            stats_ = BatchStats();
+        }
+
+    private:
+        struct Job{
+            int stream = 0;
+            Frame* frame = nullptr;
+            Clock::time_point commit_time;
+            std::promise<bool> result;
+        };
+
+        void worker(){
+
+            std::vector<Job> batch;
+            std::vector<Frame*> frames;
+            auto max_wait = std::chrono::microseconds(int(config_.max_wait_ms * 1000));
+            while(true){
+                batch.clear();
+                frames.clear();
+                bool full = false;
+                {
+                    std::unique_lock<std::mutex> l(lock_);
+                    cv_.wait(l, [&]{return stop_ || !jobs_.empty();});
+                    if(stop_ && jobs_.empty())
+                        return;
+
+                    // 从最早的一帧开始计时，攒满或超时即发出
+                    auto deadline = jobs_.front().commit_time + max_wait;
+                    cv_.wait_until(l, deadline, [&]{return stop_ || jobs_.size() >= config_.max_batch_size;});
+
+                    int n = std::min<int>(jobs_.size(), config_.max_batch_size);
+                    full = n == config_.max_batch_size;
+                    for(int i = 0; i < n; ++i){
+                        batch.emplace_back(std::move(jobs_.front()));
+                        jobs_.pop_front();
+                    }
+                }
+
+                auto dispatch_time = Clock::now();
+                double wait_ms = 0, max_wait_ms = 0;
+                for(auto& job : batch){
+                    double w = elapsed_ms(job.commit_time, dispatch_time);
+                    wait_ms += w;
+                    max_wait_ms = std::max(max_wait_ms, w);
+                    frames.push_back(job.frame);
+                }
+
+                bool ok = detector_->detect(frames);
+                for(auto frame : frames)
+                    frame->detected = ok;
+                double detect_ms = elapsed_ms(dispatch_time);
+
+                {
+                    std::unique_lock<std::mutex> l(lock_);
+                    stats_.batches++;
+                    stats_.frames += batch.size();
+                    stats_.full_batches += full;
+                    stats_.wait_ms += wait_ms;
+                    stats_.max_wait_ms = std::max(stats_.max_wait_ms, max_wait_ms);
+                    stats_.detect_ms += detect_ms;
+                }
+
+                // 同一路流的帧在队列中保持提交顺序，batch也按顺序发出，因此结果按帧序兑现
+                for(auto& job : batch)
+                    job.result.set_value(ok);
+            }
+        }
+
+    private:
+        std::shared_ptr<BatchDetector> detector_;
+        BatchConfig config_;
+        std::thread worker_;
+        mutable std::mutex lock_;
+        std::condition_variable cv_;
+        std::deque<Job> jobs_;
+        BatchStats stats_;
+        bool stop_ = false;
+    };
+
+    std::shared_ptr<BatchFrontend> create_batch_frontend(const std::shared_ptr<BatchDetector>& detector, const BatchConfig& config){
+        std::shared_ptr<BatchFrontendImpl> instance(new BatchFrontendImpl());
+        if(!instance->startup(detector, config))
+            instance.reset();
+        return instance;
+    }
+
+    /* detect与wait分别在流水线的detect和track线程中调用，两者都按帧序进行，future按提交顺序排队 */
+    class FrontendDetector : public Detector{
+    public:
+        FrontendDetector(const std::shared_ptr<BatchFrontend>& frontend, int stream):frontend_(frontend), stream_(stream){}
+
+        virtual bool detect(Frame& frame) override{
+            auto future = frontend_->commit(stream_, &frame);
+            std::unique_lock<std::mutex> l(lock_);
+            pending_.emplace_back(&frame, future);
+            return true;
+        }
+
+        virtual bool wait(Frame& frame) override{
+
+            std::shared_future<bool> future;
+            {
+                std::unique_lock<std::mutex> l(lock_);
+                if(pending_.empty() || pending_.front().first != &frame){
+                    printf("Frame %d was not committed to stream %d\n", frame.index, stream_);
+                    return false;
+                }
+                future = pending_.front().second;
+                pending_.pop_front();
+            }
+            return future.get();
+        }
+
+    private:
+        std::shared_ptr<BatchFrontend> frontend_;
+        int stream_;
+        std::mutex lock_;
+        std::deque<std::pair<Frame*, std::shared_future<bool>>> pending_;
+    };
+
+    std::shared_ptr<Detector> create_frontend_detector(const std::shared_ptr<BatchFrontend>& frontend, int stream){
+        if(frontend == nullptr)
+            return nullptr;
+        return std::make_shared<FrontendDetector>(frontend, stream);
+    }
+
+}; // namespace Pipeline
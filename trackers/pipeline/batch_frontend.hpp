@@ -0,0 +1,70 @@
+
+#ifndef BATCH_FRONTEND_HPP
+#define BATCH_FRONTEND_HPP
+
+#include <memory>
+#include <vector>
+#include <future>
+#include "pipeline.hpp"
+
+/**
+ * 多路视频共享一个检测器时的动态batch前端
+ * 各路流调用commit提交一帧，得到一个future，调度线程把不同流的帧攒成batch交给BatchDetector，
+ * batch满max_batch_size或最早的一帧等待超过max_wait_ms时立即发出。
+ * 结果按提交顺序兑现，每路流在自己的线程里get之后按帧序更新自己的跟踪器
+ */
+namespace Pipeline {
+
+// 一次处理多帧的检测器，结果写入每一帧的detections
+class BatchDetector{
+public:
+    virtual int max_batch_size() const = 0;
+    virtual bool detect(const std::vector<Frame*>& frames) = 0;
+};
+
+/**
+ * @brief CPU上的模拟检测器，每个batch耗时base_latency_ms + per_image_ms * batch，
+ *        每帧输出boxes_per_image个随帧号匀速移动的框，用于在没有GPU时压测和调节batch参数
+ */
+std::shared_ptr<BatchDetector> create_mock_batch_detector(
+    float base_latency_ms = 8, float per_image_ms = 1, int max_batch_size = 16, int boxes_per_image = 10
+);
+
+struct BatchConfig{
+    int max_batch_size = 8;      // 不超过detector->max_batch_size()
+    float max_wait_ms  = 5;      // 最早的一帧最多等待多久就发出batch
+};
+
+struct BatchStats{
+    uint64_t batches   = 0;
+    uint64_t frames    = 0;
+    uint64_t full_batches = 0;   // 因为攒满而发出的batch
+    double wait_ms     = 0;      // 所有帧从commit到进入batch的时间之和
+    double max_wait_ms = 0;
+    double detect_ms   = 0;      // 检测器耗时之和
+
+    double mean_batch_size() const{return batches > 0 ? double(frames) / batches : 0;}
+    double mean_wait_ms() const{return frames > 0 ? wait_ms / frames : 0;}
+    double mean_detect_ms() const{return batches > 0 ? detect_ms / batches : 0;}
+};
+
+class BatchFrontend{
+public:
+    // 线程安全，frame在future兑现之前必须保持有效，future的值为检测是否成功
+    virtual std::shared_future<bool> commit(int stream, Frame* frame) = 0;
+    virtual BatchStats stats() const = 0;
+    virtual void reset_stats() = 0;
+};
+
+std::shared_ptr<BatchFrontend> create_batch_frontend(
+    const std::shared_ptr<BatchDetector>& detector,
+    const BatchConfig& config = BatchConfig()
+);
+
+// 把某一路流包装成流水线的异步Detector，detect阶段只提交到前端，track阶段取回结果，
+// 每路流可以有多帧同时在前端排队，batch大小可以超过流数
+std::shared_ptr<Detector> create_frontend_detector(const std::shared_ptr<BatchFrontend>& frontend, int stream);
+
+}; // namespace Pipeline
+
+#endif // BATCH_FRONTEND_HPP
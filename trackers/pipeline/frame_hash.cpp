@@ -0,0 +1,202 @@
+#include "frame_hash.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define FRAME_HASH_SSE
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define FRAME_HASH_NEON
+#endif
+
+namespace Pipeline {
+
+    /* DCT-II的基，C[k][n] = s(k) * cos(pi * (2n + 1) * k / 64)，s(0) = sqrt(1/32)，其余为sqrt(2/32) */
+    static const float* dct_basis(){
+        static struct Basis{
+            float values[32 * 32];
+            Basis(){
+                for(int k = 0; k < 32; ++k){
+                    double scale = k == 0 ? std::sqrt(1.0 / 32) : std::sqrt(2.0 / 32);
+                    for(int n = 0; n < 32; ++n)
+                        values[k * 32 + n] = scale * std::cos(M_PI * (2 * n + 1) * k / 64);
+                }
+            }
+        } basis;
+        return basis.values;
+    }
+
+    /* output[i][:] = sum_k a[i][k] * b[k][:]，a、b、output都是32列，只计算前rows行 */
+    static void multiply32(const float* a, const float* b, float* output, int rows){
+
+        for(int i = 0; i < rows; ++i){
+            const float* arow = a + i * 32;
+            float* orow = output + i * 32;
+#if defined(FRAME_HASH_SSE)
+            // 一行输出正好是8个寄存器，展开写以保证累加器不落到栈上
+            __m128 a0 = _mm_setzero_ps(), a1 = a0, a2 = a0, a3 = a0, a4 = a0, a5 = a0, a6 = a0, a7 = a0;
+            for(int k = 0; k < 32; ++k){
+                __m128 s = _mm_set1_ps(arow[k]);
+                const float* brow = b + k * 32;
+                a0 = _mm_add_ps(a0, _mm_mul_ps(s, _mm_loadu_ps(brow + 0)));
+                a1 = _mm_add_ps(a1, _mm_mul_ps(s, _mm_loadu_ps(brow + 4)));
+                a2 = _mm_add_ps(a2, _mm_mul_ps(s, _mm_loadu_ps(brow + 8)));
+                a3 = _mm_add_ps(a3, _mm_mul_ps(s, _mm_loadu_ps(brow + 12)));
+                a4 = _mm_add_ps(a4, _mm_mul_ps(s, _mm_loadu_ps(brow + 16)));
+                a5 = _mm_add_ps(a5, _mm_mul_ps(s, _mm_loadu_ps(brow + 20)));
+                a6 = _mm_add_ps(a6, _mm_mul_ps(s, _mm_loadu_ps(brow + 24)));
+                a7 = _mm_add_ps(a7, _mm_mul_ps(s, _mm_loadu_ps(brow + 28)));
+            }
+            _mm_storeu_ps(orow + 0, a0);
+            _mm_storeu_ps(orow + 4, a1);
+            _mm_storeu_ps(orow + 8, a2);
+            _mm_storeu_ps(orow + 12, a3);
+            _mm_storeu_ps(orow + 16, a4);
+            _mm_storeu_ps(orow + 20, a5);
+            _mm_storeu_ps(orow + 24, a6);
+            _mm_storeu_ps(orow + 28, a7);
+#elif defined(FRAME_HASH_NEON)
+            float32x4_t a0 = vdupq_n_f32(0), a1 = a0, a2 = a0, a3 = a0, a4 = a0, a5 = a0, a6 = a0, a7 = a0;
+            for(int k = 0; k < 32; ++k){
+                float s = arow[k];
+                const float* brow = b + k * 32;
+                a0 = vmlaq_n_f32(a0, vld1q_f32(brow + 0), s);
+                a1 = vmlaq_n_f32(a1, vld1q_f32(brow + 4), s);
+                a2 = vmlaq_n_f32(a2, vld1q_f32(brow + 8), s);
+                a3 = vmlaq_n_f32(a3, vld1q_f32(brow + 12), s);
+                a4 = vmlaq_n_f32(a4, vld1q_f32(brow + 16), s);
+                a5 = vmlaq_n_f32(a5, vld1q_f32(brow + 20), s);
+                a6 = vmlaq_n_f32(a6, vld1q_f32(brow + 24), s);
+                a7 = vmlaq_n_f32(a7, vld1q_f32(brow + 28), s);
+            }
+            vst1q_f32(orow + 0, a0);
+            vst1q_f32(orow + 4, a1);
+            vst1q_f32(orow + 8, a2);
+            vst1q_f32(orow + 12, a3);
+            vst1q_f32(orow + 16, a4);
+            vst1q_f32(orow + 20, a5);
+            vst1q_f32(orow + 24, a6);
+            vst1q_f32(orow + 28, a7);
+#else
+            float acc[32] = {0};
+            for(int k = 0; k < 32; ++k){
+                const float* brow = b + k * 32;
+                for(int j = 0; j < 32; ++j)
+                    acc[j] += arow[k] * brow[j];
+            }
+            memcpy(orow, acc, sizeof(acc));
+#endif
+        }
+    }
+
+    /* Y = C * X * C^T，两次都是按行广播的乘加：T = C * X，再由 C * T^T = Y^T 得到结果 */
+    void dct32x32(const float* input, float* output, int low){
+
+        low = std::max(1, std::min(low, 32));
+        const float* basis = dct_basis();
+        float temp[32 * 32];
+        float transposed[32 * 32] = {0};
+        multiply32(basis, input, temp, low);
+
+        for(int i = 0; i < low; ++i)
+            for(int j = 0; j < 32; ++j)
+                transposed[j * 32 + i] = temp[i * 32 + j];
+
+        multiply32(basis, transposed, temp, low);
+        for(int i = 0; i < low; ++i)
+            for(int j = 0; j < low; ++j)
+                output[j * 32 + i] = temp[i * 32 + j];
+    }
+
+    uint64_t dct_hash(const float* pixels){
+
+        float coeffs[32 * 32];
+        dct32x32(pixels, coeffs, 8);
+
+        float low[64];
+        for(int i = 0; i < 8; ++i)
+            memcpy(low + i * 8, coeffs + i * 32, sizeof(float) * 8);
+
+        // 直流分量只反映亮度，不参与中值
+        float ac[63];
+        float energy = 0;
+        for(int i = 1; i < 64; ++i){
+            ac[i - 1] = low[i];
+            energy += low[i] * low[i];
+        }
+
+        // 平坦的块(AC系数的均方根小于1个灰度级)只剩噪声，比较中值没有意义
+        if(energy < 63)
+            return 0;
+
+        std::nth_element(ac, ac + 31, ac + 63);
+        float median = ac[31];
+
+        uint64_t hash = 0;
+        for(int i = 1; i < 64; ++i){
+            if(low[i] > median)
+                hash |= uint64_t(1) << i;
+        }
+        return hash;
+    }
+
+    void compute_frame_hash(const cv::Mat& image, int grid, FrameHash& hash, cv::Mat& buffer){
+
+        grid = std::max(1, grid);
+        hash.grid = grid;
+        hash.tiles.resize(grid * grid);
+        if(image.empty()){
+            std::fill(hash.tiles.begin(), hash.tiles.end(), 0);
+            return;
+        }
+
+        // 先缩放再转灰度，全分辨率的画面只被INTER_AREA读一遍
+        int size = grid * 32;
+        cv::resize(image, buffer, cv::Size(size, size), 0, 0, cv::INTER_AREA);
+
+        int channels = buffer.channels();
+        float pixels[32 * 32];
+        for(int ty = 0; ty < grid; ++ty){
+            for(int tx = 0; tx < grid; ++tx){
+                for(int y = 0; y < 32; ++y){
+                    const uchar* row = buffer.ptr<uchar>(ty * 32 + y) + tx * 32 * channels;
+                    float* output = pixels + y * 32;
+                    if(channels >= 3){
+                        for(int x = 0; x < 32; ++x, row += channels)
+                            output[x] = 0.114f * row[0] + 0.587f * row[1] + 0.299f * row[2];
+                    }else{
+                        for(int x = 0; x < 32; ++x, row += channels)
+                            output[x] = row[0];
+                    }
+                }
+                hash.tiles[ty * grid + tx] = dct_hash(pixels);
+            }
+        }
+    }
+
+    static int popcount(uint64_t value){
+#if defined(__GNUC__)
+        return __builtin_popcountll(value);
+#else
+        int count = 0;
+        for(; value; value &= value - 1)
+            ++count;
+        return count;
+#endif
+    }
+
+    int hash_distance(const FrameHash& a, const FrameHash& b){
+
+        if(a.grid != b.grid || a.tiles.size() != b.tiles.size() || a.tiles.empty())
+            return 64;
+
+        int distance = 0;
+        for(int i = 0; i < a.tiles.size(); ++i)
+            distance = std::max(distance, popcount(a.tiles[i] ^ b.tiles[i]));
+        return distance;
+    }
+
+}; // namespace Pipeline
@@ -0,0 +1,41 @@
+
+#ifndef FRAME_HASH_HPP
+#define FRAME_HASH_HPP
+
+#include <vector>
+#include <stdint.h>
+#include <opencv2/opencv.hpp>
+
+/**
+ * 基于DCT的感知哈希(pHash)，用于判断画面是否与之前几乎相同
+ * 画面分为grid x grid块，每块缩放到32x32灰度图，做二维DCT-II后取左上角8x8低频系数，
+ * 与去掉直流分量后的中值比较得到64位哈希。两帧对应分块的汉明距离反映了该区域的结构变化，
+ * 对亮度的整体漂移、压缩噪声不敏感
+ */
+namespace Pipeline {
+
+// 32x32二维DCT-II，正交归一化，input与output按行主序
+// low < 32时只计算output左上角low x low的低频部分，其余元素不写入
+// x86上使用SSE，ARM上使用NEON，其余平台为标量实现
+void dct32x32(const float* input, float* output, int low = 32);
+
+// 一个32x32灰度块的64位哈希，低对比度的块系数都接近0，返回0，避免噪声造成哈希跳变
+uint64_t dct_hash(const float* pixels);
+
+struct FrameHash{
+    int grid = 0;
+    std::vector<uint64_t> tiles;      // grid x grid个分块，按行主序
+};
+
+/**
+ * @brief 计算一帧的分块哈希，image为BGR或灰度图
+ * @param buffer 缩放用的临时图像，逐帧复用可以避免重新分配
+ */
+void compute_frame_hash(const cv::Mat& image, int grid, FrameHash& hash, cv::Mat& buffer);
+
+// 所有分块中最大的汉明距离，分块数不同时返回64
+int hash_distance(const FrameHash& a, const FrameHash& b);
+
+}; // namespace Pipeline
+
+#endif // FRAME_HASH_HPP
@@ -0,0 +1,357 @@
+#include "pipeline.hpp"
+#include "spsc_queue.hpp"
+#include "frame_hash.hpp"
+#include "tracklog/track_log.hpp"
+
+#include <map>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+#include <stdio.h>
+
+namespace Pipeline {
+
+    typedef std::chrono::steady_clock Clock;
+
+    static double elapsed_ms(const Clock::time_point& begin){
+        return std::chrono::duration<double, std::milli>(Clock::now() - begin).count();
+    }
+
+    class ReplayDetector : public Detector{
+    public:
+        bool load(const std::string& file, float latency_ms){
+
+            latency_ms_ = latency_ms;
+            if(TrackLog::is_log_file(file))
+                return load_log(file);
+
+            FILE* f = fopen(file.c_str(), "rb");
+            if(f == nullptr){
+                printf("Open %s failed.\n", file.c_str());
+                return false;
+            }
+
+            char line[512];
+            while(fgets(line, sizeof(line), f)){
+                int index = 0, label = 0;
+                Detection det;
+                int n = sscanf(line, "%d %f %f %f %f %f %d", &index, &det.left, &det.top, &det.right, &det.bottom, &det.confidence, &label);
+                if(n < 6)
+                    continue;
+
+                det.class_label = n == 7 ? label : 0;
+                records_[index].push_back(det);
+            }
+            fclose(f);
+            return true;
+        }
+
+        /* 二进制日志中只回放检测结果，即track_id为-1的记录 */
+        bool load_log(const std::string& file){
+
+            auto reader = TrackLog::open_reader(file);
+            if(reader == nullptr)
+                return false;
+
+            reader->range(reader->first_frame(), reader->last_frame() + 1, [&](const TrackLog::FrameView& view){
+                auto& output = records_[view.frame];
+                for(int i = 0; i < view.count; ++i){
+                    if(view.track_id[i] != -1) continue;
+                    output.push_back({view.left[i], view.top[i], view.right[i], view.bottom[i], view.score[i], view.label[i]});
+                }
+            });
+            return true;
+        }
+
+        virtual bool detect(Frame& frame) override{
+
+            if(latency_ms_ > 0)
+                std::this_thread::sleep_for(std::chrono::microseconds(int(latency_ms_ * 1000)));
+
+            auto iter = records_.find(frame.index);
+            if(iter == records_.end())
+                frame.detections.clear();
+            else
+                frame.detections = iter->second;
+            return true;
+        }
+
+    private:
+        float latency_ms_ = 0;
+        std::map<int, std::vector<Detection>> records_;
+    };
+
+    std::shared_ptr<Detector> create_replay_detector(const std::string& file, float latency_ms){
+        std::shared_ptr<ReplayDetector> instance(new ReplayDetector());
+        if(!instance->load(file, latency_ms))
+            instance.reset();
+        return instance;
+    }
+
+    /* 流水线中的帧以指针传递，nullptr表示流结束 */
+    typedef SPSCQueue<Frame*> FrameQueue;
+
+    class RunnerImpl : public Runner{
+    public:
+        bool startup(const Stages& stages, const PipelineConfig& config){
+
+            if(!stages.decode || !stages.detector || !stages.track || config.pool_size < 1 || config.queue_capacity < 1 || config.detect_stride < 1){
+                printf("Invalid pipeline, decode, detector and track are required, pool_size = %d, queue_capacity = %d, detect_stride = %d\n", config.pool_size, config.queue_capacity, config.detect_stride);
+                return false;
+            }
+
+            if(config.dedup_distance >= 0 && (config.dedup_grid < 1 || config.dedup_max_skip < 1)){
+                printf("Invalid dedup config, dedup_grid = %d, dedup_max_skip = %d\n", config.dedup_grid, config.dedup_max_skip);
+                return false;
+            }
+
+            stages_ = stages;
+            config_ = config;
+            pool_.resize(config.pool_size);
+
+            const char* names[] = {"decode", "detect", "track", "render", "encode"};
+            stats_.resize(NumStages);
+            for(int i = 0; i < NumStages; ++i)
+                stats_[i].name = names[i];
+            return true;
+        }
+
+        virtual bool run() override{
+
+            for(auto& s : stats_){
+                std::string name = s.name;
+                s = StageStats();
+                s.name = name;
+            }
+            frames_ = 0;
+            failed_ = false;
+            detect_credit_ = 0;
+            detect_latency_ = 0;
+            detected_hash_ = FrameHash();
+            dedup_skipped_ = 0;
+
+            // 空闲帧队列从encode回到decode，预先放入全部帧。队列都是单生产者单消费者，每次运行重新创建
+            free_.reset(new FrameQueue(config_.pool_size));
+            for(auto& frame : pool_)
+                free_->try_push(&frame);
+
+            for(int i = 0; i < NumQueues; ++i)
+                queues_[i].reset(new FrameQueue(config_.queue_capacity));
+
+            auto begin = Clock::now();
+            std::thread threads[] = {
+                std::thread(&RunnerImpl::decode_worker, this),
+                std::thread(&RunnerImpl::stage_worker, this, 1, queues_[0].get(), queues_[1].get()),
+                std::thread(&RunnerImpl::stage_worker, this, 2, queues_[1].get(), queues_[2].get()),
+                std::thread(&RunnerImpl::stage_worker, this, 3, queues_[2].get(), queues_[3].get()),
+                std::thread(&RunnerImpl::stage_worker, this, 4, queues_[3].get(), free_.get())
+            };
+            for(auto& t : threads)
+                t.join();
+
+            wall_ms_ = elapsed_ms(begin);
+            return !failed_;
+        }
+
+        virtual const std::vector<StageStats>& stats() const override{return stats_;}
+        virtual double wall_ms() const override{return wall_ms_;}
+        virtual uint64_t frames() const override{return frames_;}
+
+    private:
+        void decode_worker(){
+
+            auto& stat = stats_[0];
+            auto output = queues_[0].get();
+            int index = 0;
+            while(true){
+                // 没有空闲帧说明下游处理不过来，计入blocked
+                Frame* frame = nullptr;
+                stat.blocked_ms += free_->pop(frame);
+
+                auto tick = Clock::now();
+                frame->timestamp = 0;
+                bool ok = !failed_ && stages_.decode(*frame);
+                stat.busy_ms += elapsed_ms(tick);
+                if(!ok){
+                    // 取出的空闲帧不再归还，下一次run会重建空闲队列
+                    stat.blocked_ms += output->push(nullptr);
+                    break;
+                }
+
+                frame->index = index++;
+                frame->detected = false;
+                frame->detections.clear();
+                frame->tracks.clear();
+                ++stat.frames;
+                stat.blocked_ms += output->push(frame);
+            }
+        }
+
+        /* 除decode之外的各级，encode的输出队列就是空闲帧队列 */
+        void stage_worker(int stage, FrameQueue* input, FrameQueue* output){
+
+            auto& stat = stats_[stage];
+            while(true){
+                Frame* frame = nullptr;
+                stat.queue_depth_sum += input->size();
+                stat.starved_ms += input->pop(frame);
+                if(frame == nullptr){
+                    if(output != free_.get())
+                        stat.blocked_ms += output->push(nullptr);
+                    break;
+                }
+
+                // 等待异步检测结果的时间计入starved
+                if(stage == 2)
+                    stat.starved_ms += wait_detection(*frame);
+
+                auto tick = Clock::now();
+                process(stage, *frame);
+                stat.busy_ms += elapsed_ms(tick);
+                ++stat.frames;
+
+                if(stage == NumStages - 1)
+                    ++frames_;
+                stat.blocked_ms += output->push(frame);
+            }
+        }
+
+        void process(int stage, Frame& frame){
+            switch(stage){
+            case 1:
+                detect(frame);
+                break;
+            case 2: stages_.track(frame); break;
+            case 3: if(stages_.render) stages_.render(frame); break;
+            case 4: if(stages_.encode) stages_.encode(frame); break;
+            }
+        }
+
+        void detect(Frame& frame){
+
+            if(!should_detect(frame)){
+                ++stats_[1].skipped;
+                return;
+            }
+
+            if(is_duplicate(frame)){
+                ++stats_[1].skipped;
+                ++stats_[1].deduped;
+                return;
+            }
+
+            // 异步检测器的结果由其他线程写入，detected必须在提交之前设置
+            auto tick = Clock::now();
+            frame.detected = true;
+            if(!stages_.detector->detect(frame)){
+                printf("Detect frame %d failed\n", frame.index);
+                frame.detected = false;
+                failed_ = true;
+                return;
+            }
+
+            // 之后的帧与这一帧比较
+            if(config_.dedup_distance >= 0){
+                std::swap(detected_hash_, frame_hash_);
+                dedup_skipped_ = 0;
+            }
+
+            double latency = elapsed_ms(tick);
+            detect_latency_ = detect_latency_ == 0 ? latency : detect_latency_ * 0.9 + latency * 0.1;
+            detect_credit_ -= latency;
+        }
+
+        /* 在track线程中调用，同步检测器直接返回 */
+        double wait_detection(Frame& frame){
+
+            if(!frame.detected)
+                return 0;
+
+            auto tick = Clock::now();
+            if(!stages_.detector->wait(frame)){
+                printf("Detect frame %d failed\n", frame.index);
+                frame.detected = false;
+                failed_ = true;
+            }
+            return elapsed_ms(tick);
+        }
+
+        /* 每帧获得detect_budget_ms的额度，额度不少于检测器的平均耗时才运行，额度上限防止空闲后集中检测 */
+        bool should_detect(const Frame& frame){
+
+            if(config_.detect_stride > 1 && frame.index % config_.detect_stride != 0)
+                return false;
+
+            if(config_.detect_budget_ms <= 0)
+                return true;
+
+            detect_credit_ = std::min<double>(detect_credit_ + config_.detect_budget_ms, detect_latency_ + config_.detect_budget_ms);
+            return detect_credit_ >= detect_latency_;
+        }
+
+        /* 只对将要检测的帧计算哈希，与上一次检测的帧每个分块的汉明距离都不超过dedup_distance则认为画面没有变化 */
+        bool is_duplicate(const Frame& frame){
+
+            if(config_.dedup_distance < 0)
+                return false;
+
+            auto& stat = stats_[1];
+            auto tick = Clock::now();
+            compute_frame_hash(frame.image, config_.dedup_grid, frame_hash_, hash_buffer_);
+            stat.hash_ms += elapsed_ms(tick);
+            ++stat.hashed;
+
+            if(dedup_skipped_ >= config_.dedup_max_skip || hash_distance(frame_hash_, detected_hash_) > config_.dedup_distance)
+                return false;
+
+            ++dedup_skipped_;
+            return true;
+        }
+
+    private:
+        static const int NumStages = 5;
+        static const int NumQueues = NumStages - 1;
+
+        Stages stages_;
+        PipelineConfig config_;
+        std::vector<Frame> pool_;
+        std::unique_ptr<FrameQueue> free_;
+        std::unique_ptr<FrameQueue> queues_[NumQueues];
+        std::vector<StageStats> stats_;
+        std::atomic<bool> failed_{false};
+        std::atomic<uint64_t> frames_{0};
+        double wall_ms_ = 0;
+
+        // 只在detect线程中访问
+        double detect_credit_ = 0;
+        double detect_latency_ = 0;
+        FrameHash frame_hash_;
+        FrameHash detected_hash_;
+        cv::Mat hash_buffer_;
+        int dedup_skipped_ = 0;
+    };
+
+    std::shared_ptr<Runner> create_runner(const Stages& stages, const PipelineConfig& config){
+        std::shared_ptr<RunnerImpl> instance(new RunnerImpl());
+        if(!instance->startup(stages, config))
+            instance.reset();
+        return instance;
+    }
+
+    void print_stats(const Runner& runner){
+
+        double wall = runner.wall_ms();
+        printf("pipeline: %d frames in %.1f ms, %.1f fps\n", (int)runner.frames(), wall, wall > 0 ? runner.frames() / wall * 1000 : 0);
+        for(auto& s : runner.stats()){
+            printf("  %-7s busy %7.3f ms/frame, occupancy %5.1f%%, starved %8.1f ms, blocked %8.1f ms, queue depth %.2f, skipped %d\n",
+                s.name.c_str(), s.busy_per_frame(), s.occupancy(wall) * 100, s.starved_ms, s.blocked_ms, s.mean_queue_depth(), (int)s.skipped
+            );
+            if(s.hashed > 0){
+                printf("  %-7s deduped %d / %d frames (%.1f%%), hash %.3f ms/frame\n",
+                    "", (int)s.deduped, (int)s.frames, s.frames > 0 ? s.deduped * 100.0 / s.frames : 0, s.hash_per_frame()
+                );
+            }
+        }
+    }
+
+}; // namespace Pipeline
@@ -0,0 +1,115 @@
+
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+#include <memory>
+#include <vector>
+#include <string>
+#include <functional>
+#include <opencv2/opencv.hpp>
+
+/**
+ * 分级并发的视频处理流水线：decode -> detect -> track -> render -> encode
+ * 每一级一个线程，级与级之间是有界的无锁队列，帧缓冲区来自固定大小的池，encode之后归还。
+ * 池和队列的容量共同限制了在途帧数，下游变慢时上游自然阻塞，吞吐接近最慢的一级而不是各级之和
+ */
+namespace Pipeline {
+
+struct Detection{
+    float left, top, right, bottom, confidence;
+    int class_label;
+};
+
+struct TrackBox{
+    float left, top, right, bottom;
+    int id;
+};
+
+// 帧缓冲区在流水线中循环使用，各级只写自己负责的字段
+struct Frame{
+    int index = 0;
+    double timestamp = 0;                // 毫秒，decode阶段填写，用于计算跟踪器的dt
+    cv::Mat image;                       // decode时复用，尺寸不变则不会重新分配
+    bool detected = false;               // false表示检测器跳过了这一帧，跟踪器应只做预测
+    std::vector<Detection> detections;   // detect阶段写入
+    cv::Mat features;                    // detect阶段可选写入的外观特征，第k行对应第k个需要跟踪的检测框
+    std::vector<TrackBox> tracks;        // track阶段写入，供render使用
+};
+
+// 检测器接口，流水线不关心检测器的实现，可以是TensorRT引擎，也可以是回放记录的CPU替身
+// 异步检测器在detect中只提交，track阶段处理这一帧之前调用wait取回结果，期间detect阶段继续提交后续帧，
+// 在途帧数受queue_capacity与pool_size限制。异步时detect_budget_ms按提交耗时计算额度，基本不会跳帧
+class Detector{
+public:
+    virtual bool detect(Frame& frame) = 0;
+    virtual bool wait(Frame& frame){return true;}
+};
+
+/**
+ * @brief 回放记录的检测结果，file可以是TrackLog二进制日志(track.meta.bin)，
+ *        也可以是每行为 "frame left top right bottom confidence [class_label]" 的文本，class_label缺省为0
+ * @param latency_ms 模拟的每帧推理耗时
+ */
+std::shared_ptr<Detector> create_replay_detector(const std::string& file, float latency_ms = 0);
+
+struct Stages{
+    std::function<bool(Frame& frame)> decode;     // 读取下一帧到frame.image并填写timestamp，返回false表示结束
+    std::shared_ptr<Detector> detector;
+    std::function<void(Frame& frame)> track;       // 按帧序调用
+    std::function<void(Frame& frame)> render;      // 可以为空
+    std::function<void(Frame& frame)> encode;      // 可以为空
+};
+
+struct PipelineConfig{
+    int pool_size      = 8;   // 帧缓冲区个数，即最大在途帧数
+    int queue_capacity = 4;   // 相邻两级之间的队列容量
+
+    // 检测器跳帧，两个条件同时满足时才运行检测
+    int detect_stride       = 1;    // 每k帧检测一次
+    float detect_budget_ms  = 0;    // 每帧分配给检测器的时间，按检测器的平均耗时累积额度，0表示不限制
+
+    // 感知哈希去重，画面与上一次检测的帧几乎相同时跳过检测，跟踪器只做预测。与上一次检测的帧而不是上一帧比较，缓慢的变化不会被逐帧漏掉
+    int dedup_distance  = -1;       // 每个分块允许的最大汉明距离(0~64)，-1表示不去重
+    int dedup_grid      = 4;        // 画面分为grid x grid块，画面局部的小目标变化不会被整帧平均掉
+    int dedup_max_skip  = 30;       // 最多连续去重的帧数，超过后强制检测一次
+};
+
+struct StageStats{
+    std::string name;
+    uint64_t frames   = 0;
+    uint64_t skipped  = 0;    // detect阶段跳过的帧
+    uint64_t deduped  = 0;    // 其中因为与上一次检测的帧几乎相同而跳过的帧
+    uint64_t hashed   = 0;    // 计算了感知哈希的帧
+    double hash_ms    = 0;    // 计算感知哈希的时间，包含在busy_ms中
+    double busy_ms    = 0;    // 处理帧的时间
+    double starved_ms = 0;    // 等待上游(输入队列为空)的时间
+    double blocked_ms = 0;    // 等待下游(输出队列已满)的时间
+    double queue_depth_sum = 0;   // 每次取帧时输入队列的深度之和
+
+    // 处理时间占运行时间的比例，最接近1的一级就是瓶颈
+    double occupancy(double wall_ms) const{return wall_ms > 0 ? busy_ms / wall_ms : 0;}
+    double busy_per_frame() const{return frames > 0 ? busy_ms / frames : 0;}
+    double mean_queue_depth() const{return frames > 0 ? queue_depth_sum / frames : 0;}
+    double hash_per_frame() const{return hashed > 0 ? hash_ms / hashed : 0;}
+};
+
+class Runner{
+public:
+    // 阻塞运行直到decode返回false且所有在途帧处理完毕
+    virtual bool run() = 0;
+    virtual const std::vector<StageStats>& stats() const = 0;
+    virtual double wall_ms() const = 0;
+    virtual uint64_t frames() const = 0;
+};
+
+std::shared_ptr<Runner> create_runner(
+    const Stages& stages,
+    const PipelineConfig& config = PipelineConfig()
+);
+
+// 打印每一级的统计
+void print_stats(const Runner& runner);
+
+}; // namespace Pipeline
+
+#endif // PIPELINE_HPP
@@ -0,0 +1,130 @@
+#include "renderer.hpp"
+#include "spsc_queue.hpp"
+
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <stdio.h>
+
+namespace Pipeline {
+
+    typedef std::chrono::steady_clock Clock;
+
+    static double elapsed_ms(const Clock::time_point& begin){
+        return std::chrono::duration<double, std::milli>(Clock::now() - begin).count();
+    }
+
+    /* 槽位编号在两个单生产者单消费者队列之间循环：free_由渲染线程归还、跟踪线程取出，ready_方向相反，-1表示结束 */
+    class RendererImpl : public Renderer{
+    public:
+        virtual ~RendererImpl(){
+            close();
+        }
+
+        bool startup(const std::function<void(RenderFrame& frame)>& render, int ring_size){
+
+            if(!render || ring_size < 1){
+                printf("Invalid renderer, render is required, ring_size = %d\n", ring_size);
+                return false;
+            }
+
+            render_ = render;
+            slots_.resize(ring_size);
+            free_.reset(new SPSCQueue<int>(ring_size));
+            ready_.reset(new SPSCQueue<int>(ring_size + 1));
+            for(int i = 0; i < ring_size; ++i)
+                free_->try_push(i);
+
+            worker_ = std::thread(&RendererImpl::worker, this);
+            return true;
+        }
+
+        virtual bool submit(int index, cv::Mat& image, const TrackBox* tracks, int count) override{
+
+            auto tick = Clock::now();
+            ++submitted_;
+
+            int slot = -1;
+            if(closed_ || !free_->try_pop(slot)){
+                ++dropped_;
+                submit_ms_ = submit_ms_ + elapsed_ms(tick);
+                return false;
+            }
+
+            auto& frame = slots_[slot];
+            frame.index = index;
+            std::swap(frame.image, image);
+            frame.tracks.assign(tracks, tracks + count);
+            ready_->try_push(slot);
+
+            submit_ms_ = submit_ms_ + elapsed_ms(tick);
+            return true;
+        }
+
+        virtual void close() override{
+            if(closed_ || !worker_.joinable())
+                return;
+
+            closed_ = true;
+            ready_->push(-1);
+            worker_.join();
+        }
+
+        virtual RenderStats stats() const override{
+            RenderStats output;
+            output.submitted = submitted_;
+            output.rendered  = rendered_;
+            output.dropped   = dropped_;
+            output.render_ms = render_ms_;
+            output.submit_ms = submit_ms_;
+            return output;
+        }
+
+    private:
+        void worker(){
+
+            while(true){
+                int slot = -1;
+                ready_->pop(slot);
+                if(slot < 0)
+                    break;
+
+                auto tick = Clock::now();
+                render_(slots_[slot]);
+                render_ms_ = render_ms_ + elapsed_ms(tick);
+                ++rendered_;
+                free_->push(slot);
+            }
+        }
+
+    private:
+        std::function<void(RenderFrame& frame)> render_;
+        std::vector<RenderFrame> slots_;
+        std::unique_ptr<SPSCQueue<int>> free_;
+        std::unique_ptr<SPSCQueue<int>> ready_;
+        std::thread worker_;
+        bool closed_ = false;      // 只在提交线程中访问
+
+        // 各自只有一个线程写入
+        std::atomic<uint64_t> submitted_{0};
+        std::atomic<uint64_t> dropped_{0};
+        std::atomic<uint64_t> rendered_{0};
+        std::atomic<double> submit_ms_{0};
+        std::atomic<double> render_ms_{0};
+    };
+
+    std::shared_ptr<Renderer> create_renderer(const std::function<void(RenderFrame& frame)>& render, int ring_size){
+        std::shared_ptr<RendererImpl> instance(new RendererImpl());
+        if(!instance->startup(render, ring_size))
+            instance.reset();
+        return instance;
+    }
+
+    void print_stats(const RenderStats& stats){
+        printf("render: %d submitted, %d rendered, %d dropped (%.1f%%), render %.3f ms/frame, submit %.3f ms/frame\n",
+            (int)stats.submitted, (int)stats.rendered, (int)stats.dropped, stats.drop_rate() * 100,
+            stats.render_per_frame(), stats.submit_per_frame()
+        );
+    }
+
+}; // namespace Pipeline
@@ -0,0 +1,63 @@
+
+#ifndef RENDERER_HPP
+#define RENDERER_HPP
+
+#include <memory>
+#include <vector>
+#include <functional>
+#include "pipeline.hpp"
+
+/**
+ * 脱离跟踪线程的异步渲染
+ * 跟踪线程submit一帧画面和轨迹快照，画框、缩放、编码都在渲染线程中完成。
+ * 两者之间是固定槽位的无锁环，画面缓冲区以交换而不是拷贝的方式交接，
+ * 渲染或编码跟不上时新提交的帧直接丢弃，跟踪线程永远不会等待渲染。
+ * 无界面部署时不创建Renderer即可，跟踪路径上不再有任何绘制相关的开销
+ */
+namespace Pipeline {
+
+struct RenderFrame{
+    int index = 0;
+    cv::Mat image;
+    std::vector<TrackBox> tracks;
+};
+
+struct RenderStats{
+    uint64_t submitted = 0;
+    uint64_t rendered  = 0;
+    uint64_t dropped   = 0;     // 没有空闲槽位而丢弃的帧
+    double render_ms   = 0;     // 渲染线程中回调的耗时之和
+    double submit_ms   = 0;     // 跟踪线程中submit的耗时之和
+
+    double render_per_frame() const{return rendered > 0 ? render_ms / rendered : 0;}
+    double submit_per_frame() const{return submitted > 0 ? submit_ms / submitted : 0;}
+    double drop_rate() const{return submitted > 0 ? double(dropped) / submitted : 0;}
+};
+
+class Renderer{
+public:
+    /**
+     * @brief 只能在一个线程中调用，从不阻塞
+     *        image与空闲槽位中的缓冲区交换，返回后image是渲染线程用过的旧缓冲区，内容无意义，可以直接用于解码下一帧。
+     *        没有空闲槽位时丢弃这一帧并返回false，image保持不变
+     */
+    virtual bool submit(int index, cv::Mat& image, const TrackBox* tracks, int count) = 0;
+
+    // 渲染完已提交的帧后结束渲染线程，之后submit总是返回false
+    virtual void close() = 0;
+
+    // 计数在两个线程中累加，close之前读取时为近似值
+    virtual RenderStats stats() const = 0;
+};
+
+/**
+ * @brief render在渲染线程中按帧序调用，负责画框和写入视频，可以直接修改frame.image
+ * @param ring_size 槽位数，即允许渲染线程落后的最大帧数
+ */
+std::shared_ptr<Renderer> create_renderer(const std::function<void(RenderFrame& frame)>& render, int ring_size = 4);
+
+void print_stats(const RenderStats& stats);
+
+}; // namespace Pipeline
+
+#endif // RENDERER_HPP
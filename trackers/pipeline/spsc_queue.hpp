@@ -0,0 +1,112 @@
+
+#ifndef SPSC_QUEUE_HPP
+#define SPSC_QUEUE_HPP
+
+#include <atomic>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <stddef.h>
+
+namespace Pipeline {
+
+/**
+ * @brief 有界的单生产者单消费者无锁队列
+ *
+ * 底层数组大小向上取整为2的幂，head/tail之间用填充隔开，避免生产者和消费者争用同一个cache line。
+ * push/pop在队列满/空时先自旋，再让出时间片，再短暂休眠，满时即形成对上游的反压
+ */
+template<typename _T>
+class SPSCQueue{
+public:
+    explicit SPSCQueue(size_t capacity){
+        size_t n = 2;
+        while(n < capacity) n <<= 1;
+        buffer_.resize(n);
+        mask_ = n - 1;
+        capacity_ = capacity;
+    }
+
+    SPSCQueue(const SPSCQueue&) = delete;
+    SPSCQueue& operator=(const SPSCQueue&) = delete;
+
+    bool try_push(const _T& value){
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if(tail - head_cache_ >= capacity_){
+            head_cache_ = head_.load(std::memory_order_acquire);
+            if(tail - head_cache_ >= capacity_)
+                return false;
+        }
+        buffer_[tail & mask_] = value;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(_T& value){
+        size_t head = head_.load(std::memory_order_relaxed);
+        if(head == tail_cache_){
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            if(head == tail_cache_)
+                return false;
+        }
+        value = buffer_[head & mask_];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 阻塞直到成功，返回等待的时间(毫秒)
+    double push(const _T& value){
+        if(try_push(value))
+            return 0;
+
+        auto tick = std::chrono::steady_clock::now();
+        for(int spin = 0; !try_push(value); ++spin)
+            backoff(spin);
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tick).count();
+    }
+
+    double pop(_T& value){
+        if(try_pop(value))
+            return 0;
+
+        auto tick = std::chrono::steady_clock::now();
+        for(int spin = 0; !try_pop(value); ++spin)
+            backoff(spin);
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tick).count();
+    }
+
+    // 近似值，生产者和消费者都可以调用
+    size_t size() const{
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const{return capacity_;}
+
+private:
+    static void backoff(int spin){
+        if(spin < 64)
+            return;
+        if(spin < 128)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+
+private:
+    std::vector<_T> buffer_;
+    size_t mask_ = 0;
+    size_t capacity_ = 0;
+
+    char pad0_[64];
+    std::atomic<size_t> head_{0};
+    size_t tail_cache_ = 0;     // 消费者持有的tail副本
+
+    char pad1_[64];
+    std::atomic<size_t> tail_{0};
+    size_t head_cache_ = 0;     // 生产者持有的head副本
+    char pad2_[64];
+};
+
+}; // namespace Pipeline
+
+#endif // SPSC_QUEUE_HPP
@@ -0,0 +1,296 @@
+#include "crop_batch.hpp"
+
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <stdio.h>
+
+namespace ReID {
+
+    /* 与cv::resize(INTER_LINEAR)相同的坐标映射，每个输出列对应源图中的两个像素偏移和一个权重 */
+    struct ResizeTable{
+        std::vector<int> x0, x1;
+        std::vector<float> alpha;
+
+        void resize(int width){
+            x0.resize(width);
+            x1.resize(width);
+            alpha.resize(width);
+        }
+    };
+
+    static void map_coordinate(int dst, float scale, int size, int& i0, int& i1, float& weight){
+        float f = (dst + 0.5f) * scale - 0.5f;
+        int i = (int)std::floor(f);
+        weight = f - i;
+        if(i < 0){
+            i = 0;
+            weight = 0;
+        }
+        if(i >= size - 1){
+            i = size - 1;
+            weight = 0;
+        }
+        i0 = i;
+        i1 = std::min(i + 1, size - 1);
+    }
+
+    class CropBatcherImpl : public CropBatcher{
+    public:
+        virtual ~CropBatcherImpl(){
+            {
+                std::unique_lock<std::mutex> l(lock_);
+                stop_ = true;
+            }
+            job_cv_.notify_all();
+            for(auto& t : workers_)
+                t.join();
+        }
+
+        bool startup(const CropConfig& config){
+
+            if(config.width < 1 || config.height < 1 || config.std[0] == 0 || config.std[1] == 0 || config.std[2] == 0){
+                printf("Invalid crop config, width = %d, height = %d, std = [%f, %f, %f]\n",
+                    config.width, config.height, config.std[0], config.std[1], config.std[2]);
+                return false;
+            }
+
+            config_ = config;
+            for(int c = 0; c < 3; ++c){
+                scale_[c] = 1.0f / config.std[c];
+                bias_[c]  = -config.mean[c] / config.std[c];
+            }
+
+            int num_threads = config.num_threads > 0 ? config.num_threads : std::thread::hardware_concurrency();
+            num_threads = std::max(1, num_threads);
+            tables_.resize(num_threads);
+            for(auto& table : tables_)
+                table.resize(config.width);
+
+            for(int i = 1; i < num_threads; ++i)
+                workers_.emplace_back(&CropBatcherImpl::worker, this, i);
+            return true;
+        }
+
+        virtual void process(const Image& image, const CropBox* boxes, int count, float* output) override{
+
+            if(count <= 0)
+                return;
+
+            image_  = image;
+            boxes_  = boxes;
+            count_  = count;
+            output_ = output;
+            next_   = 0;
+
+            // 只有一个框时不唤醒工作线程
+            if(workers_.empty() || count == 1){
+                drain(tables_[0]);
+                return;
+            }
+
+            {
+                std::unique_lock<std::mutex> l(lock_);
+                pending_ = workers_.size();
+                ++generation_;
+            }
+            job_cv_.notify_all();
+            drain(tables_[0]);
+
+            std::unique_lock<std::mutex> l(lock_);
+            done_cv_.wait(l, [&]{return pending_ == 0;});
+        }
+
+        virtual const CropConfig& config() const override{return config_;}
+        virtual size_t sample_size() const override{return (size_t)3 * config_.width * config_.height;}
+
+    private:
+        void worker(int index){
+
+            uint64_t seen = 0;
+            while(true){
+                {
+                    std::unique_lock<std::mutex> l(lock_);
+                    job_cv_.wait(l, [&]{return stop_ || generation_ != seen;});
+                    if(stop_)
+                        return;
+                    seen = generation_;
+                }
+
+                drain(tables_[index]);
+
+                std::unique_lock<std::mutex> l(lock_);
+                if(--pending_ == 0)
+                    done_cv_.notify_one();
+            }
+        }
+
+        void drain(ResizeTable& table){
+            int i = 0;
+            while((i = next_.fetch_add(1)) < count_)
+                crop_resize_normalize(boxes_[i], output_ + sample_size() * i, table);
+        }
+
+        /* 裁剪、缩放、归一化、BGR交错转平面一次完成，直接写入output */
+        void crop_resize_normalize(const CropBox& box, float* output, ResizeTable& table){
+
+            int width  = config_.width;
+            int height = config_.height;
+            int area   = width * height;
+
+            // 与cv::Rect(cv::Point(left, top), cv::Point(right, bottom)) & 图像范围一致
+            int left   = std::max(0, (int)std::lround(box.left));
+            int top    = std::max(0, (int)std::lround(box.top));
+            int right  = std::min(image_.width, (int)std::lround(box.right));
+            int bottom = std::min(image_.height, (int)std::lround(box.bottom));
+            int crop_width  = right - left;
+            int crop_height = bottom - top;
+            if(crop_width <= 0 || crop_height <= 0){
+                memset(output, 0, sizeof(float) * area * 3);
+                return;
+            }
+
+            float scale_x = crop_width / (float)width;
+            float scale_y = crop_height / (float)height;
+            for(int dx = 0; dx < width; ++dx){
+                int x0, x1;
+                map_coordinate(dx, scale_x, crop_width, x0, x1, table.alpha[dx]);
+                table.x0[dx] = (left + x0) * 3;
+                table.x1[dx] = (left + x1) * 3;
+            }
+
+            int planes[3] = {0, 1, 2};
+            if(config_.bgr2rgb)
+                std::swap(planes[0], planes[2]);
+
+            float* plane[3] = {output + planes[0] * area, output + planes[1] * area, output + planes[2] * area};
+            float scale[3] = {scale_[planes[0]], scale_[planes[1]], scale_[planes[2]]};
+            float bias[3]  = {bias_[planes[0]], bias_[planes[1]], bias_[planes[2]]};
+            const int* ix0 = table.x0.data();
+            const int* ix1 = table.x1.data();
+            const float* alpha = table.alpha.data();
+
+            for(int dy = 0; dy < height; ++dy){
+                int y0, y1;
+                float beta;
+                map_coordinate(dy, scale_y, crop_height, y0, y1, beta);
+
+                const uint8_t* row0 = image_.data + (size_t)(top + y0) * image_.stride;
+                const uint8_t* row1 = image_.data + (size_t)(top + y1) * image_.stride;
+                float* out0 = plane[0] + dy * width;
+                float* out1 = plane[1] + dy * width;
+                float* out2 = plane[2] + dy * width;
+                float w00 = 1 - beta;
+
+                for(int dx = 0; dx < width; ++dx){
+                    const uint8_t* p00 = row0 + ix0[dx];
+                    const uint8_t* p01 = row0 + ix1[dx];
+                    const uint8_t* p10 = row1 + ix0[dx];
+                    const uint8_t* p11 = row1 + ix1[dx];
+                    float a = alpha[dx];
+                    float b = 1 - a;
+
+                    float v0 = w00 * (b * p00[0] + a * p01[0]) + beta * (b * p10[0] + a * p11[0]);
+                    float v1 = w00 * (b * p00[1] + a * p01[1]) + beta * (b * p10[1] + a * p11[1]);
+                    float v2 = w00 * (b * p00[2] + a * p01[2]) + beta * (b * p10[2] + a * p11[2]);
+                    out0[dx] = v0 * scale[0] + bias[0];
+                    out1[dx] = v1 * scale[1] + bias[1];
+                    out2[dx] = v2 * scale[2] + bias[2];
+                }
+            }
+        }
+
+    private:
+        CropConfig config_;
+        float scale_[3], bias_[3];
+        std::vector<ResizeTable> tables_;     // 每个线程一份
+
+        // 当前batch
+        Image image_;
+        const CropBox* boxes_ = nullptr;
+        float* output_ = nullptr;
+        int count_ = 0;
+        std::atomic<int> next_{0};
+
+        std::vector<std::thread> workers_;
+        std::mutex lock_;
+        std::condition_variable job_cv_, done_cv_;
+        uint64_t generation_ = 0;
+        size_t pending_ = 0;
+        bool stop_ = false;
+    };
+
+    std::shared_ptr<CropBatcher> create_crop_batcher(const CropConfig& config){
+        std::shared_ptr<CropBatcherImpl> instance(new CropBatcherImpl());
+        if(!instance->startup(config))
+            instance.reset();
+        return instance;
+    }
+
+    class DummyExtractor : public FeatureExtractor{
+    public:
+        DummyExtractor(int width, int height, int grid, int max_batch_size)
+            :width_(width), height_(height), grid_(grid), max_batch_size_(max_batch_size){}
+
+        virtual int dim() const override{return 3 * grid_ * grid_;}
+        virtual int max_batch_size() const override{return max_batch_size_;}
+
+        virtual bool forward(const float* input, int batch, float* output) override{
+
+            if(batch > max_batch_size_){
+                printf("Batch %d exceeds max batch size %d\n", batch, max_batch_size_);
+                return false;
+            }
+
+            int area = width_ * height_;
+            for(int n = 0; n < batch; ++n){
+                float* feature = output + (size_t)n * dim();
+                float* cell = feature;
+                for(int c = 0; c < 3; ++c){
+                    const float* plane = input + ((size_t)n * 3 + c) * area;
+                    for(int gy = 0; gy < grid_; ++gy){
+                        int y0 = gy * height_ / grid_, y1 = (gy + 1) * height_ / grid_;
+                        for(int gx = 0; gx < grid_; ++gx){
+                            int x0 = gx * width_ / grid_, x1 = (gx + 1) * width_ / grid_;
+                            double sum = 0;
+                            for(int y = y0; y < y1; ++y)
+                                for(int x = x0; x < x1; ++x)
+                                    sum += plane[y * width_ + x];
+
+                            int count = (y1 - y0) * (x1 - x0);
+                            *cell++ = count > 0 ? sum / count : 0;
+                        }
+                    }
+                }
+
+                double norm = 0;
+                for(int i = 0; i < dim(); ++i)
+                    norm += feature[i] * feature[i];
+
+                norm = std::sqrt(norm);
+                if(norm > 0){
+                    for(int i = 0; i < dim(); ++i)
+                        feature[i] /= norm;
+                }
+            }
+            return true;
+        }
+
+    private:
+        int width_, height_, grid_, max_batch_size_;
+    };
+
+    std::shared_ptr<FeatureExtractor> create_dummy_extractor(int input_width, int input_height, int grid, int max_batch_size){
+
+        if(input_width < 1 || input_height < 1 || grid < 1 || max_batch_size < 1){
+            printf("Invalid dummy extractor, input = %dx%d, grid = %d, max_batch_size = %d\n", input_width, input_height, grid, max_batch_size);
+            return nullptr;
+        }
+        return std::make_shared<DummyExtractor>(input_width, input_height, grid, max_batch_size);
+    }
+
+}; // namespace ReID
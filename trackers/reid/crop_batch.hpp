@@ -0,0 +1,75 @@
+
+#ifndef CROP_BATCH_HPP
+#define CROP_BATCH_HPP
+
+#include <memory>
+#include <vector>
+#include <stdint.h>
+
+/**
+ * ReID特征提取的批量预处理，不依赖OpenCV
+ * 一帧中所有目标框一次性裁剪、双线性缩放、归一化，直接写入N×3×H×W的平面float缓冲区，
+ * 缓冲区可以是推理引擎的输入tensor，每个框只读一遍原图、写一遍输出，框之间并行
+ */
+namespace ReID {
+
+struct CropBox{
+    float left, top, right, bottom;
+};
+
+// 输入图像，BGR交错的uint8，stride为每行字节数
+struct Image{
+    const uint8_t* data = nullptr;
+    int width  = 0;
+    int height = 0;
+    int stride = 0;
+
+    Image() = default;
+    Image(const uint8_t* data, int width, int height, int stride = 0)
+        :data(data), width(width), height(height), stride(stride > 0 ? stride : width * 3){}
+};
+
+struct CropConfig{
+    int width  = 256;
+    int height = 256;
+
+    // output = (pixel - mean) / std，按输出通道顺序
+    float mean[3] = {0, 0, 0};
+    float std[3]  = {1, 1, 1};
+    bool bgr2rgb  = false;
+
+    int num_threads = 0;    // 0表示std::thread::hardware_concurrency()
+};
+
+class CropBatcher{
+public:
+    // output至少为count * 3 * height * width个float，框会先裁剪到图像范围内，完全在图像外的框输出全0
+    virtual void process(const Image& image, const CropBox* boxes, int count, float* output) = 0;
+    virtual const CropConfig& config() const = 0;
+    virtual size_t sample_size() const = 0;     // 每个框的float个数，3 * height * width
+};
+
+std::shared_ptr<CropBatcher> create_crop_batcher(
+    const CropConfig& config = CropConfig()
+);
+
+// 特征提取器接口，一次处理一个batch
+class FeatureExtractor{
+public:
+    virtual int dim() const = 0;
+    virtual int max_batch_size() const = 0;
+    // input为batch * 3 * H * W，output为batch * dim，输出已做L2归一化
+    virtual bool forward(const float* input, int batch, float* output) = 0;
+};
+
+/**
+ * @brief CPU上的替身特征提取器，把每个通道划分为grid×grid的网格取平均，得到3 * grid * grid维的特征，
+ *        用于在没有GPU时验证预处理和跟踪流程，特征对颜色和大致布局敏感
+ */
+std::shared_ptr<FeatureExtractor> create_dummy_extractor(
+    int input_width = 256, int input_height = 256, int grid = 8, int max_batch_size = 64
+);
+
+}; // namespace ReID
+
+#endif // CROP_BATCH_HPP
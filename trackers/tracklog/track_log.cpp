@@ -0,0 +1,564 @@
+#include "track_log.hpp"
+
+#include <vector>
+#include <deque>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <algorithm>
+#include <cstring>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace TrackLog {
+
+    static const char FileMagic[8] = {'T', 'R', 'A', 'C', 'K', 'L', 'O', 'G'};
+    static const uint32_t FileVersion = 1;
+    static const uint32_t ChunkMagic = 0x4b4e4843;    // "CHNK"
+
+    struct FileHeader{
+        char magic[8];
+        uint32_t version;
+        uint32_t reserved;
+    };
+
+    struct ChunkHeader{
+        uint32_t magic;
+        uint32_t num_frames;
+        uint32_t num_records;
+        uint32_t bytes;         // 包括ChunkHeader在内的整个chunk的字节数
+    };
+
+    static const int NumFloatColumns = 5;
+    static const int NumIntColumns   = 2;
+
+    static size_t chunk_bytes(size_t num_frames, size_t num_records){
+        return sizeof(ChunkHeader) + sizeof(int32_t) * num_frames + sizeof(uint32_t) * (num_frames + 1)
+            + (sizeof(float) * NumFloatColumns + sizeof(int32_t) * NumIntColumns) * num_records;
+    }
+
+    /* 检查chunk内的frame列和offset列，frame严格递增，offset从0开始不减且以num_records结束 */
+    static bool valid_columns(const ChunkHeader& header, const int32_t* frames, const uint32_t* offsets){
+
+        if(offsets[0] != 0 || offsets[header.num_frames] != header.num_records)
+            return false;
+
+        for(uint32_t i = 1; i < header.num_frames; ++i){
+            if(frames[i] <= frames[i - 1])
+                return false;
+        }
+
+        for(uint32_t i = 0; i < header.num_frames; ++i){
+            if(offsets[i + 1] < offsets[i])
+                return false;
+        }
+        return true;
+    }
+
+    static bool valid_header(const ChunkHeader& header, size_t offset, size_t size){
+        return header.magic == ChunkMagic && header.num_frames > 0 &&
+               header.bytes == chunk_bytes(header.num_frames, header.num_records) &&
+               offset + header.bytes <= size;
+    }
+
+    /* 写入端按列累积一个chunk */
+    struct ChunkBuilder{
+        std::vector<int32_t> frames;
+        std::vector<uint32_t> offsets;
+        std::vector<float> columns[NumFloatColumns];
+        std::vector<int32_t> labels, track_ids;
+
+        ChunkBuilder(){offsets.push_back(0);}
+
+        void append(int frame, const Record* records, int count){
+            frames.push_back(frame);
+            for(int i = 0; i < count; ++i){
+                auto& r = records[i];
+                columns[0].push_back(r.left);
+                columns[1].push_back(r.top);
+                columns[2].push_back(r.right);
+                columns[3].push_back(r.bottom);
+                columns[4].push_back(r.score);
+                labels.push_back(r.label);
+                track_ids.push_back(r.track_id);
+            }
+            offsets.push_back(labels.size());
+        }
+
+        bool empty() const{return frames.empty();}
+
+        void serialize(std::vector<char>& output) const{
+
+            size_t num_frames  = frames.size();
+            size_t num_records = labels.size();
+            output.resize(chunk_bytes(num_frames, num_records));
+
+            ChunkHeader header;
+            header.magic       = ChunkMagic;
+            header.num_frames  = num_frames;
+            header.num_records = num_records;
+            header.bytes       = output.size();
+
+            char* p = output.data();
+            auto put = [&](const void* data, size_t size){
+                memcpy(p, data, size);
+                p += size;
+            };
+
+            put(&header, sizeof(header));
+            put(frames.data(), sizeof(int32_t) * num_frames);
+            put(offsets.data(), sizeof(uint32_t) * (num_frames + 1));
+            for(auto& column : columns)
+                put(column.data(), sizeof(float) * num_records);
+            put(labels.data(), sizeof(int32_t) * num_records);
+            put(track_ids.data(), sizeof(int32_t) * num_records);
+        }
+    };
+
+    class WriterImpl : public Writer{
+    public:
+        virtual ~WriterImpl(){
+            close();
+        }
+
+        bool open(const std::string& file, const WriterConfig& config){
+
+            if(config.chunk_frames < 1 || config.max_pending_chunks < 1){
+                printf("Invalid writer config, chunk_frames = %d, max_pending_chunks = %d\n", config.chunk_frames, config.max_pending_chunks);
+                return false;
+            }
+
+            // 追加模式打开时已有的数据不会被截断，写入总是在文件末尾
+            file_ = fopen(file.c_str(), config.truncate ? "wb+" : "ab+");
+            if(file_ == nullptr){
+                printf("Open %s failed.\n", file.c_str());
+                return false;
+            }
+
+            if(!resume(file)){
+                fclose(file_);
+                file_ = nullptr;
+                return false;
+            }
+
+            config_ = config;
+            worker_ = std::thread(&WriterImpl::worker, this);
+            return true;
+        }
+
+        virtual bool append(int frame, const Record* records, int count) override{
+
+            if(file_ == nullptr)
+                return false;
+
+            if(frames_ > 0 && frame <= last_frame_){
+                printf("Frame %d is not after the last frame %d\n", frame, last_frame_);
+                return false;
+            }
+
+            current_.append(frame, records, count);
+            last_frame_ = frame;
+            ++frames_;
+            if(current_.frames.size() >= config_.chunk_frames)
+                submit();
+            return true;
+        }
+
+        virtual void flush() override{
+            if(file_ == nullptr)
+                return;
+
+            submit();
+            std::unique_lock<std::mutex> l(lock_);
+            cv_.wait(l, [&]{return pending_.empty() && !writing_;});
+            fflush(file_);
+        }
+
+        virtual void close() override{
+            if(file_ == nullptr)
+                return;
+
+            flush();
+            {
+                std::unique_lock<std::mutex> l(lock_);
+                stop_ = true;
+            }
+            cv_.notify_all();
+            worker_.join();
+            fclose(file_);
+            file_ = nullptr;
+        }
+
+        virtual uint64_t frames() const override{return frames_;}
+        virtual uint64_t bytes_written() const override{return bytes_written_;}
+
+    private:
+        /**
+         * 新文件写入文件头。已有文件检查文件头，逐个校验chunk，
+         * 从最后一个完整的chunk之后继续写，末尾不完整的数据被截掉
+         */
+        bool resume(const std::string& file){
+
+            fseek(file_, 0, SEEK_END);
+            size_t size = ftell(file_);
+            if(size == 0){
+                FileHeader header;
+                memcpy(header.magic, FileMagic, sizeof(FileMagic));
+                header.version  = FileVersion;
+                header.reserved = 0;
+                if(fwrite(&header, sizeof(header), 1, file_) != 1){
+                    printf("Write %s failed.\n", file.c_str());
+                    return false;
+                }
+                bytes_written_ = sizeof(header);
+                return true;
+            }
+
+            FileHeader header;
+            fseek(file_, 0, SEEK_SET);
+            if(size < sizeof(header) || fread(&header, sizeof(header), 1, file_) != 1 ||
+               memcmp(header.magic, FileMagic, sizeof(FileMagic)) != 0 || header.version != FileVersion){
+                printf("%s exists and is not a track log or version mismatch.\n", file.c_str());
+                return false;
+            }
+
+            size_t offset = sizeof(header);
+            std::vector<int32_t> frames;
+            std::vector<uint32_t> offsets;
+            while(offset + sizeof(ChunkHeader) <= size){
+                ChunkHeader chunk;
+                fseek(file_, offset, SEEK_SET);
+                if(fread(&chunk, sizeof(chunk), 1, file_) != 1 || !valid_header(chunk, offset, size))
+                    break;
+
+                frames.resize(chunk.num_frames);
+                offsets.resize(chunk.num_frames + 1);
+                if(fread(frames.data(), sizeof(int32_t), frames.size(), file_) != frames.size() ||
+                   fread(offsets.data(), sizeof(uint32_t), offsets.size(), file_) != offsets.size() ||
+                   !valid_columns(chunk, frames.data(), offsets.data()) ||
+                   (frames_ > 0 && frames[0] <= last_frame_))
+                    break;
+
+                frames_    += chunk.num_frames;
+                last_frame_ = frames.back();
+                offset     += chunk.bytes;
+            }
+
+            if(offset != size){
+                printf("%s has %d bytes of incomplete data at the end, truncated.\n", file.c_str(), int(size - offset));
+                fflush(file_);
+                if(ftruncate(fileno(file_), offset) != 0){
+                    printf("Truncate %s failed.\n", file.c_str());
+                    return false;
+                }
+            }
+
+            fseek(file_, 0, SEEK_END);
+            bytes_written_ = offset;
+            if(frames_ > 0)
+                printf("Resume %s after frame %d, %d frames exist.\n", file.c_str(), last_frame_, (int)frames_);
+            return true;
+        }
+
+        void submit(){
+            if(current_.empty())
+                return;
+
+            std::unique_lock<std::mutex> l(lock_);
+            cv_.wait(l, [&]{return pending_.size() < config_.max_pending_chunks;});
+            pending_.emplace_back(std::move(current_));
+            current_ = ChunkBuilder();
+            cv_.notify_all();
+        }
+
+        void worker(){
+
+            std::vector<char> buffer;
+            while(true){
+                ChunkBuilder chunk;
+                {
+                    std::unique_lock<std::mutex> l(lock_);
+                    cv_.wait(l, [&]{return stop_ || !pending_.empty();});
+                    if(pending_.empty())
+                        return;
+
+                    chunk = std::move(pending_.front());
+                    pending_.pop_front();
+                    writing_ = true;
+                }
+
+                chunk.serialize(buffer);
+                if(fwrite(buffer.data(), 1, buffer.size(), file_) != buffer.size())
+                    printf("Write chunk failed, %d frames lost\n", (int)chunk.frames.size());
+                else
+                    bytes_written_ += buffer.size();
+
+                std::unique_lock<std::mutex> l(lock_);
+                writing_ = false;
+                cv_.notify_all();
+            }
+        }
+
+    private:
+        WriterConfig config_;
+        FILE* file_ = nullptr;
+        ChunkBuilder current_;
+        int last_frame_ = 0;
+        uint64_t frames_ = 0;
+        std::atomic<uint64_t> bytes_written_{0};
+
+        std::thread worker_;
+        std::mutex lock_;
+        std::condition_variable cv_;
+        std::deque<ChunkBuilder> pending_;
+        bool writing_ = false;
+        bool stop_ = false;
+    };
+
+    std::shared_ptr<Writer> create_writer(const std::string& file, const WriterConfig& config){
+        std::shared_ptr<WriterImpl> instance(new WriterImpl());
+        if(!instance->open(file, config))
+            instance.reset();
+        return instance;
+    }
+
+    /* 读取端每个chunk的列指针，都指向mmap的内存 */
+    struct ChunkView{
+        int num_frames = 0;
+        const int32_t* frames = nullptr;
+        const uint32_t* offsets = nullptr;
+        const float* columns[NumFloatColumns];
+        const int32_t* labels = nullptr;
+        const int32_t* track_ids = nullptr;
+
+        void frame_at(int i, FrameView& view) const{
+            uint32_t begin = offsets[i];
+            view.frame    = frames[i];
+            view.count    = offsets[i + 1] - begin;
+            view.left     = columns[0] + begin;
+            view.top      = columns[1] + begin;
+            view.right    = columns[2] + begin;
+            view.bottom   = columns[3] + begin;
+            view.score    = columns[4] + begin;
+            view.label    = labels + begin;
+            view.track_id = track_ids + begin;
+        }
+    };
+
+    class ReaderImpl : public Reader{
+    public:
+        virtual ~ReaderImpl(){
+            if(data_ != nullptr)
+                munmap((void*)data_, size_);
+        }
+
+        bool open(const std::string& file){
+
+            int fd = ::open(file.c_str(), O_RDONLY);
+            if(fd < 0){
+                printf("Open %s failed.\n", file.c_str());
+                return false;
+            }
+
+            struct stat st;
+            if(fstat(fd, &st) != 0 || st.st_size < sizeof(FileHeader)){
+                printf("%s is not a track log.\n", file.c_str());
+                ::close(fd);
+                return false;
+            }
+
+            size_ = st.st_size;
+            void* ptr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+            if(ptr == MAP_FAILED){
+                printf("mmap %s failed.\n", file.c_str());
+                return false;
+            }
+            data_ = (const char*)ptr;
+
+            auto header = (const FileHeader*)data_;
+            if(memcmp(header->magic, FileMagic, sizeof(FileMagic)) != 0 || header->version != FileVersion){
+                printf("%s is not a track log or version mismatch.\n", file.c_str());
+                return false;
+            }
+            return index_chunks(file);
+        }
+
+        virtual int num_frames() const override{return num_frames_;}
+        virtual uint64_t num_records() const override{return num_records_;}
+        virtual int first_frame() const override{return chunks_.empty() ? 0 : chunks_.front().frames[0];}
+        virtual int last_frame() const override{return chunks_.empty() ? 0 : chunks_.back().frames[chunks_.back().num_frames - 1];}
+
+        virtual bool frame(int frame, FrameView& view) const override{
+
+            int chunk = find_chunk(frame);
+            if(chunk < 0)
+                return false;
+
+            auto& c = chunks_[chunk];
+            auto iter = std::lower_bound(c.frames, c.frames + c.num_frames, frame);
+            if(iter == c.frames + c.num_frames || *iter != frame)
+                return false;
+
+            c.frame_at(iter - c.frames, view);
+            return true;
+        }
+
+        virtual int range(int begin, int end, const std::function<void(const FrameView& view)>& visitor) const override{
+
+            int visited = 0;
+            int chunk = std::max(0, find_chunk(begin));
+            FrameView view;
+            for(; chunk < chunks_.size(); ++chunk){
+                auto& c = chunks_[chunk];
+                int i = std::lower_bound(c.frames, c.frames + c.num_frames, begin) - c.frames;
+                for(; i < c.num_frames; ++i){
+                    if(c.frames[i] >= end)
+                        return visited;
+
+                    c.frame_at(i, view);
+                    visitor(view);
+                    ++visited;
+                }
+            }
+            return visited;
+        }
+
+    private:
+        /* 只读取每个chunk的头，建立帧号到chunk的索引 */
+        bool index_chunks(const std::string& file){
+
+            size_t offset = sizeof(FileHeader);
+            while(offset + sizeof(ChunkHeader) <= size_){
+                auto header = (const ChunkHeader*)(data_ + offset);
+                if(!valid_header(*header, offset, size_))
+                    break;
+
+                const char* p = data_ + offset + sizeof(ChunkHeader);
+                ChunkView c;
+                c.num_frames = header->num_frames;
+                c.frames     = (const int32_t*)p;   p += sizeof(int32_t) * header->num_frames;
+                c.offsets    = (const uint32_t*)p;  p += sizeof(uint32_t) * (header->num_frames + 1);
+                for(auto& column : c.columns){
+                    column = (const float*)p;
+                    p += sizeof(float) * header->num_records;
+                }
+                c.labels     = (const int32_t*)p;   p += sizeof(int32_t) * header->num_records;
+                c.track_ids  = (const int32_t*)p;
+
+                // offset列决定了帧内记录的范围，不合法时frame_at会越界，按损坏处理
+                if(!valid_columns(*header, c.frames, c.offsets) ||
+                   (!chunks_.empty() && c.frames[0] <= last_frame())){
+                    printf("%s has an invalid chunk at %d.\n", file.c_str(), (int)offset);
+                    break;
+                }
+
+                chunks_.push_back(c);
+                first_frames_.push_back(c.frames[0]);
+                num_frames_  += header->num_frames;
+                num_records_ += header->num_records;
+                offset       += header->bytes;
+            }
+
+            if(offset != size_)
+                printf("%s has %d bytes of incomplete data at the end, ignored.\n", file.c_str(), int(size_ - offset));
+            return true;
+        }
+
+        /* 包含frame的chunk，即first_frame <= frame的最后一个chunk，不存在时返回-1 */
+        int find_chunk(int frame) const{
+            auto iter = std::upper_bound(first_frames_.begin(), first_frames_.end(), frame);
+            return int(iter - first_frames_.begin()) - 1;
+        }
+
+    private:
+        const char* data_ = nullptr;
+        size_t size_ = 0;
+        std::vector<ChunkView> chunks_;
+        std::vector<int> first_frames_;
+        int num_frames_ = 0;
+        uint64_t num_records_ = 0;
+    };
+
+    std::shared_ptr<Reader> open_reader(const std::string& file){
+        std::shared_ptr<ReaderImpl> instance(new ReaderImpl());
+        if(!instance->open(file))
+            instance.reset();
+        return instance;
+    }
+
+    bool is_log_file(const std::string& file){
+
+        FILE* f = fopen(file.c_str(), "rb");
+        if(f == nullptr)
+            return false;
+
+        FileHeader header;
+        bool ok = fread(&header, sizeof(header), 1, f) == 1 && memcmp(header.magic, FileMagic, sizeof(FileMagic)) == 0;
+        fclose(f);
+        return ok;
+    }
+
+    bool text_to_log(const std::string& text_file, const std::string& log_file){
+
+        FILE* f = fopen(text_file.c_str(), "rb");
+        if(f == nullptr){
+            printf("Open %s failed.\n", text_file.c_str());
+            return false;
+        }
+
+        // 文本中的帧不保证有序，先按帧号归并
+        std::map<int, std::vector<Record>> frames;
+        char line[512];
+        while(fgets(line, sizeof(line), f)){
+            int frame = 0;
+            Record r;
+            int n = sscanf(line, "%d %f %f %f %f %f %d %d", &frame, &r.left, &r.top, &r.right, &r.bottom, &r.score, &r.label, &r.track_id);
+            if(n < 6)
+                continue;
+            frames[frame].push_back(r);
+        }
+        fclose(f);
+
+        WriterConfig config;
+        config.truncate = true;
+        auto writer = create_writer(log_file, config);
+        if(writer == nullptr)
+            return false;
+
+        for(auto& item : frames)
+            writer->append(item.first, item.second.data(), item.second.size());
+        writer->close();
+        return true;
+    }
+
+    bool log_to_text(const std::string& log_file, const std::string& text_file){
+
+        auto reader = open_reader(log_file);
+        if(reader == nullptr)
+            return false;
+
+        FILE* f = fopen(text_file.c_str(), "wb");
+        if(f == nullptr){
+            printf("Open %s failed.\n", text_file.c_str());
+            return false;
+        }
+
+        reader->range(reader->first_frame(), reader->last_frame() + 1, [&](const FrameView& view){
+            for(int i = 0; i < view.count; ++i){
+                fprintf(f, "%d %f %f %f %f %f", view.frame, view.left[i], view.top[i], view.right[i], view.bottom[i], view.score[i]);
+                if(view.label[i] != 0 || view.track_id[i] != -1)
+                    fprintf(f, " %d %d", view.label[i], view.track_id[i]);
+                fprintf(f, "\n");
+            }
+        });
+        fclose(f);
+        return true;
+    }
+
+}; // namespace TrackLog
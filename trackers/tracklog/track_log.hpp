@@ -0,0 +1,91 @@
+
+#ifndef TRACK_LOG_HPP
+#define TRACK_LOG_HPP
+
+#include <memory>
+#include <string>
+#include <functional>
+#include <stdint.h>
+
+/**
+ * 检测/跟踪结果的二进制列式日志，只追加写入
+ *
+ * 文件由16字节的文件头和若干chunk组成，每个chunk保存连续若干帧：
+ *   ChunkHeader | frame[F] | offset[F+1] | left[R] | top[R] | right[R] | bottom[R] | score[R] | label[R] | track_id[R]
+ * 所有列都是4字节定宽、小端，第i帧的记录为offset[i]到offset[i+1]。
+ * 写入在后台线程完成，进程中断时最多丢失未落盘的chunk，末尾不完整的chunk在读取时被忽略，
+ * 再次以写入方式打开时被截掉，新的帧接在最后一个完整的chunk之后。
+ * 读取通过mmap完成，FrameView直接指向文件映射的内存，不做拷贝
+ */
+namespace TrackLog {
+
+struct Record{
+    float left, top, right, bottom, score;
+    int label    = 0;
+    int track_id = -1;    // 检测结果为-1
+
+    Record() = default;
+    Record(float left, float top, float right, float bottom, float score, int label = 0, int track_id = -1)
+        :left(left), top(top), right(right), bottom(bottom), score(score), label(label), track_id(track_id){}
+};
+
+// 一帧的全部记录，指针在Reader存活期间有效
+struct FrameView{
+    int frame = 0;
+    int count = 0;
+    const float *left = nullptr, *top = nullptr, *right = nullptr, *bottom = nullptr, *score = nullptr;
+    const int32_t *label = nullptr, *track_id = nullptr;
+
+    Record record(int i) const{return Record(left[i], top[i], right[i], bottom[i], score[i], label[i], track_id[i]);}
+};
+
+struct WriterConfig{
+    int chunk_frames       = 256;   // 每个chunk包含的帧数
+    int max_pending_chunks = 16;    // 等待落盘的chunk上限，超过时append阻塞
+    bool truncate          = false; // 为true时清空已有的文件重新写，否则接在已有的数据之后
+};
+
+class Writer{
+public:
+    // frame必须严格递增，count可以为0
+    virtual bool append(int frame, const Record* records, int count) = 0;
+    // 把当前未满的chunk交给后台线程并等待全部落盘
+    virtual void flush() = 0;
+    virtual void close() = 0;
+    virtual uint64_t frames() const = 0;
+    virtual uint64_t bytes_written() const = 0;
+};
+
+// 文件已存在且没有设置truncate时追加写入，frame需要大于文件中的最后一帧，frames()和bytes_written()包括已有的部分
+std::shared_ptr<Writer> create_writer(
+    const std::string& file,
+    const WriterConfig& config = WriterConfig()
+);
+
+class Reader{
+public:
+    virtual int num_frames() const = 0;
+    virtual uint64_t num_records() const = 0;
+    virtual int first_frame() const = 0;
+    virtual int last_frame() const = 0;
+    // 帧不存在时返回false
+    virtual bool frame(int frame, FrameView& view) const = 0;
+    // 按帧序访问[begin, end)内所有存在的帧，返回访问的帧数
+    virtual int range(int begin, int end, const std::function<void(const FrameView& view)>& visitor) const = 0;
+};
+
+std::shared_ptr<Reader> open_reader(const std::string& file);
+
+// 根据文件头判断是否是TrackLog文件
+bool is_log_file(const std::string& file);
+
+/**
+ * 与文本格式互相转换，文本每行为 "frame left top right bottom score [label [track_id]]"，
+ * 即track.meta.txt的格式。label为0且track_id为-1时只输出前6列
+ */
+bool text_to_log(const std::string& text_file, const std::string& log_file);
+bool log_to_text(const std::string& log_file, const std::string& text_file);
+
+}; // namespace TrackLog
+
+#endif // TRACK_LOG_HPP